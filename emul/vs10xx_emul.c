@@ -0,0 +1,679 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx emulator, a virtual spi master and gpio chip with a vs1053/vs1063 model.
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+/*
+    Load before the driver, the gpio chip has no interrupts so the driver polls DREQ:
+
+        insmod vs10xx_emul.ko devices=2 bitrate=128000
+        insmod vs10xx.ko irqmode=0
+
+    Unload in reverse order, the driver does not handle its spi devices going away.
+
+    Chip select 2n is the ctrl (SCI) and 2n+1 the data (SDI) device of emulated device n.
+    The model keeps the SCI register file, WRAM writes (the parametric area is readable),
+    a 2048 byte stream buffer drained at bitrate with DREQ low when less than 32 bytes are
+    free, software reset and the SM_CANCEL handshake. HDAT0/1 are taken from the first bytes
+    of a stream, mp3 frame headers and RIFF/OggS/fLaC are recognized. Writing n to the hang
+    parameter hangs device n-1 on its next SDI write: it stops decoding, DREQ goes low once
+    the stream buffer is full and only a reset brings it back.
+
+    The VS1063 rateTune (0x1E07/08) and sampleCounter (0x1E0A/0B) parameters are modelled on
+    top of a crystal error of n * xtalppm ppm for device n, for testing drift correction.
+*/
+
+#include "vs10xx_common.h"
+
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/spi/spi.h>
+#include <linux/gpio.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/delay.h>
+
+/* number of emulated devices */
+static int devices = 1;
+module_param(devices, int, 0444);
+
+/* chip version, 1053 or 1063 */
+static int chip = 1053;
+module_param(chip, int, 0444);
+
+/* stream consumption [bit/s] */
+static int bitrate = 128000;
+module_param(bitrate, int, 0644);
+
+/* spi clock [kHz] to spend per byte, 0: transfers take no time */
+static int spikhz = 0;
+module_param(spikhz, int, 0644);
+
+/* endfill bytes before SM_CANCEL clears */
+static int cancelbytes = 64;
+module_param(cancelbytes, int, 0644);
+
+/* crystal error [ppm] of device n is n * xtalppm */
+static int xtalppm = 0;
+module_param(xtalppm, int, 0644);
+
+/* hang device n-1 on its next sdi write, 0: none */
+static int hang = 0;
+module_param(hang, int, 0644);
+
+/* spi bus number, -1: dynamic */
+static int busnum = -1;
+module_param(busnum, int, 0444);
+
+MODULE_DESCRIPTION("vs10xx emulator");
+MODULE_AUTHOR("Richard van Paasen");
+MODULE_LICENSE("GPL v2");
+
+#define EMUL_FIFO 2048
+#define EMUL_PARAM 0x1E00
+#define EMUL_PARAMS 0x40
+
+struct vs10xx_emul_chip {
+	spinlock_t lock;
+	int reset;
+	int hung;
+	unsigned short sci[16];
+	unsigned short wramaddr;
+	unsigned short param[EMUL_PARAMS];
+	unsigned long wramwords;
+	unsigned int fill;
+	ktime_t stamp;
+	u64 consumed;
+	u64 counted;
+	unsigned int cancel;
+	unsigned char head[4];
+	unsigned int heads;
+	unsigned long overflows;
+	unsigned long sdibytes;
+	/* sci command parser */
+	int n;
+	unsigned char cmd[4];
+	unsigned short latch;
+};
+
+/* per device, allocated for the devices parameter */
+static struct vs10xx_emul_chip *vs10xx_emul_chips;
+static struct vs10xx_board_info *vs10xx_emul_board;
+
+static struct platform_device *vs10xx_emul_pdev;
+static struct spi_master *vs10xx_emul_master;
+static struct gpio_chip vs10xx_emul_gpio;
+static int vs10xx_emul_gpiook;
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX EMUL DECODER MODEL                                                                                                     */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static void vs10xx_emul_drain(struct vs10xx_emul_chip *c) {
+/*
+ *  Descr:  Consume stream buffer bytes at bitrate since the last call
+ *  Return: -
+ */
+
+	ktime_t now = ktime_get();
+	unsigned int rate = MAX(bitrate, 8) / 8;
+	s64 ns = ktime_to_ns(ktime_sub(now, c->stamp));
+	s32 ppm = (int)(c - vs10xx_emul_chips) * xtalppm + (s32)(c->param[0x07] | (c->param[0x08] << 16));
+	u64 mrate, used;
+
+	if (c->reset || c->hung || (c->sci[0x00] & 0x0008) || ns <= 0) {
+		c->stamp = now;
+		return;
+	}
+
+	/* [bytes/1000s], fine enough for the ppm of crystal error and rateTune */
+	mrate = (u64)rate * 1000 + div_s64((s64)rate * ppm, 1000);
+	used = div_u64(div_u64(mrate * ns, 1000), NSEC_PER_SEC);
+
+	if (used >= c->fill) {
+
+		/* starved, time does not carry over */
+		c->consumed += c->fill;
+		c->counted += c->fill;
+		c->fill = 0;
+		c->stamp = now;
+
+	} else if (used > 0) {
+
+		/* advance by the time the used bytes took, keep the remainder */
+		c->consumed += used;
+		c->counted += used;
+		c->fill -= (unsigned int)used;
+		c->stamp = ktime_add_ns(c->stamp, div_u64(used * 1000 * NSEC_PER_SEC, (u32)mrate));
+	}
+}
+
+static int vs10xx_emul_dreq(struct vs10xx_emul_chip *c) {
+
+	vs10xx_emul_drain(c);
+
+	return (!c->reset && c->fill + 32 <= EMUL_FIFO);
+}
+
+static void vs10xx_emul_stream(struct vs10xx_emul_chip *c) {
+/*
+ *  Descr:  Forget the current stream (reset, cancel)
+ *  Return: -
+ */
+
+	c->fill = 0;
+	c->consumed = 0;
+	c->heads = 0;
+	c->cancel = 0;
+	c->stamp = ktime_get();
+	c->sci[0x04] = 0;
+	c->sci[0x05] = 0;
+	c->sci[0x08] = 0;
+	c->sci[0x09] = 0;
+}
+
+static void vs10xx_emul_swreset(struct vs10xx_emul_chip *c) {
+
+	unsigned short mode = c->sci[0x00] & ~0x000C;
+
+	memset(c->sci, 0, sizeof(c->sci));
+	memset(c->param, 0, sizeof(c->param));
+
+	c->sci[0x00] = mode | 0x0800;
+	c->sci[0x01] = (chip == 1063 ? 6 : 4) << 4;
+	c->wramaddr = 0;
+	c->hung = 0;
+	c->counted = 0;
+
+	vs10xx_emul_stream(c);
+}
+
+static void vs10xx_emul_header(struct vs10xx_emul_chip *c, unsigned char b) {
+/*
+ *  Descr:  Recognize the stream from its first four bytes, like the decoder fills HDAT0/1
+ *  Return: -
+ */
+
+	if (c->heads == 0 && b == 0) {
+
+		/* padding, like the two bytes after a reset */
+		return;
+	}
+
+	if (c->heads < 4) {
+
+		c->head[c->heads++] = b;
+
+		if (c->heads == 4) {
+
+			c->sci[0x05] = 0xAC45;
+
+			if (c->head[0] == 0xFF && (c->head[1] & 0xE0) == 0xE0) {
+				c->sci[0x09] = (c->head[0] << 8) | c->head[1];
+				c->sci[0x08] = (c->head[2] << 8) | c->head[3];
+			} else if (!memcmp(c->head, "RIFF", 4)) {
+				c->sci[0x09] = 0x7665;
+				c->sci[0x08] = bitrate / 8;
+			} else if (!memcmp(c->head, "OggS", 4)) {
+				c->sci[0x09] = 0x4F67;
+				c->sci[0x08] = bitrate / 8;
+			} else if (!memcmp(c->head, "fLaC", 4)) {
+				c->sci[0x09] = 0x664C;
+				c->sci[0x08] = bitrate / 8;
+			} else {
+				c->sci[0x05] = 0;
+			}
+		}
+	}
+}
+
+static void vs10xx_emul_sdi(struct vs10xx_emul_chip *c, const unsigned char *buf, unsigned len) {
+
+	unsigned i;
+
+	vs10xx_emul_drain(c);
+
+	c->sdibytes += len;
+
+	if (hang == (int)(c - vs10xx_emul_chips) + 1) {
+		hang = 0;
+		c->hung = 1;
+	}
+
+	if (c->sci[0x00] & 0x0008) {
+
+		/* cancelling, the decoder acknowledges after some endfill bytes */
+		c->cancel += len;
+		if (c->cancel >= cancelbytes) {
+			c->sci[0x00] &= ~0x0008;
+			vs10xx_emul_stream(c);
+		}
+		return;
+	}
+
+	if (c->fill + len > EMUL_FIFO) {
+		/* sent with DREQ low, the real chip would lose data */
+		c->overflows++;
+		len = EMUL_FIFO - c->fill;
+	}
+
+	for (i = 0; buf && i < len && c->heads < 4; i++) {
+		vs10xx_emul_header(c, buf[i]);
+	}
+
+	c->fill += len;
+}
+
+static unsigned short vs10xx_emul_sciread(struct vs10xx_emul_chip *c, unsigned char reg) {
+
+	unsigned short val;
+	unsigned int rate = MAX(bitrate, 8) / 8;
+
+	vs10xx_emul_drain(c);
+
+	switch (reg & 0x0F) {
+
+		case 0x04:
+			/* decode time counts from the last write */
+			return c->sci[0x04] + (unsigned short)div_u64(c->consumed, rate);
+
+		case 0x06:
+			val = 0;
+			if (c->wramaddr == EMUL_PARAM + 0x0A || c->wramaddr == EMUL_PARAM + 0x0B) {
+				/* sampleCounter, at 44.1 kHz like SCI_AUDATA says */
+				u64 samples = div_u64(c->counted * 44100, rate);
+				val = (c->wramaddr == EMUL_PARAM + 0x0A ? samples & 0xFFFF : (samples >> 16) & 0xFFFF);
+			} else if (c->wramaddr >= EMUL_PARAM && c->wramaddr < EMUL_PARAM + EMUL_PARAMS) {
+				val = c->param[c->wramaddr - EMUL_PARAM];
+			}
+			c->wramaddr++;
+			return val;
+
+		case 0x07:
+			return c->wramaddr;
+
+		default:
+			return c->sci[reg & 0x0F];
+	}
+}
+
+static void vs10xx_emul_sciwrite(struct vs10xx_emul_chip *c, unsigned char reg, unsigned short val) {
+
+	vs10xx_emul_drain(c);
+
+	switch (reg & 0x0F) {
+
+		case 0x00:
+			c->sci[0x00] = val;
+			if (val & 0x0004) {
+				vs10xx_emul_swreset(c);
+			} else if (val & 0x0008) {
+				c->cancel = 0;
+			}
+			break;
+
+		case 0x01:
+			/* version bits are read-only */
+			c->sci[0x01] = (c->sci[0x01] & 0x00F0) | (val & ~0x00F0);
+			break;
+
+		case 0x04:
+			c->sci[0x04] = val;
+			c->consumed = 0;
+			break;
+
+		case 0x06:
+			if (c->wramaddr == EMUL_PARAM + 0x0A || c->wramaddr == EMUL_PARAM + 0x0B) {
+				/* sampleCounter can only be cleared */
+				c->counted = 0;
+			} else if (c->wramaddr >= EMUL_PARAM && c->wramaddr < EMUL_PARAM + EMUL_PARAMS) {
+				c->param[c->wramaddr - EMUL_PARAM] = val;
+			}
+			c->wramaddr++;
+			c->wramwords++;
+			break;
+
+		case 0x07:
+			c->wramaddr = val;
+			break;
+
+		case 0x08:
+		case 0x09:
+			/* HDAT0/1 are read-only */
+			break;
+
+		default:
+			c->sci[reg & 0x0F] = val;
+			break;
+	}
+}
+
+static unsigned char vs10xx_emul_sci(struct vs10xx_emul_chip *c, unsigned char in) {
+/*
+ *  Descr:  Clock one byte through the sci, 0x02 reg msb lsb writes and 0x03 reg reads two bytes
+ *  Return: byte clocked out
+ */
+
+	unsigned char out = 0;
+
+	if (c->n < 4) {
+
+		if (c->cmd[0] == 0x03 && c->n >= 2) {
+			out = (c->n == 2 ? c->latch >> 8 : c->latch & 0xFF);
+		}
+
+		c->cmd[c->n++] = in;
+
+		if (c->n == 2 && c->cmd[0] == 0x03) {
+			c->latch = vs10xx_emul_sciread(c, c->cmd[1]);
+		} else if (c->n == 4 && c->cmd[0] == 0x02) {
+			vs10xx_emul_sciwrite(c, c->cmd[1], (c->cmd[2] << 8) | c->cmd[3]);
+		}
+	}
+
+	return out;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX EMUL SPI MASTER                                                                                                        */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static int vs10xx_emul_setup(struct spi_device *spi) {
+
+	return (spi->chip_select < 2 * devices ? 0 : -EINVAL);
+}
+
+static int vs10xx_emul_transfer(struct spi_device *spi, struct spi_message *mesg) {
+/*
+ *  Descr:  Run the message to completion right away, spi_sync callers are woken before we return
+ *  Return: 0
+ */
+
+	struct vs10xx_emul_chip *c = &vs10xx_emul_chips[spi->chip_select / 2];
+	int data = spi->chip_select & 1;
+	struct spi_transfer *xfer;
+	unsigned long flags;
+	unsigned i;
+
+	mesg->actual_length = 0;
+
+	spin_lock_irqsave(&c->lock, flags);
+
+	/* chip select starts a new sci command */
+	c->n = 0;
+	memset(c->cmd, 0, sizeof(c->cmd));
+
+	list_for_each_entry(xfer, &mesg->transfers, transfer_list) {
+
+		const unsigned char *tx = xfer->tx_buf;
+		unsigned char *rx = xfer->rx_buf;
+
+		if (data) {
+
+			vs10xx_emul_sdi(c, tx, xfer->len);
+			if (rx) {
+				memset(rx, 0, xfer->len);
+			}
+
+		} else {
+
+			for (i = 0; i < xfer->len; i++) {
+				unsigned char out = vs10xx_emul_sci(c, tx ? tx[i] : 0);
+				if (rx) {
+					rx[i] = out;
+				}
+			}
+		}
+
+		if (xfer->cs_change) {
+			c->n = 0;
+			memset(c->cmd, 0, sizeof(c->cmd));
+		}
+
+		mesg->actual_length += xfer->len;
+	}
+
+	spin_unlock_irqrestore(&c->lock, flags);
+
+	if (spikhz > 0) {
+		/* 8 clocks per byte */
+		udelay(mesg->actual_length * 8000 / spikhz);
+	}
+
+	mesg->status = 0;
+	mesg->complete(mesg->context);
+
+	return 0;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX EMUL GPIO                                                                                                              */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+/* gpio 2n is the reset and 2n+1 the DREQ line of device n */
+
+static int vs10xx_emul_gpio_get(struct gpio_chip *gc, unsigned offset) {
+
+	struct vs10xx_emul_chip *c = &vs10xx_emul_chips[offset / 2];
+	unsigned long flags;
+	int val;
+
+	spin_lock_irqsave(&c->lock, flags);
+	val = (offset & 1 ? vs10xx_emul_dreq(c) : !c->reset);
+	spin_unlock_irqrestore(&c->lock, flags);
+
+	return val;
+}
+
+static void vs10xx_emul_gpio_set(struct gpio_chip *gc, unsigned offset, int value) {
+
+	struct vs10xx_emul_chip *c = &vs10xx_emul_chips[offset / 2];
+	unsigned long flags;
+
+	if (offset & 1) {
+		return;
+	}
+
+	spin_lock_irqsave(&c->lock, flags);
+
+	if (!value) {
+		/* held in reset, comes out as after power on */
+		c->sci[0x00] = 0x0800;
+		vs10xx_emul_swreset(c);
+	}
+	c->reset = !value;
+
+	spin_unlock_irqrestore(&c->lock, flags);
+}
+
+static int vs10xx_emul_gpio_input(struct gpio_chip *gc, unsigned offset) {
+
+	return (offset & 1 ? 0 : -EINVAL);
+}
+
+static int vs10xx_emul_gpio_output(struct gpio_chip *gc, unsigned offset, int value) {
+
+	if (offset & 1) {
+		return -EINVAL;
+	}
+
+	vs10xx_emul_gpio_set(gc, offset, value);
+
+	return 0;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX EMUL INIT/EXIT                                                                                                         */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static void vs10xx_emul_cleanup(void) {
+
+	int i;
+
+	if (vs10xx_emul_master) {
+		/* also unregisters the spi devices */
+		spi_unregister_master(vs10xx_emul_master);
+		vs10xx_emul_master = NULL;
+	}
+
+	if (vs10xx_emul_gpiook) {
+		if (gpiochip_remove(&vs10xx_emul_gpio) < 0) {
+			vs10xx_err("gpiochip_remove");
+		}
+		vs10xx_emul_gpiook = 0;
+	}
+
+	if (vs10xx_emul_pdev) {
+		platform_device_unregister(vs10xx_emul_pdev);
+		vs10xx_emul_pdev = NULL;
+	}
+
+	for (i = 0; vs10xx_emul_chips && i < devices; i++) {
+		vs10xx_inf("id:%d sdibytes:%lu overflows:%lu wramwords:%lu", i,
+			vs10xx_emul_chips[i].sdibytes, vs10xx_emul_chips[i].overflows, vs10xx_emul_chips[i].wramwords);
+	}
+
+	kfree(vs10xx_emul_board);
+	vs10xx_emul_board = NULL;
+
+	kfree(vs10xx_emul_chips);
+	vs10xx_emul_chips = NULL;
+}
+
+static int __init vs10xx_emul_init(void) {
+
+	struct spi_board_info info;
+	struct spi_master *master;
+	int i, status = 0;
+
+	if (devices < 1) {
+		vs10xx_err("devices:%d out of range", devices);
+		return -EINVAL;
+	}
+
+	vs10xx_emul_chips = kcalloc(devices, sizeof(*vs10xx_emul_chips), GFP_KERNEL);
+	vs10xx_emul_board = kcalloc(devices, sizeof(*vs10xx_emul_board), GFP_KERNEL);
+	if (vs10xx_emul_chips == NULL || vs10xx_emul_board == NULL) {
+		vs10xx_err("kcalloc devices:%d", devices);
+		vs10xx_emul_cleanup();
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < devices; i++) {
+		spin_lock_init(&vs10xx_emul_chips[i].lock);
+		vs10xx_emul_chips[i].sci[0x00] = 0x0800;
+		vs10xx_emul_swreset(&vs10xx_emul_chips[i]);
+	}
+
+	/* parent for the spi master */
+	vs10xx_emul_pdev = platform_device_register_simple("vs10xx-emul", -1, NULL, 0);
+	if (IS_ERR(vs10xx_emul_pdev)) {
+		vs10xx_err("platform_device_register_simple");
+		status = PTR_ERR(vs10xx_emul_pdev);
+		vs10xx_emul_pdev = NULL;
+	}
+
+	if (status == 0) {
+		/* reset and dreq lines */
+		vs10xx_emul_gpio.label = "vs10xx-emul";
+		vs10xx_emul_gpio.owner = THIS_MODULE;
+		vs10xx_emul_gpio.base = -1;
+		vs10xx_emul_gpio.ngpio = 2 * devices;
+		vs10xx_emul_gpio.get = vs10xx_emul_gpio_get;
+		vs10xx_emul_gpio.set = vs10xx_emul_gpio_set;
+		vs10xx_emul_gpio.direction_input = vs10xx_emul_gpio_input;
+		vs10xx_emul_gpio.direction_output = vs10xx_emul_gpio_output;
+
+		status = gpiochip_add(&vs10xx_emul_gpio);
+		if (status < 0) {
+			vs10xx_err("gpiochip_add");
+		} else {
+			vs10xx_emul_gpiook = 1;
+		}
+	}
+
+	if (status == 0) {
+		master = spi_alloc_master(&vs10xx_emul_pdev->dev, 0);
+		if (master == NULL) {
+			vs10xx_err("spi_alloc_master");
+			status = -ENOMEM;
+		} else {
+			master->bus_num = busnum;
+			master->num_chipselect = 2 * devices;
+			master->setup = vs10xx_emul_setup;
+			master->transfer = vs10xx_emul_transfer;
+
+			status = spi_register_master(master);
+			if (status < 0) {
+				vs10xx_err("spi_register_master");
+				spi_master_put(master);
+			} else {
+				vs10xx_emul_master = master;
+			}
+		}
+	}
+
+	for (i = 0; (status == 0) && (i < devices); i++) {
+
+		vs10xx_emul_board[i].device_id = i;
+		vs10xx_emul_board[i].gpio_reset = vs10xx_emul_gpio.base + 2 * i;
+		vs10xx_emul_board[i].gpio_dreq = vs10xx_emul_gpio.base + 2 * i + 1;
+
+		memset(&info, 0, sizeof(info));
+		info.max_speed_hz = 1000 * MAX(spikhz, 1);
+		info.bus_num = vs10xx_emul_master->bus_num;
+		info.mode = SPI_MODE_0;
+		info.platform_data = &vs10xx_emul_board[i];
+
+		/* ctrl */
+		strlcpy(info.modalias, VS10XX_SPI_CTRL, sizeof(info.modalias));
+		info.chip_select = 2 * i;
+		if (spi_new_device(vs10xx_emul_master, &info) == NULL) {
+			vs10xx_err("id:%d spi_new_device ctrl", i);
+			status = -ENODEV;
+		}
+
+		/* data */
+		strlcpy(info.modalias, VS10XX_SPI_DATA, sizeof(info.modalias));
+		info.chip_select = 2 * i + 1;
+		if (status == 0 && spi_new_device(vs10xx_emul_master, &info) == NULL) {
+			vs10xx_err("id:%d spi_new_device data", i);
+			status = -ENODEV;
+		}
+
+		if (status == 0) {
+			vs10xx_inf("id:%d spi:%d.%d/%d gpio_reset:%d gpio_dreq:%d", i, vs10xx_emul_master->bus_num,
+				2 * i, 2 * i + 1, vs10xx_emul_board[i].gpio_reset, vs10xx_emul_board[i].gpio_dreq);
+		}
+	}
+
+	if (status != 0) {
+		vs10xx_emul_cleanup();
+	}
+
+	return status;
+}
+
+static void __exit vs10xx_emul_exit(void) {
+
+	vs10xx_emul_cleanup();
+}
+
+module_init(vs10xx_emul_init);
+module_exit(vs10xx_emul_exit);
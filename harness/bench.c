@@ -0,0 +1,964 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx userspace micro-benchmarks.
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+#include "harness.h"
+#include "vs10xx.h"
+#include "vs10xx_queue.h"
+#include "vs10xx_common.h"
+#include "vs10xx_stats.h"
+
+#include <getopt.h>
+
+static int seconds = 2;
+static int threads = 2;
+
+/* devices of the group, drift, fanout and move runs */
+#define BENCH_MAXGROUP 16
+static int groupsize = 3;
+
+/* by default the decoder is never the bottleneck */
+static int bitrate = 2000000000;
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* QUEUE                                                                                                                         */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static int bench_queue(void) {
+/*
+ *  Descr:  Fill the queue completely and drain it again, without the driver around it
+ *  Return: 0 or error
+ */
+
+	struct vs10xx_stats_dev_t *stats = NULL;
+	struct vs10xx_queue_t *queue = NULL;
+	struct vs10xx_queue_buf_t *buf;
+	long long t0, enq = 0, deq = 0, ops = 0;
+	long long end = harness_now() + seconds * 1000000000LL;
+	int i, n;
+
+	if (vs10xx_stats_init(0, &stats) < 0 || vs10xx_queue_init(0, stats, &queue) < 0) {
+		fprintf(stderr, "queue init failed\n");
+		return -1;
+	}
+
+	do {
+
+		t0 = harness_now();
+		for (n = 0; !vs10xx_queue_isfull(queue); n++) {
+			buf = vs10xx_queue_getslot(queue);
+			buf->len = sizeof(buf->data);
+			vs10xx_queue_enqueue(queue);
+		}
+		enq += harness_now() - t0;
+
+		t0 = harness_now();
+		for (i = 0; !vs10xx_queue_isempty(queue); i++) {
+			buf = vs10xx_queue_gethead(queue);
+			vs10xx_queue_dequeue(queue);
+		}
+		deq += harness_now() - t0;
+
+		ops += n;
+
+	} while (harness_now() < end);
+
+	printf("queue: %lld entries, enqueue %.1f ns/op, dequeue %.1f ns/op\n",
+		ops, (double)enq / ops, (double)deq / ops);
+
+	vs10xx_queue_exit(queue);
+	vs10xx_stats_exit(stats);
+
+	return 0;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* PUMP                                                                                                                          */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+struct bench_ctrl {
+	pthread_t thread;
+	struct file *file;
+	volatile int *stop;
+	long long ops;
+	long long ns;
+	long long max;
+};
+
+static void *bench_ctrl_thread(void *arg) {
+
+	struct bench_ctrl *ctrl = arg;
+	struct vs10xx_volume volume;
+	long long t0, dt;
+
+	while (!*ctrl->stop) {
+
+		t0 = harness_now();
+		harness_ioctl(ctrl->file, VS10XX_CTL_GETVOLUME, &volume);
+		volume.left = volume.rght = (ctrl->ops & 1) ? 0x20 : 0x21;
+		harness_ioctl(ctrl->file, VS10XX_CTL_SETVOLUME, &volume);
+		dt = harness_now() - t0;
+
+		ctrl->ops += 2;
+		ctrl->ns += dt;
+		if (dt > ctrl->max) {
+			ctrl->max = dt;
+		}
+	}
+
+	return NULL;
+}
+
+static int bench_pump(int nctrl) {
+/*
+ *  Descr:  Stream through the whole driver into the emulator, optionally with ioctl threads
+ *          fighting the pump for the device lock
+ *  Return: 0 or error
+ */
+
+	struct bench_ctrl ctrl[nctrl > 0 ? nctrl : 1];
+	struct vs10xx_delay delay;
+	volatile int stop = 0;
+	static char stream[4096];
+	char text[PAGE_SIZE];
+	struct file *file;
+	long long t0, t1, written = 0;
+	ssize_t n;
+	int i;
+
+	/* mp3 frame headers keep the emulator's format detection happy */
+	for (i = 0; i < (int)sizeof(stream); i += 4) {
+		stream[i] = 0xff; stream[i+1] = 0xfb; stream[i+2] = 0x90; stream[i+3] = 0x00;
+	}
+
+	file = harness_open(0, 1);
+	if (file == NULL) {
+		fprintf(stderr, "open failed\n");
+		return -1;
+	}
+
+	/* prime the queue, then start measuring */
+	harness_write(file, stream, sizeof(stream));
+	kshim_sysfs_store(0, "stats", "0");
+	kshim_sysfs_store(0, "ctrlwait", "0");
+
+	/* decode time hardly moves when the emulated decoder outruns the pump */
+	kshim_param_set("watchdog", 0);
+
+	for (i = 0; i < nctrl; i++) {
+		memset(&ctrl[i], 0, sizeof(ctrl[i]));
+		ctrl[i].stop = &stop;
+		/* control goes through the player's file, read-only opens only observe */
+		ctrl[i].file = file;
+		pthread_create(&ctrl[i].thread, NULL, bench_ctrl_thread, &ctrl[i]);
+	}
+
+	t0 = harness_now();
+	t1 = t0 + seconds * 1000000000LL;
+	while (harness_now() < t1) {
+		n = harness_write(file, stream, sizeof(stream));
+		if (n < 0) {
+			fprintf(stderr, "write failed (%zd)\n", n);
+			break;
+		}
+		written += n;
+	}
+	t1 = harness_now();
+
+	stop = 1;
+	for (i = 0; i < nctrl; i++) {
+		pthread_join(ctrl[i].thread, NULL);
+	}
+
+	/* bytes still queued or in the decoder fifo did not make it through the pump */
+	if (harness_ioctl(file, VS10XX_CTL_GETDELAY, &delay) == 0) {
+		written -= delay.bytes;
+	}
+
+	printf("pump: %d ioctl threads, %.2f MB/s\n", nctrl, written * 1000.0 / (t1 - t0));
+	for (i = 0; i < nctrl; i++) {
+		printf("  ioctl thread %d: %lld ops, avg %.1f us, max %.1f us\n", i, ctrl[i].ops,
+			ctrl[i].ops ? ctrl[i].ns / 1000.0 / ctrl[i].ops : 0.0, ctrl[i].max / 1000.0);
+	}
+
+	if (kshim_sysfs_show(0, "stats", text) > 0) {
+		printf("%s", text);
+	}
+	if (nctrl > 0 && kshim_sysfs_show(0, "ctrlwait", text) > 0) {
+		printf("ctrlwait:\n%s", text);
+	}
+
+	harness_ioctl(file, VS10XX_CTL_FLUSH, NULL);
+	harness_close(file);
+
+	return 0;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* FAULT                                                                                                                         */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+struct bench_writer {
+	pthread_t thread;
+	struct file *file;
+	int stop;
+	int rate;           /* [bytes/s] like a live source, 0: as fast as the queue takes it */
+};
+
+static void *bench_writer_thread(void *arg) {
+
+	struct bench_writer *writer = arg;
+	static char stream[4096];
+	int i;
+
+	for (i = 0; i < (int)sizeof(stream); i += 4) {
+		stream[i] = 0xff; stream[i+1] = 0xfb; stream[i+2] = 0x90; stream[i+3] = 0x00;
+	}
+
+	long long next = harness_now();
+
+	while (!__atomic_load_n(&writer->stop, __ATOMIC_RELAXED)) {
+		if (harness_write(writer->file, stream, sizeof(stream)) < 0) {
+			break;
+		}
+		if (writer->rate > 0) {
+			next += sizeof(stream) * 1000000000LL / writer->rate;
+			if (next > harness_now()) {
+				usleep((next - harness_now()) / 1000);
+			}
+		}
+	}
+
+	return NULL;
+}
+
+static unsigned long long bench_stat(const char *text, const char *key) {
+
+	const char *p = strstr(text, key);
+
+	return (p ? strtoull(p + strlen(key) + 1, NULL, 10) : 0);
+}
+
+static void bench_fault_set(const char *knob, unsigned int val) {
+
+	char path[64], buf[16];
+
+	snprintf(path, sizeof(path), "%s/%s-0/fault/%s", VS10XX_NAME, VS10XX_NAME, knob);
+	snprintf(buf, sizeof(buf), "%u", val);
+	kshim_debugfs_store(path, buf);
+}
+
+static int bench_fault(void) {
+/*
+ *  Descr:  Stream at 128 kbit/s, inject spi failures, stuck DREQ and garbled register reads and
+ *          report how long the pump takes to recover and how much audio is lost
+ *  Return: 0 or error
+ */
+
+	static const struct {
+		const char *name;
+		const char *knob;
+		unsigned int val;
+		int ms;
+	} faults[] = {
+		{ "spi x1",     "spifail",   1,  0   },
+		{ "spi x8",     "spifail",   8,  0   },
+		{ "dreq 50ms",  "dreqstuck", 1,  50  },
+		{ "dreq 250ms", "dreqstuck", 1,  250 },
+		{ "sci garble", "scigarble", 1,  0   },
+		{ "hang",       NULL,        1,  0   },
+	};
+	struct bench_writer writer;
+	struct vs10xx_volume before, volume;
+	char recovery[64], text[PAGE_SIZE];
+	int i, n, rounds, garbled;
+
+	kshim_param_set("bitrate", 128000);
+	kshim_param_set("watchdog", 1000);
+
+	memset(&writer, 0, sizeof(writer));
+	writer.file = harness_open(0, 1);
+	if (writer.file == NULL) {
+		fprintf(stderr, "open failed\n");
+		return -1;
+	}
+
+	pthread_create(&writer.thread, NULL, bench_writer_thread, &writer);
+
+	/* let the stream buffer fill before the first fault */
+	usleep(500000);
+
+	snprintf(recovery, sizeof(recovery), "%s/%s-0/recovery", VS10XX_NAME, VS10XX_NAME);
+	rounds = MAX(seconds * 2, 1);
+
+	printf("%-11s %6s %8s %8s %8s %9s %10s %8s %12s\n", "fault", "rounds", "spierror", "faults", "dropped", "dropbyte", "silent ms", "watchdog", "max recov us");
+
+	for (i = 0; i < (int)(sizeof(faults) / sizeof(faults[0])); i++) {
+
+		kshim_sysfs_store(0, "stats", "0");
+		kshim_debugfs_store(recovery, "0");
+		garbled = 0;
+
+		for (n = 0; n < rounds; n++) {
+
+			harness_ioctl(writer.file, VS10XX_CTL_GETVOLUME, &before);
+
+			if (faults[i].knob == NULL) {
+				/* the emulated decoder stops until the watchdog resets it */
+				kshim_param_set("hang", 1);
+				usleep(1500000);
+			} else {
+				bench_fault_set(faults[i].knob, faults[i].val);
+			}
+
+			if (faults[i].ms) {
+				usleep(faults[i].ms * 1000);
+				bench_fault_set(faults[i].knob, 0);
+			} else if (faults[i].knob && !strcmp(faults[i].knob, "scigarble")) {
+				/* reads SCI_VOL from the chip */
+				harness_ioctl(writer.file, VS10XX_CTL_GETVOLUME, &volume);
+				garbled += (volume.left != before.left || volume.rght != before.rght);
+			}
+
+			/* recover and refill before the next round */
+			usleep(400000);
+		}
+
+		kshim_sysfs_show(0, "stats", text);
+		printf("%-11s %6d %8llu %8llu %8llu %9llu %10.1f %8llu", faults[i].name, rounds,
+			bench_stat(text, "spierror"), bench_stat(text, "faults  "), bench_stat(text, "dropped "),
+			bench_stat(text, "dropbyte"), bench_stat(text, "silentus") / 1000.0, bench_stat(text, "watchdog"));
+
+		kshim_debugfs_show(recovery, text, sizeof(text));
+		printf(" %12llu", bench_stat(text, "max           us"));
+		if (garbled) {
+			printf("  (%d garbled reads seen)", garbled);
+		}
+		printf("\n");
+	}
+
+	__atomic_store_n(&writer.stop, 1, __ATOMIC_RELAXED);
+	pthread_join(writer.thread, NULL);
+
+	harness_ioctl(writer.file, VS10XX_CTL_FLUSH, NULL);
+	harness_close(writer.file);
+
+	kshim_param_set("bitrate", bitrate);
+
+	return 0;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* GROUP                                                                                                                         */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static int bench_group(void) {
+/*
+ *  Descr:  Start groupsize devices as a sync group 50 ms ahead, over and over, and report
+ *          the spread of their first transfers
+ *  Return: 0 or error
+ */
+
+	struct bench_writer writer[BENCH_MAXGROUP];
+	struct vs10xx_group group;
+	struct vs10xx_groupstart gs;
+	long long end = harness_now() + seconds * 1000000000LL;
+	unsigned int skewmax = 0, latemax = 0;
+	unsigned long long skewsum = 0;
+	int i, rounds = 0, rc = 0;
+
+	kshim_param_set("bitrate", 128000);
+
+	do {
+
+		for (i = 0; i < groupsize; i++) {
+			memset(&writer[i], 0, sizeof(writer[i]));
+			writer[i].file = harness_open(i, 1);
+			if (writer[i].file == NULL) {
+				fprintf(stderr, "open %d failed\n", i);
+				return -1;
+			}
+			group.group = 1;
+			harness_ioctl(writer[i].file, VS10XX_CTL_SETGROUP, &group);
+			pthread_create(&writer[i].thread, NULL, bench_writer_thread, &writer[i]);
+		}
+
+		memset(&gs, 0, sizeof(gs));
+		gs.group = 1;
+		gs.when = harness_now() + 50000000LL;
+		if (harness_ioctl(writer[0].file, VS10XX_CTL_GROUPSTART, &gs) < 0) {
+			fprintf(stderr, "group start failed\n");
+			rc = -1;
+		}
+
+		rounds++;
+		skewsum += gs.skew;
+		skewmax = MAX(skewmax, gs.skew);
+		latemax = MAX(latemax, gs.late);
+
+		usleep(100000);
+
+		for (i = 0; i < groupsize; i++) {
+			__atomic_store_n(&writer[i].stop, 1, __ATOMIC_RELAXED);
+			pthread_join(writer[i].thread, NULL);
+			harness_ioctl(writer[i].file, VS10XX_CTL_FLUSH, NULL);
+			group.group = 0;
+			harness_ioctl(writer[i].file, VS10XX_CTL_SETGROUP, &group);
+			harness_close(writer[i].file);
+		}
+
+	} while (rc == 0 && harness_now() < end);
+
+	printf("group: %d devices, %d starts, skew avg %.1f us, max %u us, late max %u us\n",
+		groupsize, rounds, (double)skewsum / rounds, skewmax, latemax);
+
+	kshim_param_set("bitrate", bitrate);
+
+	return rc;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* FANOUT                                                                                                                        */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static int bench_fanout_run(const char *name, unsigned int members, int policy, int hang) {
+/*
+ *  Descr:  Write to groupsize devices for seconds, from one writer per device (members 0) or
+ *          from one writer on device 0 fanned out to members, and report what reached each decoder
+ *  Return: 0 or error
+ */
+
+	struct bench_writer writer[BENCH_MAXGROUP];
+	struct vs10xx_fanout fanout;
+	unsigned long long wr = 0, sdi[BENCH_MAXGROUP], drops[BENCH_MAXGROUP];
+	char text[PAGE_SIZE];
+	int i, n = (members ? 1 : groupsize), rc = 0;
+	long long t0, t1;
+
+	for (i = 0; i < groupsize; i++) {
+		kshim_sysfs_store(i, "stats", "0");
+	}
+
+	for (i = 0; i < n; i++) {
+		memset(&writer[i], 0, sizeof(writer[i]));
+		writer[i].file = harness_open(i, 1);
+		if (writer[i].file == NULL) {
+			fprintf(stderr, "open %d failed\n", i);
+			return -1;
+		}
+	}
+
+	if (members) {
+		fanout.members = members;
+		fanout.policy = policy;
+		if (harness_ioctl(writer[0].file, VS10XX_CTL_SETFANOUT, &fanout) < 0) {
+			fprintf(stderr, "fan-out failed\n");
+			rc = -1;
+		}
+	}
+
+	kshim_param_set("hang", hang);
+
+	t0 = harness_now();
+	for (i = 0; rc == 0 && i < n; i++) {
+		pthread_create(&writer[i].thread, NULL, bench_writer_thread, &writer[i]);
+	}
+
+	usleep(seconds * 1000000);
+
+	for (i = 0; rc == 0 && i < n; i++) {
+		__atomic_store_n(&writer[i].stop, 1, __ATOMIC_RELAXED);
+		if (hang) {
+			/* a writer blocked on the hung member only returns after the flush */
+			harness_ioctl(writer[0].file, VS10XX_CTL_FLUSH, NULL);
+		}
+		pthread_join(writer[i].thread, NULL);
+	}
+	t1 = harness_now();
+
+	for (i = 0; i < groupsize; i++) {
+		kshim_sysfs_show(i, "stats", text);
+		wr += bench_stat(text, "wr_bytes");
+		sdi[i] = bench_stat(text, "sdibytes");
+		drops[i] = bench_stat(text, "dropbyte");
+	}
+
+	printf("%-14s %6.2f", name, wr * 1000.0 / (t1 - t0));
+	for (i = 0; i < groupsize; i++) {
+		printf("   %6.2f %6.2f", sdi[i] * 1000.0 / (t1 - t0), drops[i] * 1000.0 / (t1 - t0));
+	}
+	printf("\n");
+
+	for (i = 0; i < n; i++) {
+		harness_ioctl(writer[i].file, VS10XX_CTL_FLUSH, NULL);
+		harness_close(writer[i].file);
+	}
+
+	/* let the members end their streams before the next run opens them */
+	usleep(100000);
+	kshim_param_set("hang", 0);
+
+	return rc;
+}
+
+static int bench_fanout(void) {
+/*
+ *  Descr:  Compare groupsize writers against one fanned out writer, then hang one member
+ *          under each fan-out policy
+ *  Return: 0 or error
+ */
+
+	unsigned int all = (1U << groupsize) - 1;
+	int i, rc = 0;
+
+	/* a hung member is the test, not something to recover from */
+	kshim_param_set("watchdog", 0);
+
+	printf("fanout          wr MB/s");
+	for (i = 0; i < groupsize; i++) {
+		printf("   dev%d MB/s drop", i);
+	}
+	printf("\n");
+
+	rc = bench_fanout_run("separate", 0, 0, 0);
+
+	if (rc == 0) {
+		rc = bench_fanout_run("shared", all, VS10XX_FANOUT_BLOCK, 0);
+	}
+
+	if (rc == 0) {
+		rc = bench_fanout_run("hang, block", all, VS10XX_FANOUT_BLOCK, groupsize);
+	}
+
+	if (rc == 0) {
+		rc = bench_fanout_run("hang, drop", all, VS10XX_FANOUT_DROP, groupsize);
+	}
+
+	return rc;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* MOVE                                                                                                                          */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static long long bench_move_gap(int id, long long since) {
+/*
+ *  Descr:  Wait for the first sdi data of device id
+ *  Return: [ns] from since, -1 after 10 s
+ */
+
+	char text[PAGE_SIZE];
+
+	while (harness_now() - since < 10000000000LL) {
+		kshim_sysfs_show(id, "stats", text);
+		if (bench_stat(text, "sdibytes") > 0) {
+			return harness_now() - since;
+		}
+		usleep(500);
+	}
+
+	return -1;
+}
+
+static int bench_move(void) {
+/*
+ *  Descr:  Play a live (paced) 128 kbit/s stream on device 0 and continue it on device 1, once by
+ *          closing and reopening, once with VS10XX_CTL_MOVE, and report the silence in between
+ *  Return: 0 or error
+ */
+
+	struct bench_writer writer;
+	struct vs10xx_move move;
+	long long t0, gap;
+	int round, rc = 0;
+
+	kshim_param_set("bitrate", 128000);
+
+	for (round = 0; rc == 0 && round < 2; round++) {
+
+		kshim_sysfs_store(0, "stats", "0");
+
+		memset(&writer, 0, sizeof(writer));
+		writer.rate = 128000 / 8;
+		writer.file = harness_open(0, 1);
+		if (writer.file == NULL) {
+			fprintf(stderr, "open failed\n");
+			return -1;
+		}
+		pthread_create(&writer.thread, NULL, bench_writer_thread, &writer);
+
+		/* prebuffered and playing */
+		if (bench_move_gap(0, harness_now()) < 0) {
+			fprintf(stderr, "no playback\n");
+			rc = -1;
+		}
+		usleep(500000);
+		kshim_sysfs_store(1, "stats", "0");
+
+		t0 = harness_now();
+
+		if (round == 0) {
+
+			/* the old way: end the stream, start over on the other device */
+			__atomic_store_n(&writer.stop, 1, __ATOMIC_RELAXED);
+			pthread_join(writer.thread, NULL);
+			harness_close(writer.file);
+			writer.stop = 0;
+			writer.file = harness_open(1, 1);
+			if (writer.file == NULL) {
+				fprintf(stderr, "open 1 failed\n");
+				return -1;
+			}
+			pthread_create(&writer.thread, NULL, bench_writer_thread, &writer);
+			memset(&move, 0, sizeof(move));
+
+		} else {
+
+			move.target = 1;
+			if (harness_ioctl(writer.file, VS10XX_CTL_MOVE, &move) < 0) {
+				fprintf(stderr, "move failed\n");
+				rc = -1;
+			}
+		}
+
+		gap = bench_move_gap(1, t0);
+
+		printf("move: %-8s silence %8.1f ms, handed over %6u bytes, skipped %u\n",
+			round == 0 ? "reopen" : "ioctl", gap / 1e6, move.bytes, move.skipped);
+
+		__atomic_store_n(&writer.stop, 1, __ATOMIC_RELAXED);
+		pthread_join(writer.thread, NULL);
+		harness_ioctl(writer.file, VS10XX_CTL_FLUSH, NULL);
+		harness_close(writer.file);
+		usleep(100000);
+	}
+
+	kshim_param_set("bitrate", bitrate);
+
+	return rc;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* DRIFT                                                                                                                         */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static int bench_drift(void) {
+/*
+ *  Descr:  Play a sync group of groupsize emulated VS1063 devices whose crystals are 150 ppm
+ *          apart, with the rateTune correction on, and report the offset of each member
+ *  Return: 0 or error
+ */
+
+	struct bench_writer writer[BENCH_MAXGROUP];
+	struct vs10xx_group group;
+	struct vs10xx_groupstart gs;
+	char text[512];
+	long long start, end;
+	int i, rc = 0;
+
+	kshim_param_set("bitrate", 128000);
+	kshim_param_set("xtalppm", 150);
+	kshim_param_set("ratetune", 200);
+
+	for (i = 0; i < groupsize; i++) {
+		memset(&writer[i], 0, sizeof(writer[i]));
+		writer[i].file = harness_open(i, 1);
+		if (writer[i].file == NULL) {
+			fprintf(stderr, "open %d failed\n", i);
+			return -1;
+		}
+		group.group = 1;
+		harness_ioctl(writer[i].file, VS10XX_CTL_SETGROUP, &group);
+		pthread_create(&writer[i].thread, NULL, bench_writer_thread, &writer[i]);
+	}
+
+	memset(&gs, 0, sizeof(gs));
+	gs.group = 1;
+	if (harness_ioctl(writer[0].file, VS10XX_CTL_GROUPSTART, &gs) < 0) {
+		fprintf(stderr, "group start failed\n");
+		rc = -1;
+	}
+
+	start = harness_now();
+	end = start + MAX(seconds, 10) * 1000000000LL;
+
+	while (rc == 0 && harness_now() < end) {
+
+		sleep(1);
+
+		printf("drift: %4.1f s", (harness_now() - start) / 1e9);
+		for (i = 1; i < groupsize; i++) {
+			kshim_sysfs_show(i, "drift", text);
+			printf(", dev %d %+6lld us %+5lld ppm tune %+5lld", i,
+				(long long)bench_stat(text, "offsetus"), (long long)bench_stat(text, "driftppm"), (long long)bench_stat(text, "ratetune"));
+		}
+		printf("\n");
+	}
+
+	for (i = 0; i < groupsize; i++) {
+		__atomic_store_n(&writer[i].stop, 1, __ATOMIC_RELAXED);
+		pthread_join(writer[i].thread, NULL);
+		harness_ioctl(writer[i].file, VS10XX_CTL_FLUSH, NULL);
+		group.group = 0;
+		harness_ioctl(writer[i].file, VS10XX_CTL_SETGROUP, &group);
+		harness_close(writer[i].file);
+	}
+
+	kshim_param_set("ratetune", 0);
+	kshim_param_set("xtalppm", 0);
+	kshim_param_set("bitrate", bitrate);
+
+	return rc;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* SCHED                                                                                                                         */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static void *bench_hog_thread(void *arg) {
+
+	volatile int *stop = arg;
+	cpu_set_t cpu0;
+
+	CPU_ZERO(&cpu0);
+	CPU_SET(0, &cpu0);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu0), &cpu0);
+
+	while (!*stop);
+
+	return NULL;
+}
+
+static int bench_sched_run(const char *sched, int nhogs) {
+/*
+ *  Descr:  Play 128 kbit/s on device 0 with its thread on cpu 0 at class sched, next to nhogs
+ *          busy threads on the same cpu, and report how late the pump came back to the decoder
+ *  Return: 0 or error
+ */
+
+	struct bench_writer writer;
+	pthread_t hog[nhogs > 0 ? nhogs : 1];
+	volatile int stop = 0;
+	char text[PAGE_SIZE];
+	int i;
+
+	if (kshim_sysfs_store(0, "sched", sched) < 0) {
+		printf("sched: %-9s not permitted here\n", sched);
+		return 0;
+	}
+
+	memset(&writer, 0, sizeof(writer));
+	writer.file = harness_open(0, 1);
+	if (writer.file == NULL) {
+		fprintf(stderr, "open failed\n");
+		return -1;
+	}
+	pthread_create(&writer.thread, NULL, bench_writer_thread, &writer);
+
+	for (i = 0; i < nhogs; i++) {
+		pthread_create(&hog[i], NULL, bench_hog_thread, (void *)&stop);
+	}
+
+	/* prebuffered and playing, then measure */
+	usleep(500000);
+	kshim_sysfs_store(0, "jitter", "0");
+	sleep(seconds);
+	kshim_sysfs_show(0, "jitter", text);
+
+	stop = 1;
+	for (i = 0; i < nhogs; i++) {
+		pthread_join(hog[i], NULL);
+	}
+
+	__atomic_store_n(&writer.stop, 1, __ATOMIC_RELAXED);
+	pthread_join(writer.thread, NULL);
+	harness_ioctl(writer.file, VS10XX_CTL_FLUSH, NULL);
+	harness_close(writer.file);
+
+	printf("sched: %-9s %d hogs, %7llu wakeups, avg %5llu us, jitter %5llu us, p99 %6llu us, max %6llu us\n",
+		sched, nhogs, bench_stat(text, "samples "), bench_stat(text, "avgus   "), bench_stat(text, "jitterus"),
+		bench_stat(text, "p99us   "), bench_stat(text, "maxus   "));
+
+	return 0;
+}
+
+static int bench_sched(void) {
+/*
+ *  Descr:  Compare the pump wakeup latency on an idle and on a loaded cpu, at SCHED_OTHER and SCHED_FIFO
+ *  Return: 0 or error
+ */
+
+	char cpus[32];
+	int rc = 0;
+
+	kshim_param_set("bitrate", 128000);
+
+	if (kshim_sysfs_store(0, "cpus", "0") < 0) {
+		fprintf(stderr, "cpus failed\n");
+		rc = -1;
+	}
+
+	if (rc == 0) {
+		rc = bench_sched_run("other 0", 0);
+	}
+
+	if (rc == 0) {
+		rc = bench_sched_run("other 0", threads);
+	}
+
+	if (rc == 0) {
+		rc = bench_sched_run("fifo 50", threads);
+	}
+
+	snprintf(cpus, sizeof(cpus), "0-%ld", sysconf(_SC_NPROCESSORS_CONF) - 1);
+	kshim_sysfs_store(0, "sched", "other 0");
+	kshim_sysfs_store(0, "cpus", cpus);
+	kshim_param_set("bitrate", bitrate);
+
+	return rc;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* MAIN                                                                                                                          */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+int main (int argc, char *argv[]) {
+
+	int rc = 0, opt;
+	int queue = 0, pump = 0, contention = 0, fault = 0, group = 0, drift = 0, fanout = 0, move = 0, sched = 0;
+
+	while ((opt = getopt(argc, argv, "ht:b:k:c:n:v")) != -1) {
+		switch (opt) {
+			case 't':
+				seconds = atoi(optarg);
+				break;
+			case 'b':
+				bitrate = atoi(optarg);
+				break;
+			case 'k':
+				kshim_param_set("spikhz", atoi(optarg));
+				break;
+			case 'c':
+				threads = atoi(optarg);
+				break;
+			case 'n':
+				groupsize = MAX(2, MIN(atoi(optarg), BENCH_MAXGROUP));
+				break;
+			case 'v':
+				kshim_loglevel = 7;
+				break;
+			default:
+				printf("Usage: %s [options] [queue|pump|contention|fault|group|drift|fanout|move|sched ...]\n"
+					"\nOptions:\n"
+					"  -h           help\n"
+					"  -t seconds   duration per benchmark (%d)\n"
+					"  -b bitrate   emulated decoder consumption [bit/s] (%d)\n"
+					"  -k spikhz    emulated spi clock [kHz], 0: transfers take no time\n"
+					"  -c threads   ioctl threads for the contention run, busy threads for the sched run (%d)\n"
+					"  -n devices   emulated devices for the group, drift, fanout and move runs (%d)\n"
+					"  -v           show driver messages\n\n"
+					, argv[0], seconds, bitrate, threads, groupsize
+				);
+				return (opt == 'h' ? 0 : 1);
+		}
+	}
+
+	if (optind == argc) {
+		queue = pump = contention = fault = group = 1;
+	}
+
+	for (; optind < argc; optind++) {
+		if (!strcmp(argv[optind], "queue")) {
+			queue = 1;
+		} else if (!strcmp(argv[optind], "pump")) {
+			pump = 1;
+		} else if (!strcmp(argv[optind], "contention")) {
+			contention = 1;
+		} else if (!strcmp(argv[optind], "fault")) {
+			fault = 1;
+		} else if (!strcmp(argv[optind], "group")) {
+			group = 1;
+		} else if (!strcmp(argv[optind], "drift")) {
+			drift = 1;
+		} else if (!strcmp(argv[optind], "fanout")) {
+			fanout = 1;
+		} else if (!strcmp(argv[optind], "move")) {
+			move = 1;
+		} else if (!strcmp(argv[optind], "sched")) {
+			sched = 1;
+		} else {
+			fprintf(stderr, "unknown benchmark: %s\n", argv[optind]);
+			return 1;
+		}
+	}
+
+	kshim_param_set("bitrate", bitrate);
+
+	if (group || drift || fanout || move) {
+		kshim_param_set("devices", groupsize);
+	}
+
+	if (drift) {
+		kshim_param_set("chip", 1063);
+	}
+
+	if (queue) {
+		rc = bench_queue();
+	}
+
+	if (rc == 0 && (pump || contention || fault || group || drift || fanout || move || sched)) {
+
+		rc = harness_start();
+
+		if (rc == 0 && pump) {
+			rc = bench_pump(0);
+		}
+
+		if (rc == 0 && contention) {
+			rc = bench_pump(threads);
+		}
+
+		if (rc == 0 && fault) {
+			rc = bench_fault();
+		}
+
+		if (rc == 0 && group) {
+			rc = bench_group();
+		}
+
+		if (rc == 0 && drift) {
+			rc = bench_drift();
+		}
+
+		if (rc == 0 && fanout) {
+			rc = bench_fanout();
+		}
+
+		if (rc == 0 && move) {
+			rc = bench_move();
+		}
+
+		if (rc == 0 && sched) {
+			rc = bench_sched();
+		}
+
+		harness_stop();
+	}
+
+	return (rc < 0 ? 1 : 0);
+}
@@ -0,0 +1,115 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx userspace harness.
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+#include "harness.h"
+
+struct harness_file {
+	struct file file;
+	struct inode inode;
+};
+
+int harness_start(void) {
+
+	int status;
+
+	/* the emulated gpio chip has no interrupts */
+	kshim_param_set("irqmode", 0);
+
+	status = kshim_init_vs10xx_emul_init();
+	if (status < 0) {
+		fprintf(stderr, "emulator init failed (%d)\n", status);
+		return status;
+	}
+
+	status = kshim_init_vs10xx_init();
+	if (status < 0) {
+		fprintf(stderr, "driver init failed (%d)\n", status);
+		kshim_exit_vs10xx_emul_exit();
+		return status;
+	}
+
+	return 0;
+}
+
+void harness_stop(void) {
+
+	kshim_exit_vs10xx_exit();
+	kshim_exit_vs10xx_emul_exit();
+}
+
+struct file *harness_open(int minor, int write) {
+
+	struct harness_file *hf = calloc(1, sizeof *hf);
+
+	if (hf == NULL) {
+		return NULL;
+	}
+
+	hf->inode.i_rdev = kshim_devt(minor);
+	hf->file.f_mode = FMODE_READ | (write ? FMODE_WRITE : 0);
+
+	if (kshim_fops()->open(&hf->inode, &hf->file) < 0) {
+		free(hf);
+		return NULL;
+	}
+
+	return &hf->file;
+}
+
+int harness_close(struct file *file) {
+
+	struct harness_file *hf = container_of(file, struct harness_file, file);
+	int status = kshim_fops()->release(&hf->inode, file);
+
+	free(hf);
+
+	return status;
+}
+
+ssize_t harness_write(struct file *file, const void *buf, size_t len) {
+
+	loff_t pos = 0;
+
+	return kshim_fops()->write(file, buf, len, &pos);
+}
+
+long harness_ioctl(struct file *file, unsigned int cmd, void *arg) {
+
+	return kshim_fops()->unlocked_ioctl(file, cmd, (unsigned long)arg);
+}
+
+void *harness_mmap(struct file *file, size_t len) {
+
+	struct vm_area_struct vma;
+
+	/* the shim's remap_pfn_range hands out the kernel address, same process */
+	memset(&vma, 0, sizeof vma);
+	vma.vm_end = len;
+
+	if (kshim_fops()->mmap(file, &vma) < 0) {
+		return NULL;
+	}
+
+	return (void *)vma.vm_start;
+}
+
+long long harness_now(void) {
+
+	return ktime_to_ns(ktime_get());
+}
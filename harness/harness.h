@@ -0,0 +1,39 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx userspace harness.
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef HARNESS_H
+#define HARNESS_H
+
+#include "kshim_api.h"
+
+/* load the emulator and the driver, module parameters must be set before */
+int harness_start(void);
+void harness_stop(void);
+
+/* file operations on device <minor>, a read-only open is an observer */
+struct file *harness_open(int minor, int write);
+int harness_close(struct file *file);
+ssize_t harness_write(struct file *file, const void *buf, size_t len);
+long harness_ioctl(struct file *file, unsigned int cmd, void *arg);
+void *harness_mmap(struct file *file, size_t len);
+
+/* monotonic clock [ns] */
+long long harness_now(void);
+
+#endif
@@ -0,0 +1,172 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx userspace harness, the same interface on top of the real devices.
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+/* programs linked with this instead of the shim run against a loaded driver (hardware or emul/),
+   e.g. on a kernel with lockdep and KCSAN */
+
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include "harness.h"
+
+struct file {
+	int fd;
+};
+
+int kshim_loglevel = 4;
+
+int kshim_param_set(const char *name, int val) {
+
+	char path[128];
+	FILE *f;
+
+	/* module parameters are in sysfs, read-only ones cannot be changed after load */
+	snprintf(path, sizeof path, "/sys/module/vs10xx/parameters/%s", name);
+	f = fopen(path, "w");
+	if (f == NULL) {
+		return -ENOENT;
+	}
+	fprintf(f, "%d", val);
+
+	return (fclose(f) == 0 ? 0 : -EIO);
+}
+
+int kshim_param_get(const char *name, int *val) {
+
+	char path[128];
+	FILE *f;
+	int n;
+
+	snprintf(path, sizeof path, "/sys/module/vs10xx/parameters/%s", name);
+	f = fopen(path, "r");
+	if (f == NULL) {
+		return -ENOENT;
+	}
+	n = fscanf(f, "%d", val);
+	fclose(f);
+
+	return (n == 1 ? 0 : -EIO);
+}
+
+static ssize_t harness_sysfs(int minor, const char *name, char *buf, const char *val) {
+
+	char path[128];
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof path, "/sys/class/vs10xx/vs10xx-%d/%s", minor, name);
+	fd = open(path, val ? O_WRONLY : O_RDONLY);
+	if (fd < 0) {
+		return -errno;
+	}
+
+	if (val) {
+		n = write(fd, val, strlen(val));
+	} else {
+		/* sysfs hands out at most one page */
+		n = read(fd, buf, 4095);
+		if (n >= 0) {
+			buf[n] = 0;
+		}
+	}
+	close(fd);
+
+	return (n < 0 ? -errno : n);
+}
+
+ssize_t kshim_sysfs_show(int minor, const char *name, char *buf) {
+
+	return harness_sysfs(minor, name, buf, NULL);
+}
+
+ssize_t kshim_sysfs_store(int minor, const char *name, const char *buf) {
+
+	return harness_sysfs(minor, name, NULL, buf);
+}
+
+int harness_start(void) {
+
+	return (access("/dev/vs10xx-0", F_OK) == 0 ? 0 : -ENODEV);
+}
+
+void harness_stop(void) {
+}
+
+struct file *harness_open(int minor, int write) {
+
+	struct file *file = calloc(1, sizeof *file);
+	char path[32];
+
+	if (file == NULL) {
+		return NULL;
+	}
+
+	snprintf(path, sizeof path, "/dev/vs10xx-%d", minor);
+	file->fd = open(path, write ? O_WRONLY : O_RDONLY);
+	if (file->fd < 0) {
+		free(file);
+		return NULL;
+	}
+
+	return file;
+}
+
+int harness_close(struct file *file) {
+
+	int status = close(file->fd);
+
+	free(file);
+
+	return (status < 0 ? -errno : 0);
+}
+
+ssize_t harness_write(struct file *file, const void *buf, size_t len) {
+
+	ssize_t n = write(file->fd, buf, len);
+
+	return (n < 0 ? -errno : n);
+}
+
+long harness_ioctl(struct file *file, unsigned int cmd, void *arg) {
+
+	return (ioctl(file->fd, cmd, arg) < 0 ? -errno : 0);
+}
+
+void *harness_mmap(struct file *file, size_t len) {
+
+	void *p = mmap(NULL, len, PROT_READ, MAP_SHARED, file->fd, 0);
+
+	return (p == MAP_FAILED ? NULL : p);
+}
+
+long long harness_now(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
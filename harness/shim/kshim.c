@@ -0,0 +1,1203 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx userspace harness, kernel stand-ins.
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+#include "kshim.h"
+#include "linux/debugfs.h"
+#include "linux/hrtimer.h"
+#include "linux/gpio.h"
+#include "linux/interrupt.h"
+#include "linux/jump_label.h"
+#include "linux/mm.h"
+#include "linux/platform_device.h"
+#include "linux/spi/spi.h"
+
+#include <stdarg.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "kshim_api.h"
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* KSHIM PRINTK                                                                                                                  */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+/* messages up to warnings are shown by default */
+int kshim_loglevel = 4;
+
+int kshim_printk(const char *fmt, ...) {
+
+	va_list ap;
+	int level = 4, n;
+
+	if (fmt[0] == '<' && fmt[1] >= '0' && fmt[1] <= '7' && fmt[2] == '>') {
+		level = fmt[1] - '0';
+		fmt += 3;
+	}
+
+	if (level > kshim_loglevel) {
+		return 0;
+	}
+
+	va_start(ap, fmt);
+	n = vfprintf(stderr, fmt, ap);
+	va_end(ap);
+
+	return n;
+}
+
+int scnprintf(char *buf, size_t size, const char *fmt, ...) {
+
+	va_list ap;
+	int n;
+
+	if (size == 0) {
+		return 0;
+	}
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, size, fmt, ap);
+	va_end(ap);
+
+	return (n < 0 ? 0 : ((size_t)n >= size ? (int)size - 1 : n));
+}
+
+size_t kshim_strlcpy(char *d, const char *s, size_t n) {
+
+	size_t len = strlen(s);
+
+	if (n) {
+		size_t c = (len >= n ? n - 1 : len);
+		memcpy(d, s, c);
+		d[c] = 0;
+	}
+
+	return len;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* KSHIM MODULE PARAMETERS                                                                                                       */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+#define KSHIM_PARAMS 64
+
+static struct kshim_param_t {
+	const char *name;
+	int *val;
+	kshim_param_set_t set;
+} kshim_params[KSHIM_PARAMS];
+
+static int kshim_nparams;
+
+void kshim_param_add(const char *name, int *val, kshim_param_set_t set) {
+
+	if (kshim_nparams < KSHIM_PARAMS) {
+		kshim_params[kshim_nparams].name = name;
+		kshim_params[kshim_nparams].val = val;
+		kshim_params[kshim_nparams].set = set;
+		kshim_nparams++;
+	}
+}
+
+int kshim_param_set(const char *name, int val) {
+
+	struct kernel_param kp;
+	char buf[16];
+	int i;
+
+	for (i = 0; i < kshim_nparams; i++) {
+		if (strcmp(kshim_params[i].name, name) == 0) {
+			if (kshim_params[i].set) {
+				snprintf(buf, sizeof buf, "%d", val);
+				kp.name = name;
+				kp.arg = kshim_params[i].val;
+				return kshim_params[i].set(buf, &kp);
+			}
+			*kshim_params[i].val = val;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+int kshim_param_get(const char *name, int *val) {
+
+	int i;
+
+	for (i = 0; i < kshim_nparams; i++) {
+		if (strcmp(kshim_params[i].name, name) == 0) {
+			*val = *kshim_params[i].val;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+int param_set_int(const char *val, const struct kernel_param *kp) {
+
+	char *end;
+	long v = strtol(val, &end, 0);
+
+	if (end == val) {
+		return -EINVAL;
+	}
+
+	*(int *)kp->arg = (int)v;
+	return 0;
+}
+
+int param_get_int(char *buf, const struct kernel_param *kp) {
+
+	return sprintf(buf, "%d", *(int *)kp->arg);
+}
+
+void static_branch_enable(struct static_key_false *k) {
+
+	k->enabled = 1;
+}
+
+void static_branch_disable(struct static_key_false *k) {
+
+	k->enabled = 0;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* KSHIM TIME                                                                                                                    */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+ktime_t ktime_get(void) {
+
+	struct timespec ts;
+	ktime_t t;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t.tv64 = (s64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+
+	return t;
+}
+
+unsigned long kshim_jiffies(void) {
+
+	/* HZ is 1000 */
+	return (unsigned long)(ktime_get().tv64 / 1000000);
+}
+
+void msleep(unsigned ms) {
+
+	struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR);
+}
+
+int schedule_hrtimeout(ktime_t *expires, enum hrtimer_mode mode) {
+
+	struct timespec ts;
+	s64 ns = expires->tv64;
+
+	if (mode == HRTIMER_MODE_REL) {
+		ns += ktime_get().tv64;
+	}
+
+	ts.tv_sec = ns / NSEC_PER_SEC;
+	ts.tv_nsec = ns % NSEC_PER_SEC;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+
+	return 0;
+}
+
+void udelay(unsigned long us) {
+
+	/* busy wait like the real thing, a sleep would be far too coarse */
+	s64 end = ktime_get().tv64 + (s64)us * NSEC_PER_USEC;
+
+	while (ktime_get().tv64 < end);
+}
+
+void usleep_range(unsigned long a, unsigned long b) {
+
+	struct timespec ts = { a / 1000000, (long)(a % 1000000) * 1000 };
+
+	(void)b;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR);
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* KSHIM WAIT QUEUES AND THREADS                                                                                                 */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static pthread_mutex_t kshim_preempt = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+void kshim_preempt_disable(void) {
+
+	pthread_mutex_lock(&kshim_preempt);
+}
+
+void kshim_preempt_enable(void) {
+
+	pthread_mutex_unlock(&kshim_preempt);
+}
+
+void init_waitqueue_head(wait_queue_head_t *q) {
+
+	pthread_mutex_init(&q->m, NULL);
+	pthread_cond_init(&q->c, NULL);
+}
+
+void kshim_wake(wait_queue_head_t *q) {
+
+	pthread_mutex_lock(&q->m);
+	pthread_cond_broadcast(&q->c);
+	pthread_mutex_unlock(&q->m);
+}
+
+long kshim_wait(wait_queue_head_t *q, long tmo_ms) {
+/*
+ *  Descr:  Sleep until woken, the caller re-evaluates its condition; a wakeup can slip in between
+ *          the test and this wait, so never sleep longer than 1 ms at a time
+ *  Return: remaining timeout
+ */
+
+	struct timespec ts;
+	long slice = (tmo_ms > 1 ? 1 : tmo_ms);
+	ktime_t start = ktime_get();
+	long spent;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += slice * 1000000;
+	if (ts.tv_nsec >= NSEC_PER_SEC) {
+		ts.tv_sec += 1;
+		ts.tv_nsec -= NSEC_PER_SEC;
+	}
+
+	pthread_mutex_lock(&q->m);
+	pthread_cond_timedwait(&q->c, &q->m, &ts);
+	pthread_mutex_unlock(&q->m);
+
+	spent = (long)((ktime_get().tv64 - start.tv64) / 1000000);
+
+	return (tmo_ms > spent ? tmo_ms - spent : 0);
+}
+
+void complete(struct completion *c) {
+
+	c->done = 1;
+	kshim_wake(&c->wait);
+}
+
+static __thread struct task_struct *kshim_current;
+
+static void *kshim_kthread_main(void *arg) {
+
+	struct task_struct *t = arg;
+
+	kshim_current = t;
+	__atomic_store_n(&t->tid, (pid_t)syscall(SYS_gettid), __ATOMIC_RELEASE);
+	t->fn(t->arg);
+
+	return NULL;
+}
+
+struct task_struct *kshim_kthread_run(int (*fn)(void*), void *arg) {
+
+	struct task_struct *t = calloc(1, sizeof *t);
+
+	if (t == NULL) {
+		return ERR_PTR(-ENOMEM);
+	}
+
+	t->fn = fn;
+	t->arg = arg;
+
+	if (pthread_create(&t->t, NULL, kshim_kthread_main, t) != 0) {
+		free(t);
+		return ERR_PTR(-EAGAIN);
+	}
+
+	/* the thread id is needed for the nice value */
+	while (__atomic_load_n(&t->tid, __ATOMIC_ACQUIRE) == 0) {
+		sched_yield();
+	}
+
+	return t;
+}
+
+int kthread_stop(struct task_struct *t) {
+
+	__atomic_store_n(&t->stop, 1, __ATOMIC_RELAXED);
+	pthread_join(t->t, NULL);
+	free(t);
+
+	return 0;
+}
+
+int kthread_should_stop(void) {
+
+	return (kshim_current ? __atomic_load_n(&kshim_current->stop, __ATOMIC_RELAXED) : 0);
+}
+
+int sched_setscheduler(struct task_struct *t, int policy, const struct sched_param *p) {
+
+	int status = pthread_setschedparam(t->t, policy, p);
+
+	if (status == 0) {
+		t->policy = policy;
+		t->rt_priority = p->sched_priority;
+	}
+
+	return -status;
+}
+
+void set_user_nice(struct task_struct *t, long nice) {
+
+	if (setpriority(PRIO_PROCESS, t->tid, (int)nice) == 0) {
+		t->nice = (int)nice;
+	}
+}
+
+static struct cpumask kshim_cpus_possible;
+const struct cpumask *cpu_possible_mask = &kshim_cpus_possible;
+
+static void __attribute__((constructor)) kshim_cpus_init(void) {
+
+	long n = sysconf(_SC_NPROCESSORS_CONF), cpu;
+
+	for (cpu = 0; cpu < n && cpu < 64; cpu++) {
+		set_bit(cpu, kshim_cpus_possible.bits);
+	}
+}
+
+int cpulist_parse(const char *buf, struct cpumask *m) {
+
+	const char *p = buf;
+	char *end;
+	long a, b;
+
+	memset(m, 0, sizeof(*m));
+
+	while (*p != '\0' && *p != '\n') {
+
+		a = b = strtol(p, &end, 10);
+		if (end == p || a < 0) {
+			return -EINVAL;
+		}
+		p = end;
+
+		if (*p == '-') {
+			b = strtol(++p, &end, 10);
+			if (end == p || b < a) {
+				return -EINVAL;
+			}
+			p = end;
+		}
+
+		if (b >= 64) {
+			return -ERANGE;
+		}
+
+		for (; a <= b; a++) {
+			set_bit(a, m->bits);
+		}
+
+		if (*p == ',') {
+			p++;
+		}
+	}
+
+	return 0;
+}
+
+int cpulist_scnprintf(char *buf, int len, const struct cpumask *m) {
+
+	int a, b, n = 0;
+
+	buf[0] = '\0';
+
+	for (a = 0; a < 64; a = b + 1) {
+
+		if (!test_bit(a, m->bits)) {
+			b = a;
+			continue;
+		}
+
+		for (b = a; b + 1 < 64 && test_bit(b + 1, m->bits); b++);
+
+		if (a == b) {
+			n += scnprintf(buf + n, len - n, "%s%d", n ? "," : "", a);
+		} else {
+			n += scnprintf(buf + n, len - n, "%s%d-%d", n ? "," : "", a, b);
+		}
+	}
+
+	return n;
+}
+
+int set_cpus_allowed_ptr(struct task_struct *t, const struct cpumask *m) {
+
+	cpu_set_t set;
+	int cpu;
+
+	CPU_ZERO(&set);
+	for (cpu = 0; cpu < 64; cpu++) {
+		if (test_bit(cpu, m->bits)) {
+			CPU_SET(cpu, &set);
+		}
+	}
+
+	return -pthread_setaffinity_np(t->t, sizeof(set), &set);
+}
+
+void schedule(void) {
+
+	sched_yield();
+}
+
+void cond_resched(void) {
+
+	sched_yield();
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* KSHIM SPI                                                                                                                     */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static LIST_HEAD(kshim_spi_devices);
+static LIST_HEAD(kshim_spi_drivers);
+static DEFINE_MUTEX(kshim_spi_lock);
+
+static void kshim_spi_complete(void *context) {
+
+	complete(context);
+}
+
+int spi_sync(struct spi_device *d, struct spi_message *m) {
+
+	struct completion done;
+	int status;
+
+	init_completion(&done);
+	m->complete = kshim_spi_complete;
+	m->context = &done;
+
+	status = d->master->transfer(d, m);
+	if (status == 0) {
+		wait_for_completion(&done);
+		status = m->status;
+	}
+
+	return status;
+}
+
+struct spi_master *spi_alloc_master(struct device *d, unsigned size) {
+
+	(void)d;
+	return calloc(1, sizeof(struct spi_master) + size);
+}
+
+int spi_register_master(struct spi_master *m) {
+
+	if (m->bus_num < 0) {
+		m->bus_num = 0;
+	}
+
+	return 0;
+}
+
+static void kshim_spi_probe(struct spi_driver *drv, struct spi_device *spi) {
+
+	if (strcmp(drv->driver.name, spi->modalias) == 0 && drv->probe) {
+		drv->probe(spi);
+	}
+}
+
+static void kshim_spi_remove(struct spi_driver *drv, struct spi_device *spi) {
+
+	if (strcmp(drv->driver.name, spi->modalias) == 0 && drv->remove) {
+		drv->remove(spi);
+	}
+}
+
+void spi_unregister_master(struct spi_master *m) {
+
+	struct spi_device *spi, *n;
+	struct spi_driver *drv;
+
+	mutex_lock(&kshim_spi_lock);
+	list_for_each_entry_safe(spi, n, &kshim_spi_devices, node) {
+		if (spi->master == m) {
+			list_for_each_entry(drv, &kshim_spi_drivers, node) {
+				kshim_spi_remove(drv, spi);
+			}
+			list_del(&spi->node);
+			free(spi);
+		}
+	}
+	mutex_unlock(&kshim_spi_lock);
+
+	free(m);
+}
+
+void spi_master_put(struct spi_master *m) {
+
+	free(m);
+}
+
+struct spi_device *spi_new_device(struct spi_master *m, struct spi_board_info *i) {
+
+	struct spi_device *spi = calloc(1, sizeof *spi);
+	struct spi_driver *drv;
+
+	if (spi == NULL) {
+		return NULL;
+	}
+
+	spi->master = m;
+	spi->chip_select = i->chip_select;
+	spi->max_speed_hz = i->max_speed_hz;
+	spi->mode = i->mode;
+	spi->dev.platform_data = (void *)i->platform_data;
+	strlcpy(spi->modalias, i->modalias, sizeof(spi->modalias));
+
+	if (m->setup && m->setup(spi) < 0) {
+		free(spi);
+		return NULL;
+	}
+
+	mutex_lock(&kshim_spi_lock);
+	list_add_tail(&spi->node, &kshim_spi_devices);
+	list_for_each_entry(drv, &kshim_spi_drivers, node) {
+		kshim_spi_probe(drv, spi);
+	}
+	mutex_unlock(&kshim_spi_lock);
+
+	return spi;
+}
+
+int spi_register_driver(struct spi_driver *d) {
+
+	struct spi_device *spi;
+
+	mutex_lock(&kshim_spi_lock);
+	list_add_tail(&d->node, &kshim_spi_drivers);
+	list_for_each_entry(spi, &kshim_spi_devices, node) {
+		kshim_spi_probe(d, spi);
+	}
+	mutex_unlock(&kshim_spi_lock);
+
+	return 0;
+}
+
+void spi_unregister_driver(struct spi_driver *d) {
+
+	struct spi_device *spi;
+
+	mutex_lock(&kshim_spi_lock);
+	list_for_each_entry(spi, &kshim_spi_devices, node) {
+		kshim_spi_remove(d, spi);
+	}
+	list_del(&d->node);
+	mutex_unlock(&kshim_spi_lock);
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* KSHIM GPIO AND IRQ                                                                                                            */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+#define KSHIM_GPIOCHIPS 4
+
+static struct gpio_chip *kshim_gpiochips[KSHIM_GPIOCHIPS];
+static int kshim_gpiobase = 64;
+
+static struct gpio_chip *kshim_gpiochip(int g) {
+
+	int i;
+
+	for (i = 0; i < KSHIM_GPIOCHIPS; i++) {
+		struct gpio_chip *c = kshim_gpiochips[i];
+		if (c && g >= c->base && g < c->base + (int)c->ngpio) {
+			return c;
+		}
+	}
+
+	return NULL;
+}
+
+int gpiochip_add(struct gpio_chip *c) {
+
+	int i;
+
+	for (i = 0; i < KSHIM_GPIOCHIPS; i++) {
+		if (kshim_gpiochips[i] == NULL) {
+			if (c->base < 0) {
+				c->base = kshim_gpiobase;
+				kshim_gpiobase += c->ngpio;
+			}
+			kshim_gpiochips[i] = c;
+			return 0;
+		}
+	}
+
+	return -ENOSPC;
+}
+
+int gpiochip_remove(struct gpio_chip *c) {
+
+	int i;
+
+	for (i = 0; i < KSHIM_GPIOCHIPS; i++) {
+		if (kshim_gpiochips[i] == c) {
+			kshim_gpiochips[i] = NULL;
+			return 0;
+		}
+	}
+
+	return -EINVAL;
+}
+
+int gpio_get_value(int g) {
+
+	struct gpio_chip *c = kshim_gpiochip(g);
+
+	return (c && c->get ? c->get(c, g - c->base) : 0);
+}
+
+void gpio_set_value(int g, int v) {
+
+	struct gpio_chip *c = kshim_gpiochip(g);
+
+	if (c && c->set) {
+		c->set(c, g - c->base, v);
+	}
+}
+
+int gpio_request(int g, const char *l) {
+
+	(void)l;
+	return (kshim_gpiochip(g) ? 0 : -EINVAL);
+}
+
+void gpio_free(int g) {
+
+	(void)g;
+}
+
+int gpio_direction_output(int g, int v) {
+
+	struct gpio_chip *c = kshim_gpiochip(g);
+
+	if (c == NULL) {
+		return -EINVAL;
+	}
+
+	return (c->direction_output ? c->direction_output(c, g - c->base, v) : 0);
+}
+
+int gpio_direction_input(int g) {
+
+	struct gpio_chip *c = kshim_gpiochip(g);
+
+	if (c == NULL) {
+		return -EINVAL;
+	}
+
+	return (c->direction_input ? c->direction_input(c, g - c->base) : 0);
+}
+
+int gpio_to_irq(int g) {
+
+	(void)g;
+	return -ENXIO;
+}
+
+int request_irq(int irq, irqreturn_t (*h)(int, void*), unsigned long f, const char *n, void *arg) {
+
+	/* no interrupts, the driver must run with irqmode=0 */
+	(void)irq; (void)h; (void)f; (void)n; (void)arg;
+	return -ENOSYS;
+}
+
+void free_irq(int irq, void *arg) {
+
+	(void)irq; (void)arg;
+}
+
+void synchronize_irq(int irq) {
+
+	(void)irq;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* KSHIM DEVICE MODEL                                                                                                            */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+#define KSHIM_DEVICES 16
+
+static struct device *kshim_devices[KSHIM_DEVICES];
+static const struct file_operations *kshim_cdev_fops;
+static dev_t kshim_cdev_base;
+
+struct platform_device *platform_device_register_simple(const char *name, int id, void *res, unsigned n) {
+
+	(void)name; (void)id; (void)res; (void)n;
+	return calloc(1, sizeof(struct platform_device));
+}
+
+void platform_device_unregister(struct platform_device *p) {
+
+	free(p);
+}
+
+struct device *device_create(struct class *c, struct device *p, dev_t devt, void *drv, const char *fmt, ...) {
+
+	struct device *d;
+	int i;
+
+	(void)c; (void)p; (void)fmt;
+
+	for (i = 0; i < KSHIM_DEVICES; i++) {
+		if (kshim_devices[i] == NULL) {
+			d = calloc(1, sizeof *d);
+			if (d == NULL) {
+				return ERR_PTR(-ENOMEM);
+			}
+			d->devt = devt;
+			d->drvdata = drv;
+			kshim_devices[i] = d;
+			return d;
+		}
+	}
+
+	return ERR_PTR(-ENOSPC);
+}
+
+void device_destroy(struct class *c, dev_t devt) {
+
+	int i;
+
+	(void)c;
+
+	for (i = 0; i < KSHIM_DEVICES; i++) {
+		if (kshim_devices[i] && kshim_devices[i]->devt == devt) {
+			free(kshim_devices[i]);
+			kshim_devices[i] = NULL;
+		}
+	}
+}
+
+int class_register(struct class *c) {
+
+	(void)c;
+	return 0;
+}
+
+void class_unregister(struct class *c) {
+
+	(void)c;
+}
+
+int sysfs_create_group(struct kobject *k, const struct attribute_group *g) {
+
+	container_of(k, struct device, kobj)->group = g;
+	return 0;
+}
+
+void sysfs_remove_group(struct kobject *k, const struct attribute_group *g) {
+
+	(void)g;
+	container_of(k, struct device, kobj)->group = NULL;
+}
+
+int kobject_uevent_env(struct kobject *k, enum kobject_action a, char *envp[]) {
+
+	(void)k; (void)a; (void)envp;
+	return 0;
+}
+
+int alloc_chrdev_region(dev_t *d, unsigned f, unsigned n, const char *name) {
+
+	(void)n; (void)name;
+	*d = MKDEV(240, f);
+	kshim_cdev_base = *d;
+	return 0;
+}
+
+void unregister_chrdev_region(dev_t d, unsigned n) {
+
+	(void)d; (void)n;
+}
+
+struct cdev *cdev_alloc(void) {
+
+	return calloc(1, sizeof(struct cdev));
+}
+
+void cdev_init(struct cdev *c, const struct file_operations *f) {
+
+	c->ops = f;
+}
+
+int cdev_add(struct cdev *c, dev_t d, unsigned n) {
+
+	(void)n;
+	c->dev = d;
+	kshim_cdev_fops = c->ops;
+	return 0;
+}
+
+void cdev_del(struct cdev *c) {
+
+	if (kshim_cdev_fops == c->ops) {
+		kshim_cdev_fops = NULL;
+	}
+}
+
+void poll_wait(struct file *f, wait_queue_head_t *q, poll_table *p) {
+
+	(void)f; (void)q; (void)p;
+}
+
+unsigned long copy_from_user(void *to, const void *from, unsigned long n) {
+
+	memcpy(to, from, n);
+	return 0;
+}
+
+unsigned long copy_to_user(void *to, const void *from, unsigned long n) {
+
+	memcpy(to, from, n);
+	return 0;
+}
+
+ssize_t simple_read_from_buffer(void *to, size_t count, loff_t *ppos, const void *from, size_t available) {
+
+	loff_t pos = *ppos;
+
+	if (pos < 0) {
+		return -EINVAL;
+	}
+
+	if ((size_t)pos >= available || count == 0) {
+		return 0;
+	}
+
+	if (count > available - pos) {
+		count = available - pos;
+	}
+
+	memcpy(to, (const char *)from + pos, count);
+	*ppos = pos + count;
+
+	return count;
+}
+
+/* debugfs is a table of paths, the harness reads and writes the files by path */
+#define KSHIM_DEBUGFS 64
+
+struct dentry {
+	char path[128];
+	void *data;
+	u32 *value;
+	const struct file_operations *fops;
+};
+
+static struct dentry *kshim_debugfs[KSHIM_DEBUGFS];
+static pthread_mutex_t kshim_debugfs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct dentry *kshim_debugfs_add(const char *name, struct dentry *parent, void *data, u32 *value, const struct file_operations *fops) {
+
+	struct dentry *d = calloc(1, sizeof(*d));
+	int i;
+
+	if (d == NULL) {
+		return NULL;
+	}
+
+	if (parent != NULL) {
+		strcpy(d->path, parent->path);
+		strcat(d->path, "/");
+	}
+	strncat(d->path, name, sizeof(d->path) - strlen(d->path) - 1);
+	d->data = data;
+	d->value = value;
+	d->fops = fops;
+
+	pthread_mutex_lock(&kshim_debugfs_lock);
+	for (i = 0; i < KSHIM_DEBUGFS && kshim_debugfs[i] != NULL; i++) {
+	}
+	if (i < KSHIM_DEBUGFS) {
+		kshim_debugfs[i] = d;
+	}
+	pthread_mutex_unlock(&kshim_debugfs_lock);
+
+	if (i == KSHIM_DEBUGFS) {
+		free(d);
+		d = NULL;
+	}
+
+	return d;
+}
+
+static struct dentry *kshim_debugfs_find(const char *path) {
+
+	struct dentry *d = NULL;
+	int i;
+
+	pthread_mutex_lock(&kshim_debugfs_lock);
+	for (i = 0; i < KSHIM_DEBUGFS && d == NULL; i++) {
+		if (kshim_debugfs[i] != NULL && strcmp(kshim_debugfs[i]->path, path) == 0) {
+			d = kshim_debugfs[i];
+		}
+	}
+	pthread_mutex_unlock(&kshim_debugfs_lock);
+
+	return d;
+}
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent) {
+
+	return kshim_debugfs_add(name, parent, NULL, NULL, NULL);
+}
+
+struct dentry *debugfs_create_file(const char *name, mode_t mode, struct dentry *parent, void *data, const struct file_operations *fops) {
+
+	(void)mode;
+	return kshim_debugfs_add(name, parent, data, NULL, fops);
+}
+
+struct dentry *debugfs_create_u32(const char *name, mode_t mode, struct dentry *parent, u32 *value) {
+
+	(void)mode;
+	return kshim_debugfs_add(name, parent, NULL, value, NULL);
+}
+
+void debugfs_remove_recursive(struct dentry *d) {
+
+	size_t len;
+	int i;
+
+	if (d == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&kshim_debugfs_lock);
+	len = strlen(d->path);
+	for (i = 0; i < KSHIM_DEBUGFS; i++) {
+		if (kshim_debugfs[i] != NULL && kshim_debugfs[i] != d && strncmp(kshim_debugfs[i]->path, d->path, len) == 0 && kshim_debugfs[i]->path[len] == '/') {
+			free(kshim_debugfs[i]);
+			kshim_debugfs[i] = NULL;
+		}
+	}
+	for (i = 0; i < KSHIM_DEBUGFS; i++) {
+		if (kshim_debugfs[i] == d) {
+			kshim_debugfs[i] = NULL;
+		}
+	}
+	pthread_mutex_unlock(&kshim_debugfs_lock);
+
+	free(d);
+}
+
+ssize_t kshim_debugfs_show(const char *path, char *buf, size_t size) {
+
+	struct dentry *d = kshim_debugfs_find(path);
+	struct inode inode;
+	struct file file;
+	loff_t pos = 0;
+	ssize_t len;
+
+	if (d == NULL || size == 0) {
+		return -ENOENT;
+	}
+
+	if (d->value != NULL) {
+		return snprintf(buf, size, "%u\n", __atomic_load_n(d->value, __ATOMIC_RELAXED));
+	}
+
+	if (d->fops == NULL || d->fops->read == NULL) {
+		return -EINVAL;
+	}
+
+	memset(&inode, 0, sizeof(inode));
+	memset(&file, 0, sizeof(file));
+	inode.i_private = d->data;
+	if (d->fops->open && d->fops->open(&inode, &file) < 0) {
+		return -EIO;
+	}
+
+	len = d->fops->read(&file, buf, size - 1, &pos);
+	if (len >= 0) {
+		buf[len] = 0;
+	}
+
+	if (d->fops->release) {
+		d->fops->release(&inode, &file);
+	}
+
+	return len;
+}
+
+ssize_t kshim_debugfs_store(const char *path, const char *buf) {
+
+	struct dentry *d = kshim_debugfs_find(path);
+	struct inode inode;
+	struct file file;
+	loff_t pos = 0;
+	ssize_t len;
+
+	if (d == NULL) {
+		return -ENOENT;
+	}
+
+	if (d->value != NULL) {
+		__atomic_store_n(d->value, (u32)strtoul(buf, NULL, 0), __ATOMIC_RELAXED);
+		return strlen(buf);
+	}
+
+	if (d->fops == NULL || d->fops->write == NULL) {
+		return -EINVAL;
+	}
+
+	memset(&inode, 0, sizeof(inode));
+	memset(&file, 0, sizeof(file));
+	inode.i_private = d->data;
+	if (d->fops->open && d->fops->open(&inode, &file) < 0) {
+		return -EIO;
+	}
+
+	len = d->fops->write(&file, buf, strlen(buf), &pos);
+
+	if (d->fops->release) {
+		d->fops->release(&inode, &file);
+	}
+
+	return len;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* KSHIM PAGES                                                                                                                   */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+unsigned long get_zeroed_page(int gfp) {
+
+	void *p = NULL;
+
+	(void)gfp;
+	if (posix_memalign(&p, PAGE_SIZE, PAGE_SIZE) != 0) {
+		return 0;
+	}
+	memset(p, 0, PAGE_SIZE);
+
+	return (unsigned long)p;
+}
+
+void free_page(unsigned long addr) {
+
+	free((void *)addr);
+}
+
+struct page *virt_to_page(const void *p) {
+
+	return (struct page *)p;
+}
+
+unsigned long virt_to_phys(const void *p) {
+
+	return (unsigned long)p;
+}
+
+void SetPageReserved(struct page *p) {
+
+	(void)p;
+}
+
+void ClearPageReserved(struct page *p) {
+
+	(void)p;
+}
+
+int remap_pfn_range(struct vm_area_struct *vma, unsigned long addr, unsigned long pfn, unsigned long size, int prot) {
+
+	/* the harness process shares the page already, hand out its address */
+	(void)prot; (void)size;
+	vma->vm_start = addr ? addr : (pfn << PAGE_SHIFT);
+	return 0;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* KSHIM HARNESS ACCESS                                                                                                          */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+const struct file_operations *kshim_fops(void) {
+
+	return kshim_cdev_fops;
+}
+
+dev_t kshim_devt(int minor) {
+
+	return MKDEV(MAJOR(kshim_cdev_base), MINOR(kshim_cdev_base) + minor);
+}
+
+static struct device_attribute *kshim_attr(int minor, const char *name, struct device **dev) {
+
+	dev_t devt = kshim_devt(minor);
+	struct attribute **a;
+	int i;
+
+	for (i = 0; i < KSHIM_DEVICES; i++) {
+		struct device *d = kshim_devices[i];
+		if (d && d->devt == devt && d->group) {
+			for (a = d->group->attrs; *a; a++) {
+				if (strcmp((*a)->name, name) == 0) {
+					*dev = d;
+					return container_of(*a, struct device_attribute, attr);
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+ssize_t kshim_sysfs_show(int minor, const char *name, char *buf) {
+
+	struct device *dev;
+	struct device_attribute *attr = kshim_attr(minor, name, &dev);
+
+	if (attr == NULL || attr->show == NULL) {
+		return -ENOENT;
+	}
+
+	return attr->show(dev, attr, buf);
+}
+
+ssize_t kshim_sysfs_store(int minor, const char *name, const char *buf) {
+
+	struct device *dev;
+	struct device_attribute *attr = kshim_attr(minor, name, &dev);
+
+	if (attr == NULL || attr->store == NULL) {
+		return -ENOENT;
+	}
+
+	return attr->store(dev, attr, buf, strlen(buf));
+}
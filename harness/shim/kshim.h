@@ -0,0 +1,340 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx userspace harness, kernel stand-ins.
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+/* just enough of the kernel api for the module and emulator sources to build and run as
+   a single process: locks are pthread mutexes, kthreads are pthreads, spi and gpio calls
+   are routed to whatever master/chip registered, i.e. the emulator */
+
+#ifndef KSHIM_H
+#define KSHIM_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+
+/* kernel internal, never seen by userspace */
+#define ERESTARTSYS 512
+
+#define __user
+#define __init
+#define __exit
+#define __percpu
+#define __read_mostly
+#define __iomem
+#define __must_check
+#define likely(x) __builtin_expect(!!(x),1)
+#define unlikely(x) __builtin_expect(!!(x),0)
+/* relaxed atomics rather than volatile, so thread sanitizer sees the annotated lockless accesses */
+#define ACCESS_ONCE(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define READ_ONCE(x) ACCESS_ONCE(x)
+#define WRITE_ONCE(x, val) __atomic_store_n(&(x), (val), __ATOMIC_RELAXED)
+#define smp_wmb() __sync_synchronize()
+#define smp_rmb() __sync_synchronize()
+#define smp_mb() __sync_synchronize()
+#define barrier() __asm__ __volatile__("" ::: "memory")
+#define ____cacheline_aligned __attribute__((aligned(64)))
+#define ____cacheline_aligned_in_smp __attribute__((aligned(64)))
+#define BUILD_BUG_ON(c) ((void)sizeof(char[1 - 2*!!(c)]))
+#define ARRAY_SIZE(a) (sizeof(a)/sizeof((a)[0]))
+#define container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+#include <stddef.h>
+
+typedef uint8_t u8; typedef uint16_t u16; typedef uint32_t u32; typedef uint64_t u64;
+typedef int8_t s8; typedef int16_t s16; typedef int32_t s32; typedef int64_t s64;
+typedef unsigned gfp_t;
+typedef int bool_t;
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+#define KERN_ERR "<3>"
+#define KERN_WARNING "<4>"
+#define KERN_INFO "<6>"
+#define KERN_DEBUG "<7>"
+int kshim_printk(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+#define printk kshim_printk
+
+#define THIS_MODULE ((struct module *)0)
+struct module;
+/* module parameters register themselves by name, see kshim_param_set() */
+#define module_param_named(n,v,t,p) static void __attribute__((constructor)) __kshim_param_##n(void) { kshim_param_add(#n, &(v), NULL); }
+#define module_param(n,t,p) module_param_named(n,n,t,p)
+#define MODULE_PARM_DESC(n,d)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_LICENSE(x)
+/* every module gets its own entry points, e.g. kshim_init_vs10xx_init */
+#define module_init(x) int kshim_init_##x(void) { return x(); }
+#define module_exit(x) void kshim_exit_##x(void) { x(); }
+#define EXPORT_SYMBOL(x)
+#define EXPORT_SYMBOL_GPL(x)
+
+#define GFP_KERNEL 0
+#define GFP_ATOMIC 1
+/* cache line aligned, the per-device contexts are ____cacheline_aligned */
+static inline void *kzalloc(size_t n, gfp_t f) { void *p; (void)f; return (posix_memalign(&p, 64, n) == 0 ? memset(p, 0, n) : NULL); }
+static inline void *kmalloc(size_t n, gfp_t f) { (void)f; return malloc(n); }
+static inline void *kcalloc(size_t n, size_t s, gfp_t f) { (void)f; return calloc(n, s); }
+static inline void kfree(const void *p) { free((void*)p); }
+
+/* time */
+#define HZ 1000
+unsigned long kshim_jiffies(void);
+#define jiffies kshim_jiffies()
+#define time_after(a,b) ((long)((b) - (a)) < 0)
+#define time_before(a,b) time_after(b,a)
+#define time_after_eq(a,b) ((long)((a) - (b)) >= 0)
+#define time_before_eq(a,b) time_after_eq(b,a)
+static inline unsigned long msecs_to_jiffies(unsigned m) { return m; }
+static inline unsigned jiffies_to_msecs(unsigned long j) { return j; }
+void msleep(unsigned ms);
+void udelay(unsigned long us);
+void usleep_range(unsigned long a, unsigned long b);
+
+typedef union { s64 tv64; } ktime_t;
+ktime_t ktime_get(void);
+static inline s64 ktime_to_ns(ktime_t t) { return t.tv64; }
+static inline s64 ktime_to_us(ktime_t t) { return t.tv64 / 1000; }
+static inline ktime_t ktime_sub(ktime_t a, ktime_t b) { ktime_t r; r.tv64 = a.tv64 - b.tv64; return r; }
+static inline ktime_t ktime_add_ns(ktime_t a, u64 n) { ktime_t r; r.tv64 = a.tv64 + n; return r; }
+static inline ktime_t ktime_add_us(ktime_t a, u64 n) { ktime_t r; r.tv64 = a.tv64 + n*1000; return r; }
+static inline ktime_t ns_to_ktime(u64 n) { ktime_t r; r.tv64 = n; return r; }
+static inline s64 ktime_us_delta(ktime_t a, ktime_t b) { return (a.tv64 - b.tv64)/1000; }
+static inline int ktime_equal(ktime_t a, ktime_t b) { return a.tv64 == b.tv64; }
+#define ktime_set(s,n) ns_to_ktime((u64)(s)*1000000000ULL + (n))
+#define NSEC_PER_SEC 1000000000L
+#define NSEC_PER_USEC 1000L
+#define USEC_PER_SEC 1000000L
+static inline u64 div_u64(u64 a, u32 b) { return a / b; }
+static inline u64 div64_u64(u64 a, u64 b) { return a / b; }
+static inline s64 div_s64(s64 a, s32 b) { return a / b; }
+static inline int fls(unsigned x) { return x ? 32 - __builtin_clz(x) : 0; }
+static inline int fls64(u64 x) { return x ? 64 - __builtin_clzll(x) : 0; }
+static inline int ilog2(unsigned long x) { return fls(x) - 1; }
+static inline unsigned long int_sqrt(unsigned long x) { unsigned long r = 0; while ((r + 1) * (r + 1) <= x) r++; return r; }
+#define min_t(t,a,b) ((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t,a,b) ((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define clamp_t(t,v,lo,hi) min_t(t, max_t(t, v, lo), hi)
+#define abs(x) ({ long __x = (x); __x < 0 ? -__x : __x; })
+
+/* locking */
+struct mutex { pthread_mutex_t m; };
+#define mutex_init(l) pthread_mutex_init(&(l)->m, NULL)
+#define mutex_lock(l) pthread_mutex_lock(&(l)->m)
+#define mutex_unlock(l) pthread_mutex_unlock(&(l)->m)
+#define mutex_trylock(l) (pthread_mutex_trylock(&(l)->m) == 0)
+#define mutex_lock_interruptible(l) (pthread_mutex_lock(&(l)->m), 0)
+#define mutex_is_locked(l) 0
+typedef struct { pthread_mutex_t m; } spinlock_t;
+#define spin_lock_init(l) pthread_mutex_init(&(l)->m, NULL)
+#define spin_lock(l) pthread_mutex_lock(&(l)->m)
+#define spin_unlock(l) pthread_mutex_unlock(&(l)->m)
+#define spin_lock_irqsave(l,f) ((void)(f), pthread_mutex_lock(&(l)->m))
+#define spin_unlock_irqrestore(l,f) ((void)(f), pthread_mutex_unlock(&(l)->m))
+#define spin_lock_bh(l) pthread_mutex_lock(&(l)->m)
+#define spin_unlock_bh(l) pthread_mutex_unlock(&(l)->m)
+#define DEFINE_SPINLOCK(x) spinlock_t x = { PTHREAD_MUTEX_INITIALIZER }
+#define DEFINE_MUTEX(x) struct mutex x = { PTHREAD_MUTEX_INITIALIZER }
+
+typedef struct { volatile int counter; } atomic_t;
+#define ATOMIC_INIT(i) { (i) }
+#define atomic_read(v) ((v)->counter)
+#define atomic_set(v,i) ((v)->counter = (i))
+#define atomic_inc(v) __sync_add_and_fetch(&(v)->counter, 1)
+#define atomic_dec(v) __sync_sub_and_fetch(&(v)->counter, 1)
+#define atomic_add(i,v) __sync_add_and_fetch(&(v)->counter, i)
+#define atomic_sub(i,v) __sync_sub_and_fetch(&(v)->counter, i)
+#define atomic_inc_return(v) __sync_add_and_fetch(&(v)->counter, 1)
+#define atomic_dec_return(v) __sync_sub_and_fetch(&(v)->counter, 1)
+#define atomic_dec_and_test(v) (__sync_sub_and_fetch(&(v)->counter, 1) == 0)
+#define atomic_xchg(v,n) __sync_lock_test_and_set(&(v)->counter, n)
+#define atomic_cmpxchg(v,o,n) __sync_val_compare_and_swap(&(v)->counter, o, n)
+#define set_bit(nr, addr) __sync_fetch_and_or((addr) + (nr)/(8*sizeof(long)), 1UL << ((nr) % (8*sizeof(long))))
+#define clear_bit(nr, addr) __sync_fetch_and_and((addr) + (nr)/(8*sizeof(long)), ~(1UL << ((nr) % (8*sizeof(long)))))
+#define test_bit(nr, addr) ((((addr)[(nr)/(8*sizeof(long))]) >> ((nr) % (8*sizeof(long)))) & 1)
+#define test_and_clear_bit(nr, addr) ((__sync_fetch_and_and((addr) + (nr)/(8*sizeof(long)), ~(1UL << ((nr) % (8*sizeof(long))))) >> ((nr) % (8*sizeof(long)))) & 1)
+#define test_and_set_bit(nr, addr) ((__sync_fetch_and_or((addr) + (nr)/(8*sizeof(long)), (1UL << ((nr) % (8*sizeof(long))))) >> ((nr) % (8*sizeof(long)))) & 1)
+#define xchg(p, v) __sync_lock_test_and_set(p, v)
+
+/* wait queues */
+typedef struct { pthread_mutex_t m; pthread_cond_t c; } wait_queue_head_t;
+void init_waitqueue_head(wait_queue_head_t *q);
+void kshim_wake(wait_queue_head_t *q);
+long kshim_wait(wait_queue_head_t *q, long tmo_ms);
+#define wake_up(q) kshim_wake(q)
+#define wake_up_interruptible(q) kshim_wake(q)
+#define wake_up_all(q) kshim_wake(q)
+#define waitqueue_active(q) 1
+#define wait_event_timeout(q, cond, tmo) ({ long __t = (tmo); while (!(cond) && __t > 0) __t = kshim_wait(&(q), __t); (cond) ? (__t ? __t : 1) : 0; })
+#define wait_event(q, cond) do { while (!(cond)) kshim_wait(&(q), 10); } while (0)
+#define wait_event_interruptible(q, cond) ({ while (!(cond)) kshim_wait(&(q), 10); 0; })
+#define wait_event_interruptible_timeout(q, cond, tmo) wait_event_timeout(q, cond, tmo)
+
+struct completion { int done; wait_queue_head_t wait; };
+#define init_completion(c) ((c)->done = 0, init_waitqueue_head(&(c)->wait))
+void complete(struct completion *c);
+#define wait_for_completion(c) wait_event((c)->wait, (c)->done)
+
+/* threads, scheduling class and affinity go to the pthread */
+struct task_struct { pthread_t t; pid_t tid; volatile int stop; int (*fn)(void*); void *arg; int policy; unsigned int rt_priority; int nice; };
+struct task_struct *kshim_kthread_run(int (*fn)(void*), void *arg);
+#define kthread_run(fn, arg, fmt, ...) kshim_kthread_run(fn, arg)
+int kthread_stop(struct task_struct *t);
+int kthread_should_stop(void);
+#define IS_ERR(p) ((unsigned long)(p) > (unsigned long)-4096)
+#define PTR_ERR(p) ((long)(p))
+#define ERR_PTR(e) ((void*)(long)(e))
+#define IS_ERR_OR_NULL(p) (!(p) || IS_ERR(p))
+void schedule(void);
+void cond_resched(void);
+#define set_current_state(s)
+#define __set_current_state(s)
+#define TASK_RUNNING 0
+#define TASK_INTERRUPTIBLE 1
+#define TASK_UNINTERRUPTIBLE 2
+#define signal_pending(t) 0
+#define current ((struct task_struct *)0)
+
+#include <sched.h>
+#define SCHED_NORMAL SCHED_OTHER
+#define MAX_RT_PRIO 100
+#define sched_setscheduler kshim_sched_setscheduler
+int sched_setscheduler(struct task_struct *t, int policy, const struct sched_param *p);
+void set_user_nice(struct task_struct *t, long nice);
+static inline int task_nice(const struct task_struct *t) { return t->nice; }
+
+/* cpu masks, up to 64 host cpus */
+struct cpumask { unsigned long bits[64 / (8 * sizeof(long))]; };
+typedef struct cpumask cpumask_var_t[1];
+#define alloc_cpumask_var(m, f) (memset(*(m), 0, sizeof(struct cpumask)) != NULL)
+#define zalloc_cpumask_var(m, f) alloc_cpumask_var(m, f)
+#define free_cpumask_var(m) ((void)(m))
+extern const struct cpumask *cpu_possible_mask;
+static inline void cpumask_copy(struct cpumask *d, const struct cpumask *s) { *d = *s; }
+static inline int cpumask_empty(const struct cpumask *m) { unsigned i; for (i = 0; i < sizeof(m->bits) / sizeof(long); i++) if (m->bits[i]) return 0; return 1; }
+int cpulist_parse(const char *buf, struct cpumask *m);
+int cpulist_scnprintf(char *buf, int len, const struct cpumask *m);
+int set_cpus_allowed_ptr(struct task_struct *t, const struct cpumask *m);
+
+/* percpu */
+#define alloc_percpu(type) ((type *)calloc(1, sizeof(type)))
+#define free_percpu(p) free(p)
+#define per_cpu_ptr(p, cpu) (p)
+#define this_cpu_ptr(p) (p)
+#define this_cpu_add(pcp, v) __sync_add_and_fetch(&(pcp), (v))
+#define this_cpu_inc(pcp) this_cpu_add(pcp, 1)
+#define for_each_possible_cpu(c) for ((c) = 0; (c) < 1; (c)++)
+/* all threads share the one per cpu copy, so preempt_disable() keeps the others out of it */
+void kshim_preempt_disable(void);
+void kshim_preempt_enable(void);
+#define preempt_disable() kshim_preempt_disable()
+#define preempt_enable() kshim_preempt_enable()
+#define get_cpu() 0
+#define put_cpu()
+
+/* device model */
+struct kobject { int dummy; };
+struct device { void *drvdata; void *platform_data; struct kobject kobj; dev_t devt; const struct attribute_group *group; };
+struct device_attribute { struct attribute { const char *name; int mode; } attr;
+	ssize_t (*show)(struct device *, struct device_attribute *, char *);
+	ssize_t (*store)(struct device *, struct device_attribute *, const char *, size_t); };
+#define DEVICE_ATTR(_n,_m,_s,_w) struct device_attribute dev_attr_##_n = { { #_n, _m }, _s, _w }
+#define __ATTR_NULL { { NULL, 0 } }
+struct attribute_group { struct attribute **attrs; };
+struct class_attribute { struct attribute attr; };
+struct class { const char *name; struct module *owner; struct class_attribute *class_attrs; };
+static inline void *dev_get_drvdata(const struct device *d) { return d->drvdata; }
+static inline void dev_set_drvdata(struct device *d, void *p) { d->drvdata = p; }
+struct device *device_create(struct class *c, struct device *p, dev_t devt, void *drv, const char *fmt, ...);
+void device_destroy(struct class *c, dev_t devt);
+int class_register(struct class *c);
+void class_unregister(struct class *c);
+int sysfs_create_group(struct kobject *k, const struct attribute_group *g);
+void sysfs_remove_group(struct kobject *k, const struct attribute_group *g);
+enum kobject_action { KOBJ_ADD, KOBJ_REMOVE, KOBJ_CHANGE };
+int kobject_uevent_env(struct kobject *k, enum kobject_action a, char *envp[]);
+#define PAGE_SIZE 4096
+#define PAGE_SHIFT 12
+int scnprintf(char *buf, size_t size, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+/* chardev */
+
+#define MAJOR(d) ((unsigned int)((d) >> 20))
+#define MINOR(d) ((unsigned int)((d) & 0xfffff))
+#define MKDEV(ma,mi) (((ma) << 20) | (mi))
+struct inode { dev_t i_rdev; void *i_private; };
+struct file { void *private_data; unsigned f_flags; unsigned f_mode; };
+#define FMODE_READ 1
+#define FMODE_WRITE 2
+struct poll_table_struct; typedef struct poll_table_struct poll_table;
+void poll_wait(struct file *f, wait_queue_head_t *q, poll_table *p);
+struct vm_area_struct { unsigned long vm_start, vm_end, vm_pgoff, vm_flags; int vm_page_prot; };
+#define VM_WRITE 0x2
+#define VM_MAYWRITE 0x20
+#define VM_RESERVED 0x80000
+#define VM_IO 0x4000
+struct file_operations { struct module *owner;
+	int (*open)(struct inode *, struct file *);
+	int (*release)(struct inode *, struct file *);
+	ssize_t (*read)(struct file *, char *, size_t, loff_t *);
+	ssize_t (*write)(struct file *, const char *, size_t, loff_t *);
+	long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+	unsigned int (*poll)(struct file *, poll_table *);
+	int (*mmap)(struct file *, struct vm_area_struct *); };
+struct cdev { const struct file_operations *ops; dev_t dev; };
+struct cdev *cdev_alloc(void);
+void cdev_init(struct cdev *c, const struct file_operations *f);
+int cdev_add(struct cdev *c, dev_t d, unsigned n);
+void cdev_del(struct cdev *c);
+int alloc_chrdev_region(dev_t *d, unsigned f, unsigned n, const char *name);
+void unregister_chrdev_region(dev_t d, unsigned n);
+unsigned long copy_from_user(void *to, const void *from, unsigned long n);
+unsigned long copy_to_user(void *to, const void *from, unsigned long n);
+#endif
+#ifndef KSHIM_POLL
+#define KSHIM_POLL
+#define POLLIN 1
+#define POLLPRI 2
+#define POLLOUT 4
+#define POLLERR 8
+#define POLLHUP 16
+#define POLLRDNORM 64
+#define POLLWRNORM 256
+#endif
+
+#ifndef KSHIM_EXTRA
+#define KSHIM_EXTRA
+ssize_t simple_read_from_buffer(void *to, size_t count, loff_t *ppos, const void *from, size_t available);
+struct kernel_param { const char *name; void *arg; };
+struct kernel_param_ops { int (*set)(const char *, const struct kernel_param *); int (*get)(char *, const struct kernel_param *); };
+int param_set_int(const char *val, const struct kernel_param *kp);
+int param_get_int(char *buf, const struct kernel_param *kp);
+typedef int (*kshim_param_set_t)(const char *, const struct kernel_param *);
+void kshim_param_add(const char *name, int *val, kshim_param_set_t set);
+#define module_param_cb(n, ops, arg, perm) static void __attribute__((constructor)) __kshim_param_##n(void) { kshim_param_add(#n, (arg), (ops)->set); }
+#define module_param_call(n, set, get, arg, perm) static void __attribute__((constructor)) __kshim_param_##n(void) { kshim_param_add(#n, (arg), (kshim_param_set_t)(set)); }
+#endif
+size_t kshim_strlcpy(char *d, const char *s, size_t n);
+#define strlcpy kshim_strlcpy
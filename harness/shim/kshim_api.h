@@ -0,0 +1,48 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx userspace harness, access to the shimmed kernel from the harness side.
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef KSHIM_API_H
+#define KSHIM_API_H
+
+/* printk level threshold, 4 shows errors and warnings */
+extern int kshim_loglevel;
+
+/* module parameters by name, set before the module init runs */
+int kshim_param_set(const char *name, int val);
+int kshim_param_get(const char *name, int *val);
+
+/* the character device the driver registered */
+const struct file_operations *kshim_fops(void);
+dev_t kshim_devt(int minor);
+
+/* sysfs attributes of a device */
+ssize_t kshim_sysfs_show(int minor, const char *name, char *buf);
+ssize_t kshim_sysfs_store(int minor, const char *name, const char *buf);
+
+/* debugfs files by path, e.g. "vs10xx/vs10xx-0/fault/spifail" */
+ssize_t kshim_debugfs_show(const char *path, char *buf, size_t size);
+ssize_t kshim_debugfs_store(const char *path, const char *buf);
+
+/* module entry points, see module_init() */
+int kshim_init_vs10xx_emul_init(void);
+void kshim_exit_vs10xx_emul_exit(void);
+int kshim_init_vs10xx_init(void);
+void kshim_exit_vs10xx_exit(void);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef KSHIM_GPIO_H
+#define KSHIM_GPIO_H
+#include "../kshim.h"
+int gpio_get_value(int g); void gpio_set_value(int g, int v);
+int gpio_request(int g, const char *l); void gpio_free(int g);
+int gpio_direction_output(int g, int v); int gpio_direction_input(int g);
+int gpio_to_irq(int g);
+struct gpio_chip { const char *label; struct module *owner; int base; unsigned ngpio;
+	int (*get)(struct gpio_chip *, unsigned); void (*set)(struct gpio_chip *, unsigned, int);
+	int (*direction_input)(struct gpio_chip *, unsigned); int (*direction_output)(struct gpio_chip *, unsigned, int); };
+int gpiochip_add(struct gpio_chip *c);
+int gpiochip_remove(struct gpio_chip *c);
+#endif
@@ -0,0 +1,3 @@
+#include "../kshim.h"
+enum hrtimer_mode { HRTIMER_MODE_ABS, HRTIMER_MODE_REL };
+int schedule_hrtimeout(ktime_t *expires, enum hrtimer_mode mode);
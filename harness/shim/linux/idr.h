@@ -0,0 +1,20 @@
+#include "../kshim.h"
+#ifndef KSHIM_IDR_H
+#define KSHIM_IDR_H
+/* the pre-3.9 interface over a flat table, plenty for minors */
+#define KSHIM_IDR_MAX 256
+struct idr { void *ptr[KSHIM_IDR_MAX]; unsigned char used[KSHIM_IDR_MAX]; };
+#define DEFINE_IDR(n) struct idr n = { { NULL }, { 0 } }
+static inline int idr_pre_get(struct idr *idr, gfp_t f) { (void)idr; (void)f; return 1; }
+static inline int idr_get_new(struct idr *idr, void *ptr, int *id) {
+	int i;
+	for (i = 0; i < KSHIM_IDR_MAX; i++) {
+		if (!idr->used[i]) { idr->used[i] = 1; __atomic_store_n(&idr->ptr[i], ptr, __ATOMIC_RELEASE); *id = i; return 0; }
+	}
+	return -ENOSPC;
+}
+static inline void *idr_find(struct idr *idr, int id) { return (id < 0 || id >= KSHIM_IDR_MAX) ? NULL : __atomic_load_n(&idr->ptr[id], __ATOMIC_ACQUIRE); }
+static inline void *idr_replace(struct idr *idr, void *ptr, int id) { return __atomic_exchange_n(&idr->ptr[id], ptr, __ATOMIC_ACQ_REL); }
+static inline void idr_remove(struct idr *idr, int id) { __atomic_store_n(&idr->ptr[id], NULL, __ATOMIC_RELEASE); idr->used[id] = 0; }
+static inline void idr_destroy(struct idr *idr) { (void)idr; }
+#endif
@@ -0,0 +1,11 @@
+#ifndef KSHIM_IRQ_H
+#define KSHIM_IRQ_H
+#include "../kshim.h"
+typedef int irqreturn_t;
+#define IRQ_HANDLED 1
+#define IRQF_TRIGGER_RISING 1
+#define IRQF_TRIGGER_FALLING 2
+int request_irq(int irq, irqreturn_t (*h)(int, void*), unsigned long f, const char *n, void *arg);
+void free_irq(int irq, void *arg);
+void synchronize_irq(int irq);
+#endif
@@ -0,0 +1,6 @@
+struct static_key_false { int enabled; };
+#define DECLARE_STATIC_KEY_FALSE(n) extern struct static_key_false n
+#define DEFINE_STATIC_KEY_FALSE(n) struct static_key_false n = { 0 }
+#define static_branch_unlikely(k) ((k)->enabled)
+void static_branch_enable(struct static_key_false *k);
+void static_branch_disable(struct static_key_false *k);
@@ -0,0 +1,27 @@
+#ifndef KSHIM_LIST_H
+#define KSHIM_LIST_H
+#include "../kshim.h"
+struct list_head { struct list_head *next, *prev; };
+#define LIST_HEAD_INIT(n) { &(n), &(n) }
+#define LIST_HEAD(n) struct list_head n = LIST_HEAD_INIT(n)
+static inline void INIT_LIST_HEAD(struct list_head *l) { WRITE_ONCE(l->next, l); l->prev = l; }
+static inline void __list_add(struct list_head *n, struct list_head *p, struct list_head *x) { x->prev = n; n->next = x; n->prev = p; WRITE_ONCE(p->next, n); }
+static inline void list_add(struct list_head *n, struct list_head *h) { __list_add(n, h, h->next); }
+static inline void list_add_tail(struct list_head *n, struct list_head *h) { __list_add(n, h->prev, h); }
+static inline void __list_del(struct list_head *p, struct list_head *n) { n->prev = p; WRITE_ONCE(p->next, n); }
+static inline void list_del(struct list_head *e) { __list_del(e->prev, e->next); e->next = e->prev = NULL; }
+static inline void list_del_init(struct list_head *e) { __list_del(e->prev, e->next); INIT_LIST_HEAD(e); }
+static inline void list_move(struct list_head *l, struct list_head *h) { __list_del(l->prev, l->next); list_add(l, h); }
+static inline void list_move_tail(struct list_head *l, struct list_head *h) { __list_del(l->prev, l->next); list_add_tail(l, h); }
+static inline int list_empty(const struct list_head *h) { return ACCESS_ONCE(h->next) == h; }
+static inline int list_is_singular(const struct list_head *h) { return !list_empty(h) && h->next == h->prev; }
+static inline void __list_splice(const struct list_head *l, struct list_head *p, struct list_head *n) {
+	struct list_head *f = l->next, *la = l->prev; f->prev = p; WRITE_ONCE(p->next, f); la->next = n; n->prev = la; }
+static inline void list_splice_tail_init(struct list_head *l, struct list_head *h) { if (!list_empty(l)) { __list_splice(l, h->prev, h); INIT_LIST_HEAD(l); } }
+static inline void list_splice_init(struct list_head *l, struct list_head *h) { if (!list_empty(l)) { __list_splice(l, h, h->next); INIT_LIST_HEAD(l); } }
+#define list_entry(p, t, m) container_of(p, t, m)
+#define list_first_entry(p, t, m) list_entry((p)->next, t, m)
+#define list_for_each(pos, head) for (pos = (head)->next; pos != (head); pos = pos->next)
+#define list_for_each_entry(pos, head, member) for (pos = list_entry((head)->next, typeof(*pos), member); &pos->member != (head); pos = list_entry(pos->member.next, typeof(*pos), member))
+#define list_for_each_entry_safe(pos, n, head, member) for (pos = list_entry((head)->next, typeof(*pos), member), n = list_entry(pos->member.next, typeof(*pos), member); &pos->member != (head); pos = n, n = list_entry(n->member.next, typeof(*n), member))
+#endif
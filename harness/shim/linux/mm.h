@@ -0,0 +1,12 @@
+#include "../kshim.h"
+#ifndef KSHIM_MM
+#define KSHIM_MM
+struct page;
+unsigned long get_zeroed_page(int gfp);
+void free_page(unsigned long addr);
+struct page *virt_to_page(const void *p);
+unsigned long virt_to_phys(const void *p);
+void SetPageReserved(struct page *p);
+void ClearPageReserved(struct page *p);
+int remap_pfn_range(struct vm_area_struct *vma, unsigned long addr, unsigned long pfn, unsigned long size, int prot);
+#endif
@@ -0,0 +1,4 @@
+#include "../kshim.h"
+struct platform_device { struct device dev; };
+struct platform_device *platform_device_register_simple(const char *name, int id, void *res, unsigned n);
+void platform_device_unregister(struct platform_device *p);
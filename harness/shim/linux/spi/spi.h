@@ -0,0 +1,27 @@
+#ifndef KSHIM_SPI_H
+#define KSHIM_SPI_H
+#include "../../kshim.h"
+#include "../list.h"
+struct spi_device;
+struct spi_message;
+struct spi_master { int bus_num; unsigned num_chipselect; int (*setup)(struct spi_device *); int (*transfer)(struct spi_device *, struct spi_message *); };
+struct spi_device { struct device dev; struct spi_master *master; int chip_select; unsigned max_speed_hz; unsigned mode; char modalias[32]; struct list_head node; };
+struct spi_transfer { const void *tx_buf; void *rx_buf; unsigned len; unsigned delay_usecs; unsigned cs_change; struct list_head transfer_list; };
+struct spi_message { struct list_head transfers; int status; unsigned actual_length; void (*complete)(void *); void *context; };
+static inline void spi_message_init(struct spi_message *m) { memset(m, 0, sizeof *m); INIT_LIST_HEAD(&m->transfers); }
+static inline void spi_message_add_tail(struct spi_transfer *t, struct spi_message *m) { list_add_tail(&t->transfer_list, &m->transfers); }
+int spi_sync(struct spi_device *d, struct spi_message *m);
+struct spi_driver { struct { const char *name; struct module *owner; } driver; int (*probe)(struct spi_device *); int (*remove)(struct spi_device *); struct list_head node; };
+int spi_register_driver(struct spi_driver *d);
+void spi_unregister_driver(struct spi_driver *d);
+struct spi_board_info { char modalias[32]; const void *platform_data; unsigned max_speed_hz; int bus_num; unsigned chip_select; unsigned mode; };
+#define SPI_MODE_0 0
+struct spi_master *spi_alloc_master(struct device *d, unsigned size);
+int spi_register_master(struct spi_master *m);
+void spi_unregister_master(struct spi_master *m);
+void spi_master_put(struct spi_master *m);
+struct spi_device *spi_new_device(struct spi_master *m, struct spi_board_info *i);
+#define __devexit_p(x) x
+#define __devexit
+#define __devinit
+#endif
@@ -0,0 +1,18 @@
+#ifndef KSHIM_TP_H
+#define KSHIM_TP_H
+#include "../kshim.h"
+#define TP_PROTO(args...) args
+#define TP_ARGS(args...) args
+#define TP_STRUCT__entry(args...) args
+#define TP_fast_assign(args...) args
+#define TP_printk(fmt, args...) fmt, args
+#define __field(t, n) t n;
+#define __entry ((struct { int x; } *)0)
+#define __print_symbolic(v, arr...) ""
+#endif
+#undef TRACE_EVENT
+#undef DECLARE_EVENT_CLASS
+#undef DEFINE_EVENT
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) static inline void trace_##name(proto) { }
+#define DECLARE_EVENT_CLASS(name, proto, args, tstruct, assign, print)
+#define DEFINE_EVENT(template, name, proto, args) static inline void trace_##name(proto) { }
@@ -0,0 +1,3 @@
+#include "../kshim.h"
+static inline void *vmalloc(unsigned long n) { return malloc(n); }
+static inline void vfree(const void *p) { free((void*)p); }
@@ -0,0 +1,485 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx concurrency stress test.
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+/* Writer, pump, ioctl, sysfs, open/close and test triggers all at once on one device. Built against
+   the shim (make stress, make stress-tsan) or against a loaded driver (make stress-dev, run it on a
+   kernel with lockdep and KCSAN). Reports per operation throughput and the worst stall, and fails on
+   errors, torn status page reads or an inconsistent queue at the end. */
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+
+#include "harness.h"
+#include "vs10xx.h"
+
+enum {
+	OP_WRITE, OP_OPEN, OP_VOLUME, OP_DELAY, OP_SCIBATCH, OP_FLUSH, OP_RESET,
+	OP_SYSFS, OP_OBSERVE, OP_SINETEST, OP_MEMTEST, OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] = {
+	"write", "open/close", "volume", "getdelay", "scibatch", "flush", "reset",
+	"sysfs", "observer", "sinetest", "memtest"
+};
+
+struct stress_op {
+	pthread_mutex_t lock;
+	unsigned long long ops;
+	unsigned long long errors;
+	unsigned long long bytes;
+	long long total;
+	long long max;
+};
+
+static struct stress_op ops[OP_COUNT];
+
+static int stop;
+/* the writer's open file, control ioctls go through it the way a player's control thread would */
+static pthread_rwlock_t shared_lock;
+static struct file *shared;
+
+static int minor = 0;
+static int seconds = 10;
+static int memtest = 0;
+static unsigned long long torn;
+
+static inline int stopped(void) {
+
+	return __atomic_load_n(&stop, __ATOMIC_RELAXED);
+}
+
+static void stress_account(int op, long long t0, int status, unsigned long long bytes) {
+
+	long long dt = harness_now() - t0;
+	struct stress_op *o = &ops[op];
+
+	pthread_mutex_lock(&o->lock);
+	o->ops++;
+	o->bytes += bytes;
+	o->total += dt;
+	if (dt > o->max) {
+		o->max = dt;
+	}
+	if (status < 0) {
+		o->errors++;
+	}
+	pthread_mutex_unlock(&o->lock);
+}
+
+static void stress_sleep(int ms) {
+
+	long long until = harness_now() + ms * 1000000LL;
+
+	while (!stopped() && harness_now() < until) {
+		usleep(1000);
+	}
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* THREADS                                                                                                                       */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static void *stress_writer(void *arg) {
+/*
+ *  Descr:  Stream for a random while, close (the pump ends the stream) and open again
+ *  Return: -
+ */
+
+	static char stream[8192];
+	unsigned int seed = 1;
+	struct file *file;
+	long long t0, until;
+	ssize_t n;
+	int i;
+
+	(void)arg;
+
+	for (i = 0; i < (int)sizeof(stream); i += 4) {
+		stream[i] = 0xff; stream[i+1] = 0xfb; stream[i+2] = 0x90; stream[i+3] = 0x00;
+	}
+
+	while (!stopped()) {
+
+		t0 = harness_now();
+		file = harness_open(minor, 1);
+		stress_account(OP_OPEN, t0, file ? 0 : -1, 0);
+		if (file == NULL) {
+			stress_sleep(10);
+			continue;
+		}
+
+		pthread_rwlock_wrlock(&shared_lock);
+		shared = file;
+		pthread_rwlock_unlock(&shared_lock);
+
+		until = harness_now() + (20 + rand_r(&seed) % 500) * 1000000LL;
+		while (!stopped() && harness_now() < until) {
+			size_t len = 1 + rand_r(&seed) % sizeof(stream);
+			t0 = harness_now();
+			n = harness_write(file, stream, len);
+			stress_account(OP_WRITE, t0, n < 0 ? -1 : 0, n > 0 ? n : 0);
+		}
+
+		pthread_rwlock_wrlock(&shared_lock);
+		shared = NULL;
+		pthread_rwlock_unlock(&shared_lock);
+
+		t0 = harness_now();
+		stress_account(OP_OPEN, t0, harness_close(file), 0);
+	}
+
+	return NULL;
+}
+
+static void *stress_ioctl(void *arg) {
+
+	struct vs10xx_volume volume;
+	struct vs10xx_delay delay;
+	struct vs10xx_scibatch batch;
+	unsigned int seed = 2 + (unsigned long)arg;
+	struct file *file;
+	long long t0;
+	int r, i;
+
+	file = harness_open(minor, 0);
+	if (file == NULL) {
+		stress_account(OP_OBSERVE, harness_now(), -1, 0);
+		return NULL;
+	}
+
+	/* a read-only open must not steer the stream */
+	t0 = harness_now();
+	r = harness_ioctl(file, VS10XX_CTL_FLUSH, NULL);
+	stress_account(OP_FLUSH, t0, (r == -EBADF ? 0 : -1), 0);
+
+	while (!stopped()) {
+
+		r = rand_r(&seed) % 100;
+		t0 = harness_now();
+
+		if (r < 50) {
+			volume.left = volume.rght = rand_r(&seed) % 64;
+			pthread_rwlock_rdlock(&shared_lock);
+			r = (shared ? harness_ioctl(shared, VS10XX_CTL_SETVOLUME, &volume) : 0);
+			pthread_rwlock_unlock(&shared_lock);
+			if (r == 0) {
+				r = harness_ioctl(file, VS10XX_CTL_GETVOLUME, &volume);
+			}
+			stress_account(OP_VOLUME, t0, r, 0);
+		} else if (r < 75) {
+			r = harness_ioctl(file, VS10XX_CTL_GETDELAY, &delay);
+			stress_account(OP_DELAY, t0, r, 0);
+		} else if (r < 98) {
+			memset(&batch, 0, sizeof(batch));
+			batch.count = 4;
+			for (i = 0; i < 4; i++) {
+				batch.ops[i].op = VS10XX_SCI_READ;
+				batch.ops[i].reg = i + 8;
+			}
+			r = harness_ioctl(file, VS10XX_CTL_SCIBATCH, &batch);
+			stress_account(OP_SCIBATCH, t0, r, 0);
+		} else {
+			pthread_rwlock_rdlock(&shared_lock);
+			if (shared) {
+				r = harness_ioctl(shared, VS10XX_CTL_FLUSH, NULL);
+				stress_account(OP_FLUSH, t0, r, 0);
+			}
+			pthread_rwlock_unlock(&shared_lock);
+		}
+	}
+
+	harness_close(file);
+
+	return NULL;
+}
+
+static void *stress_reset(void *arg) {
+
+	long long t0;
+	int r;
+
+	(void)arg;
+
+	while (!stopped()) {
+
+		stress_sleep(1500);
+
+		pthread_rwlock_rdlock(&shared_lock);
+		if (shared) {
+			t0 = harness_now();
+			r = harness_ioctl(shared, VS10XX_CTL_RESET, NULL);
+			stress_account(OP_RESET, t0, r, 0);
+		}
+		pthread_rwlock_unlock(&shared_lock);
+	}
+
+	return NULL;
+}
+
+static void *stress_sysfs(void *arg) {
+
+	static const char *attrs[] = { "status", "stats", "ctrlwait" };
+	char buf[4096];
+	unsigned int seed = 3;
+	long long t0;
+	int r;
+
+	(void)arg;
+
+	while (!stopped()) {
+
+		t0 = harness_now();
+		r = (int)kshim_sysfs_show(minor, attrs[rand_r(&seed) % 3], buf);
+		if (rand_r(&seed) % 50 == 0) {
+			r = (int)kshim_sysfs_store(minor, "stats", "0");
+		}
+		stress_account(OP_SYSFS, t0, r, 0);
+
+		usleep(200);
+	}
+
+	return NULL;
+}
+
+static void *stress_observer(void *arg) {
+/*
+ *  Descr:  Open/close read-only and check the status page is never seen half updated
+ *  Return: -
+ */
+
+	volatile struct vs10xx_status *page;
+	struct vs10xx_status copy;
+	struct file *file;
+	unsigned int seq;
+	long long t0;
+	int i;
+
+	(void)arg;
+
+	while (!stopped()) {
+
+		t0 = harness_now();
+		file = harness_open(minor, 0);
+		page = (file ? harness_mmap(file, sizeof(struct vs10xx_status)) : NULL);
+
+		for (i = 0; page && i < 100 && !stopped(); i++) {
+
+			seq = page->seq;
+			__sync_synchronize();
+			memcpy(&copy, (const void *)page, sizeof(copy));
+			__sync_synchronize();
+
+			if (!(seq & 1) && seq == page->seq) {
+				/* consistent snapshot, check it */
+				if (copy.seq != seq || copy.state > VS10XX_PUMP_CLOSING) {
+					__sync_fetch_and_add(&torn, 1);
+				}
+			}
+
+			usleep(100);
+		}
+
+		stress_account(OP_OBSERVE, t0, page ? 0 : -1, 0);
+
+		if (file) {
+			harness_close(file);
+		}
+	}
+
+	return NULL;
+}
+
+static void *stress_test(void *arg) {
+
+	long long t0;
+	int n = 0, r;
+
+	(void)arg;
+
+	while (!stopped()) {
+
+		stress_sleep(3000);
+		if (stopped()) {
+			break;
+		}
+
+		t0 = harness_now();
+		if (memtest && (++n % 4) == 0) {
+			r = (int)kshim_sysfs_store(minor, "test", "M");
+			stress_account(OP_MEMTEST, t0, r, 0);
+		} else {
+			r = (int)kshim_sysfs_store(minor, "test", "S");
+			stress_account(OP_SINETEST, t0, r, 0);
+		}
+	}
+
+	return NULL;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* MAIN                                                                                                                          */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static int stress_check(void) {
+/*
+ *  Descr:  After all threads stopped the pump must come to rest with an empty queue
+ *  Return: number of problems
+ */
+
+	struct vs10xx_status copy;
+	volatile struct vs10xx_status *page;
+	struct vs10xx_delay delay;
+	struct file *file;
+	long long until = harness_now() + 5000000000LL;
+	int problems = 0;
+
+	file = harness_open(minor, 0);
+	page = (file ? harness_mmap(file, sizeof(struct vs10xx_status)) : NULL);
+	if (page == NULL) {
+		printf("check: cannot open the status page\n");
+		return 1;
+	}
+
+	do {
+		usleep(10000);
+		memcpy(&copy, (const void *)page, sizeof(copy));
+	} while ((copy.level || copy.state != VS10XX_PUMP_PAUSED || (copy.seq & 1)) && harness_now() < until);
+
+	if (copy.level || copy.state != VS10XX_PUMP_PAUSED) {
+		printf("check: pump not at rest, state:%u level:%u\n", copy.state, copy.level);
+		problems++;
+	}
+
+	if (harness_ioctl(file, VS10XX_CTL_GETDELAY, &delay) < 0) {
+		printf("check: getdelay failed\n");
+		problems++;
+	}
+
+	harness_close(file);
+
+	file = harness_open(minor, 1);
+	if (file == NULL) {
+		printf("check: device cannot be opened for writing\n");
+		problems++;
+	} else {
+		harness_close(file);
+	}
+
+	return problems;
+}
+
+int main (int argc, char *argv[]) {
+
+	void *(*threads[])(void *) = {
+		stress_writer, stress_ioctl, stress_ioctl, stress_reset, stress_sysfs, stress_observer, stress_test
+	};
+	pthread_t tid[sizeof(threads) / sizeof(threads[0])];
+	int n = sizeof(threads) / sizeof(threads[0]);
+	pthread_rwlockattr_t rwattr;
+	int i, opt, problems = 0;
+	char text[4096];
+
+	while ((opt = getopt(argc, argv, "hd:t:mv")) != -1) {
+		switch (opt) {
+			case 'd':
+				minor = atoi(optarg);
+				break;
+			case 't':
+				seconds = atoi(optarg);
+				break;
+			case 'm':
+				memtest = 1;
+				break;
+			case 'v':
+				kshim_loglevel = 7;
+				break;
+			default:
+				printf("Usage: %s [options]\n"
+					"\nOptions:\n"
+					"  -h           help\n"
+					"  -d minor     device (0)\n"
+					"  -t seconds   duration (10)\n"
+					"  -m           include memtest, holds the device for over a second\n"
+					"  -v           show driver messages\n\n"
+					, argv[0]
+				);
+				return (opt == 'h' ? 0 : 1);
+		}
+	}
+
+	/* the emulator keeps up with the writer, the pump is the bottleneck */
+	kshim_param_set("bitrate", 8000000);
+
+	/* the writer must get to close while the control threads keep coming */
+	pthread_rwlockattr_init(&rwattr);
+	pthread_rwlockattr_setkind_np(&rwattr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	pthread_rwlock_init(&shared_lock, &rwattr);
+
+	if (harness_start() < 0) {
+		return 1;
+	}
+
+	for (i = 0; i < OP_COUNT; i++) {
+		pthread_mutex_init(&ops[i].lock, NULL);
+	}
+
+	for (i = 0; i < n; i++) {
+		pthread_create(&tid[i], NULL, threads[i], (void *)(long)i);
+	}
+
+	stress_sleep(seconds * 1000);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+	for (i = 0; i < n; i++) {
+		pthread_join(tid[i], NULL);
+	}
+
+	problems += stress_check();
+
+	printf("%-12s %10s %8s %12s %10s %10s\n", "operation", "ops", "errors", "kB", "avg us", "max us");
+	for (i = 0; i < OP_COUNT; i++) {
+		printf("%-12s %10llu %8llu %12llu %10.1f %10.1f\n", op_names[i], ops[i].ops, ops[i].errors, ops[i].bytes / 1024,
+			ops[i].ops ? ops[i].total / 1000.0 / ops[i].ops : 0.0, ops[i].max / 1000.0);
+		/* open may fail while the previous stream ends, anything else is a problem */
+		if (i != OP_OPEN) {
+			problems += (ops[i].errors ? 1 : 0);
+		}
+	}
+
+	printf("throughput   %.1f kB/s\n", ops[OP_WRITE].bytes / 1024.0 / seconds);
+	printf("torn status  %llu\n", torn);
+	problems += (torn ? 1 : 0);
+
+	if (kshim_sysfs_show(minor, "ctrlwait", text) > 0) {
+		printf("ctrlwait:\n%s", text);
+	}
+
+	harness_stop();
+
+	printf("%s\n", problems ? "FAILED" : "ok");
+
+	return (problems ? 1 : 0);
+}
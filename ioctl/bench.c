@@ -0,0 +1,496 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx streaming benchmark
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "../module/vs10xx.h"
+
+#define BENCH_DEVICES 64
+#define BENCH_IOV 4
+
+enum { BENCH_WRITE, BENCH_WRITEV, BENCH_SENDFILE, BENCH_POLL };
+
+static const char *method_names[] = { "write", "writev", "sendfile", "poll" };
+
+struct bench_dev {
+	const char *device;
+	pthread_t thread;
+	int fd;
+	int status_fd;
+	volatile struct vs10xx_status *page;
+	/* results */
+	unsigned long long bytes;
+	unsigned long long blocked;
+	unsigned long long cpu;
+	unsigned long long elapsed;
+	unsigned int *lat;
+	unsigned int nlat;
+	unsigned int maxlat;
+	unsigned int eagain;
+	unsigned int underruns;
+	int error;
+};
+
+/* shared settings */
+static int method = BENCH_WRITE;
+static int wrsize = 4096;
+static int rate = 0;
+static int seconds = 10;
+static int group = 0;
+static const char *source = NULL;
+static int srcfd = -1;
+static const char *srcmap = NULL;
+static off_t srclen = 0;
+
+static unsigned long long now_ns(void) {
+
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long cpu_ns(void) {
+
+	struct rusage ru;
+
+	getrusage(RUSAGE_THREAD, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+}
+
+static int cmp_uint(const void *a, const void *b) {
+
+	unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+	return (x > y) - (x < y);
+}
+
+static unsigned int percentile(struct bench_dev *dev, int permille) {
+
+	return (dev->nlat ? dev->lat[(unsigned long long)(dev->nlat - 1) * permille / 1000] : 0);
+}
+
+static unsigned int underruns(struct bench_dev *dev) {
+
+	unsigned int seq, n;
+
+	if (dev->page == NULL) {
+		return 0;
+	}
+
+	/* retry while the driver is updating the page */
+	do {
+		seq = dev->page->seq;
+		__sync_synchronize();
+		n = dev->page->underruns;
+		__sync_synchronize();
+	} while ((seq & 1) || seq != dev->page->seq);
+
+	return n;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* SOURCE                                                                                                                        */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static int source_open(void) {
+/*
+ *  Descr:  Map the file to stream, or make a synthetic one: mpeg1 layer 3 frames at 128kbit/s 44.1kHz
+ *          (417 bytes each) with a silent payload
+ *  Return: 0 or -1
+ */
+
+	static const unsigned char hdr[4] = { 0xff, 0xfb, 0x90, 0x00 };
+	struct stat st;
+	char name[] = "/tmp/vs10xx-bench-XXXXXX";
+	char frame[417];
+	int i;
+
+	if (source) {
+
+		srcfd = open(source, O_RDONLY);
+		if (srcfd < 0 || fstat(srcfd, &st) < 0 || st.st_size == 0) {
+			printf("error opening source: %s\n", source);
+			return -1;
+		}
+
+	} else {
+
+		/* a file, so sendfile works the same */
+		srcfd = mkstemp(name);
+		if (srcfd < 0) {
+			printf("error creating synthetic source\n");
+			return -1;
+		}
+		unlink(name);
+
+		memset(frame, 0, sizeof(frame));
+		memcpy(frame, hdr, sizeof(hdr));
+		for (i = 0; i < 1000; i++) {
+			if (write(srcfd, frame, sizeof(frame)) != sizeof(frame)) {
+				printf("error writing synthetic source\n");
+				return -1;
+			}
+		}
+		fstat(srcfd, &st);
+	}
+
+	srclen = st.st_size;
+	srcmap = mmap(NULL, srclen, PROT_READ, MAP_SHARED, srcfd, 0);
+	if (srcmap == MAP_FAILED) {
+		printf("error mapping source\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* STREAMING                                                                                                                     */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static ssize_t bench_once(struct bench_dev *dev, off_t *pos, size_t len) {
+/*
+ *  Descr:  One write operation of up to len bytes from the source at pos, with the selected method
+ *  Return: bytes written or -1
+ */
+
+	struct iovec iov[BENCH_IOV];
+	struct pollfd pfd;
+	size_t seg;
+	ssize_t n;
+	int i;
+
+	if (len > (size_t)(srclen - *pos)) {
+		len = srclen - *pos;
+	}
+
+	switch (method) {
+
+		case BENCH_WRITEV:
+			seg = (len + BENCH_IOV - 1) / BENCH_IOV;
+			for (i = 0; i < BENCH_IOV; i++) {
+				size_t off = i * seg < len ? i * seg : len;
+				iov[i].iov_base = (void *)(srcmap + *pos + off);
+				iov[i].iov_len = (off + seg <= len ? seg : len - off);
+			}
+			n = writev(dev->fd, iov, BENCH_IOV);
+			break;
+
+		case BENCH_SENDFILE:
+			{
+				off_t off = *pos;
+				n = sendfile(dev->fd, srcfd, &off, len);
+			}
+			break;
+
+		case BENCH_POLL:
+			n = write(dev->fd, srcmap + *pos, len);
+			while (n < 0 && errno == EAGAIN) {
+				dev->eagain++;
+				pfd.fd = dev->fd;
+				pfd.events = POLLOUT;
+				if (poll(&pfd, 1, 1000) < 0) {
+					break;
+				}
+				n = write(dev->fd, srcmap + *pos, len);
+			}
+			break;
+
+		default:
+			n = write(dev->fd, srcmap + *pos, len);
+			break;
+	}
+
+	if (n > 0) {
+		*pos = (*pos + n) % srclen;
+	}
+
+	return n;
+}
+
+static void *bench_thread(void *arg) {
+
+	struct bench_dev *dev = arg;
+	unsigned long long start, end, t0, t1, due;
+	unsigned int cap = 4096;
+	off_t pos = 0;
+	ssize_t n;
+
+	dev->lat = malloc(cap * sizeof(*dev->lat));
+	dev->underruns = underruns(dev);
+
+	start = now_ns();
+	end = start + seconds * 1000000000ULL;
+	dev->cpu = cpu_ns();
+
+	while ((t0 = now_ns()) < end && dev->lat) {
+
+		if (rate > 0) {
+
+			/* pace to the target rate [kbit/s] */
+			due = start + dev->bytes * 8000000ULL / rate;
+			if (due > t0) {
+				struct timespec ts = { (due - t0) / 1000000000ULL, (due - t0) % 1000000000ULL };
+				nanosleep(&ts, NULL);
+				t0 = now_ns();
+			}
+		}
+
+		n = bench_once(dev, &pos, wrsize);
+		t1 = now_ns();
+
+		if (n < 0) {
+			dev->error = errno;
+			break;
+		}
+
+		dev->bytes += n;
+		dev->blocked += t1 - t0;
+
+		if (dev->nlat == cap) {
+			unsigned int *lat = realloc(dev->lat, 2 * cap * sizeof(*dev->lat));
+			if (lat == NULL) {
+				break;
+			}
+			dev->lat = lat;
+			cap *= 2;
+		}
+		dev->lat[dev->nlat++] = (unsigned int)((t1 - t0) / 1000);
+	}
+
+	dev->elapsed = now_ns() - start;
+	dev->cpu = cpu_ns() - dev->cpu;
+	dev->underruns = underruns(dev) - dev->underruns;
+
+	if (dev->lat) {
+		qsort(dev->lat, dev->nlat, sizeof(*dev->lat), cmp_uint);
+		dev->maxlat = (dev->nlat ? dev->lat[dev->nlat - 1] : 0);
+	}
+
+	return NULL;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* MAIN                                                                                                                          */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+int main (int argc, char *argv[]) {
+
+	struct bench_dev devs[BENCH_DEVICES];
+	const char *csv = NULL;
+	FILE *out;
+	time_t stamp;
+	int ndevs = 0, opt, i, rc = 0;
+
+	memset(devs, 0, sizeof(devs));
+
+	while ((opt = getopt(argc, argv, "hd:f:r:s:m:t:c:g")) != -1) {
+		switch (opt) {
+			case 'd':
+				if (ndevs < BENCH_DEVICES) {
+					devs[ndevs++].device = optarg;
+				}
+				break;
+			case 'f':
+				source = optarg;
+				break;
+			case 'r':
+				rate = atoi(optarg);
+				break;
+			case 's':
+				wrsize = atoi(optarg);
+				break;
+			case 'm':
+				for (i = 0; i < 4 && strcmp(optarg, method_names[i]); i++);
+				if (i == 4) {
+					printf("unknown method: %s\n", optarg);
+					return -1;
+				}
+				method = i;
+				break;
+			case 't':
+				seconds = atoi(optarg);
+				break;
+			case 'c':
+				csv = optarg;
+				break;
+			case 'g':
+				group = 1;
+				break;
+			default:
+				printf("Usage: %s [options]\n"
+					"\nOptions:\n"
+					"  -h           help\n"
+					"  -d device    device to stream to, repeat for more (/dev/vs10xx-0)\n"
+					"  -f file      file to stream, looped (synthetic mp3 128kbit/s)\n"
+					"  -r kbit/s    target rate, 0: as fast as the driver accepts (0)\n"
+					"  -s bytes     write size (4096)\n"
+					"  -m method    write, writev, sendfile or poll (non-blocking) (write)\n"
+					"  -t seconds   duration (10)\n"
+					"  -c file      append results to a csv file\n"
+					"  -g           start the devices as a sync group, report the start skew\n\n"
+					, argv[0]
+				);
+				return (opt == 'h' ? 0 : -1);
+		}
+	}
+
+	if (ndevs == 0) {
+		devs[ndevs++].device = "/dev/vs10xx-0";
+	}
+
+	if (wrsize <= 0 || seconds <= 0 || source_open() < 0) {
+		return -1;
+	}
+
+	for (i = 0; i < ndevs; i++) {
+
+		devs[i].fd = open(devs[i].device, O_WRONLY | (method == BENCH_POLL ? O_NONBLOCK : 0));
+		if (devs[i].fd < 0) {
+			printf("error opening device: %s\n", devs[i].device);
+			return -1;
+		}
+
+		/* status page for the underrun count, optional */
+		devs[i].status_fd = open(devs[i].device, O_RDONLY);
+		if (devs[i].status_fd >= 0) {
+			devs[i].page = mmap(NULL, sizeof(struct vs10xx_status), PROT_READ, MAP_SHARED, devs[i].status_fd, 0);
+			if (devs[i].page == MAP_FAILED) {
+				devs[i].page = NULL;
+			}
+		}
+	}
+
+	for (i = 0; group && i < ndevs; i++) {
+
+		/* members hold back until VS10XX_CTL_GROUPSTART */
+		struct vs10xx_group g = { 1 };
+		if (ioctl(devs[i].fd, VS10XX_CTL_SETGROUP, &g) < 0) {
+			printf("error joining group: %s\n", devs[i].device);
+			return -1;
+		}
+	}
+
+	for (i = 0; i < ndevs; i++) {
+		pthread_create(&devs[i].thread, NULL, bench_thread, &devs[i]);
+	}
+
+	if (group) {
+
+		struct vs10xx_groupstart gs;
+		struct timespec now;
+
+		/* start 200 ms from now, the writers prebuffer meanwhile */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		memset(&gs, 0, sizeof(gs));
+		gs.group = 1;
+		gs.when = (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec + 200000000ULL;
+
+		if (ioctl(devs[0].fd, VS10XX_CTL_GROUPSTART, &gs) < 0) {
+			printf("group start failed: %s\n", strerror(errno));
+			rc = -1;
+		} else {
+			printf("group start: %u members, skew %u us, late %u us\n", gs.members, gs.skew, gs.late);
+		}
+	}
+
+	for (i = 0; i < ndevs; i++) {
+		pthread_join(devs[i].thread, NULL);
+	}
+
+	for (i = 0; group && i < ndevs; i++) {
+		struct vs10xx_group g = { 0 };
+		ioctl(devs[i].fd, VS10XX_CTL_SETGROUP, &g);
+	}
+
+	stamp = time(NULL);
+	out = NULL;
+	if (csv) {
+		struct stat st;
+		int header = (stat(csv, &st) < 0 || st.st_size == 0);
+		out = fopen(csv, "a");
+		if (out == NULL) {
+			printf("error opening csv: %s\n", csv);
+			rc = -1;
+		} else if (header) {
+			fprintf(out, "time,device,method,size,rate,seconds,bytes,kbps,p50_us,p90_us,p99_us,p999_us,max_us,"
+				"blocked_pct,cpu_pct,eagain,underruns,error\n");
+		}
+	}
+
+	for (i = 0; i < ndevs; i++) {
+
+		struct bench_dev *dev = &devs[i];
+		double secs = dev->elapsed / 1e9;
+		double kbps = (secs > 0 ? dev->bytes * 8 / 1000.0 / secs : 0);
+		double blocked = (dev->elapsed ? 100.0 * dev->blocked / dev->elapsed : 0);
+		double cpu = (dev->elapsed ? 100.0 * dev->cpu / dev->elapsed : 0);
+
+		printf("%s: %s %dB, %llu bytes in %.1fs, %.1f kbit/s\n"
+			"  latency us: p50 %u p90 %u p99 %u p99.9 %u max %u\n"
+			"  blocked %.1f%%, cpu %.1f%%, eagain %u, underruns %u%s%s\n",
+			dev->device, method_names[method], wrsize, dev->bytes, secs, kbps,
+			percentile(dev, 500), percentile(dev, 900), percentile(dev, 990), percentile(dev, 999), dev->maxlat,
+			blocked, cpu, dev->eagain, dev->underruns,
+			dev->error ? ", error: " : "", dev->error ? strerror(dev->error) : "");
+
+		if (out) {
+			fprintf(out, "%ld,%s,%s,%d,%d,%d,%llu,%.1f,%u,%u,%u,%u,%u,%.2f,%.2f,%u,%u,%d\n",
+				(long)stamp, dev->device, method_names[method], wrsize, rate, seconds, dev->bytes, kbps,
+				percentile(dev, 500), percentile(dev, 900), percentile(dev, 990), percentile(dev, 999), dev->maxlat,
+				blocked, cpu, dev->eagain, dev->underruns, dev->error);
+		}
+
+		if (dev->error) {
+			rc = -1;
+		}
+
+		if (dev->page) {
+			munmap((void *)dev->page, sizeof(struct vs10xx_status));
+		}
+		if (dev->status_fd >= 0) {
+			close(dev->status_fd);
+		}
+		close(dev->fd);
+		free(dev->lat);
+	}
+
+	if (out) {
+		fclose(out);
+	}
+
+	return rc;
+}
@@ -23,10 +23,17 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 
 #include "../module/vs10xx.h"
 
+static const char *scireg_names[16] = {
+	"MODE", "STATUS", "BASS", "CLOCKF", "DECODE_TIME", "AUDATA", "WRAM", "WRAMADDR",
+	"HDAT0", "HDAT1", "AIADDR", "VOL", "AICTRL0", "AICTRL1", "AICTRL2", "AICTRL3"
+};
+
 int main (int argc, char *argv[]) {
 
 	struct vs10xx_scireg scireg;
@@ -34,7 +41,17 @@ int main (int argc, char *argv[]) {
 	struct vs10xx_volume volume;
 	struct vs10xx_tone tone;
 	struct vs10xx_info info;
-	int fd, cmd, rc = 0;
+	struct vs10xx_scibatch scibatch;
+	struct vs10xx_ramp ramp;
+	struct vs10xx_status status;
+	struct vs10xx_delay delay;
+	struct vs10xx_rebuf rebuf;
+	struct vs10xx_group group;
+	struct vs10xx_groupstart groupstart;
+	struct timespec now;
+	volatile struct vs10xx_status *page;
+	unsigned int seq;
+	int fd, cmd, i, rc = 0;
 	char* device;
 
 	if ( (argc == 1) || (argc > 1 && (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")))) {
@@ -47,13 +64,20 @@ int main (int argc, char *argv[]) {
 			"  reset\n"
 			"  getscireg    regno\n"
 			"  setscireg    regno msb lsb\n"
+			"  dumpregs\n"
 			"  getclockf\n"
 			"  setclockf    mul add clk\n"
 			"  getvolume\n"
 			"  setvolume    left right\n"
+			"  setramp      left right msec curve\n"
 			"  gettone\n"
 			"  settone      tb tl bb bl\n"
-			"  getinfo\n\n"
+			"  getinfo\n"
+			"  getstatus\n"
+			"  getdelay\n"
+			"  setrebuf     level notify\n"
+			"  setgroup     group (0: leave)\n"
+			"  groupstart   group delay_ms\n\n"
 			, argv[0]
 		);
 
@@ -73,7 +97,8 @@ int main (int argc, char *argv[]) {
 		cmd = 1;
 	}
 
-	fd = open(device, O_RDWR);
+	/* getstatus only maps the status page, which also works while another process is streaming */
+	fd = open(device, (argc == 1 && !strcmp(argv[cmd],"getstatus")) ? O_RDONLY : O_RDWR);
 
 	if (fd == -1) {
 		printf("error opening device: %s\n", device);
@@ -97,6 +122,19 @@ int main (int argc, char *argv[]) {
 		rc = ioctl (fd, VS10XX_CTL_SETSCIREG, &scireg);
 	}
 
+	else if (argc == 1 && !strcmp(argv[cmd],"dumpregs")) {
+		memset(&scibatch, 0, sizeof(scibatch));
+		scibatch.count = 16;
+		for (i = 0; i < 16; i++) {
+			scibatch.ops[i].op = VS10XX_SCI_READ;
+			scibatch.ops[i].reg = i;
+		}
+		rc = ioctl (fd, VS10XX_CTL_SCIBATCH, &scibatch);
+		for (i = 0; rc == 0 && i < 16; i++) {
+			printf("scireg: %02X %02X%02X %s\n", scibatch.ops[i].reg, scibatch.ops[i].msb, scibatch.ops[i].lsb, scireg_names[i]);
+		}
+	}
+
 	else if (argc == 1 && !strcmp(argv[cmd],"getclockf")) {
 		rc = ioctl (fd, VS10XX_CTL_GETCLOCKF, &clockf);
 		printf("clockf: mul:%u add:%u clk:%u\n", clockf.mul, clockf.add, clockf.clk);
@@ -120,6 +158,14 @@ int main (int argc, char *argv[]) {
 		rc = ioctl (fd, VS10XX_CTL_SETVOLUME, &volume);
 	}
 
+	else if (argc == 5 && !strcmp(argv[cmd],"setramp")) {
+		ramp.left = atoi(argv[cmd+1]);
+		ramp.rght = atoi(argv[cmd+2]);
+		ramp.msec = atoi(argv[cmd+3]);
+		ramp.curve = atoi(argv[cmd+4]);
+		rc = ioctl (fd, VS10XX_CTL_SETRAMP, &ramp);
+	}
+
 	else if (argc == 1 && !strcmp(argv[cmd],"gettone")) {
 		rc = ioctl (fd, VS10XX_CTL_GETTONE, &tone);
 		printf("tone: treb-boost:%u treb-limit:%u bass-boost:%u bass-limit:%u\n",
@@ -139,6 +185,51 @@ int main (int argc, char *argv[]) {
 		printf("format: %d\n", info.fmt);
 	}
 
+	else if (argc == 1 && !strcmp(argv[cmd],"getstatus")) {
+		page = mmap(NULL, sizeof(status), PROT_READ, MAP_SHARED, fd, 0);
+		if (page == MAP_FAILED) {
+			rc = -1;
+		} else {
+			/* retry while the driver is updating the page */
+			do {
+				seq = page->seq;
+				__sync_synchronize();
+				memcpy(&status, (const void *)page, sizeof(status));
+				__sync_synchronize();
+			} while ((seq & 1) || seq != page->seq);
+			printf("state: %u format: %u time: %us bitrate: %u rate: %uHz ch: %u hdat: %04X %04X\n"
+				"level: %u underruns: %u sent: %llu\n",
+				status.state, status.fmt, status.decodetime, status.bitrate, status.samplerate, status.channels,
+				status.hdat1, status.hdat0, status.level, status.underruns, status.sent);
+			munmap((void *)page, sizeof(status));
+		}
+	}
+
+	else if (argc == 1 && !strcmp(argv[cmd],"getdelay")) {
+		rc = ioctl (fd, VS10XX_CTL_GETDELAY, &delay);
+		printf("delay: bytes:%u usec:%u rate:%u\n", delay.bytes, delay.usec, delay.rate);
+	}
+
+	else if (argc == 3 && !strcmp(argv[cmd],"setrebuf")) {
+		rebuf.level = atoi(argv[cmd+1]);
+		rebuf.notify = atoi(argv[cmd+2]);
+		rc = ioctl (fd, VS10XX_CTL_SETREBUF, &rebuf);
+	}
+
+	else if (argc == 2 && !strcmp(argv[cmd],"setgroup")) {
+		group.group = atoi(argv[cmd+1]);
+		rc = ioctl (fd, VS10XX_CTL_SETGROUP, &group);
+	}
+
+	else if (argc == 3 && !strcmp(argv[cmd],"groupstart")) {
+		memset(&groupstart, 0, sizeof(groupstart));
+		groupstart.group = atoi(argv[cmd+1]);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		groupstart.when = (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec + atoi(argv[cmd+2]) * 1000000ULL;
+		rc = ioctl (fd, VS10XX_CTL_GROUPSTART, &groupstart);
+		printf("groupstart: members:%u skew:%uus late:%uus\n", groupstart.members, groupstart.skew, groupstart.late);
+	}
+
 	if (rc < 0) {
 		printf("Error: %s\n", strerror(errno));
 	}
@@ -23,7 +23,13 @@
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 /* Board Definition                                                                                                              */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
-#define VS10XX_MAX_DEVICES 4
+/* the driver only sets up the device ids that board code registers spi devices for, any number of
+   them up to the maxdevs module parameter. Fan-out members are ids below VS10XX_MAX_MEMBERS, the
+   width of the member mask of VS10XX_CTL_SETFANOUT. */
+#define VS10XX_MAX_MEMBERS 32
+
+/* sync group numbers 1..VS10XX_MAX_GROUPS, see VS10XX_CTL_SETGROUP */
+#define VS10XX_MAX_GROUPS 32
 
 #define VS10XX_SPI_CTRL "vs10xx-ctrl"
 #define VS10XX_SPI_DATA "vs10xx-data"
@@ -40,6 +46,10 @@ struct vs10xx_board_info {
 
 #define VS10XX_CTL_TYPE      'Q'
 #define VS10XX_CTL_RESET     _IO(VS10XX_CTL_TYPE, 1)
+#define VS10XX_CTL_FLUSH     _IO(VS10XX_CTL_TYPE, 2)
+#define VS10XX_CTL_CANCEL    _IO(VS10XX_CTL_TYPE, 3)
+#define VS10XX_CTL_SEEK      _IO(VS10XX_CTL_TYPE, 4)
+#define VS10XX_CTL_DRAIN     _IO(VS10XX_CTL_TYPE, 5)
 
 #define VS10XX_CTL_GETSCIREG _IOWR(VS10XX_CTL_TYPE, 10, struct vs10xx_scireg)
 #define VS10XX_CTL_SETSCIREG _IOWR(VS10XX_CTL_TYPE, 11, struct vs10xx_scireg)
@@ -50,6 +60,15 @@ struct vs10xx_board_info {
 #define VS10XX_CTL_GETTONE   _IOR(VS10XX_CTL_TYPE, 16, struct vs10xx_tone)
 #define VS10XX_CTL_SETTONE   _IOW(VS10XX_CTL_TYPE, 17, struct vs10xx_tone)
 #define VS10XX_CTL_GETINFO   _IOR(VS10XX_CTL_TYPE, 18, struct vs10xx_info)
+#define VS10XX_CTL_SCIBATCH  _IOWR(VS10XX_CTL_TYPE, 19, struct vs10xx_scibatch)
+#define VS10XX_CTL_SETRAMP   _IOW(VS10XX_CTL_TYPE, 20, struct vs10xx_ramp)
+#define VS10XX_CTL_GETEVENTS _IOR(VS10XX_CTL_TYPE, 21, struct vs10xx_events)
+#define VS10XX_CTL_GETDELAY  _IOR(VS10XX_CTL_TYPE, 22, struct vs10xx_delay)
+#define VS10XX_CTL_SETREBUF  _IOW(VS10XX_CTL_TYPE, 23, struct vs10xx_rebuf)
+#define VS10XX_CTL_SETGROUP  _IOW(VS10XX_CTL_TYPE, 24, struct vs10xx_group)
+#define VS10XX_CTL_GROUPSTART _IOWR(VS10XX_CTL_TYPE, 25, struct vs10xx_groupstart)
+#define VS10XX_CTL_SETFANOUT _IOW(VS10XX_CTL_TYPE, 26, struct vs10xx_fanout)
+#define VS10XX_CTL_MOVE      _IOWR(VS10XX_CTL_TYPE, 27, struct vs10xx_move)
 
 struct vs10xx_scireg {
 	unsigned char reg; /* 0..15  */
@@ -57,6 +76,22 @@ struct vs10xx_scireg {
 	unsigned char lsb; /* 0..255 */
 };
 
+#define VS10XX_SCI_READ   0
+#define VS10XX_SCI_WRITE  1
+#define VS10XX_SCI_MAXOPS 32
+
+struct vs10xx_sciop {
+	unsigned char op;  /* VS10XX_SCI_READ or VS10XX_SCI_WRITE */
+	unsigned char reg; /* 0..15  */
+	unsigned char msb; /* 0..255 */
+	unsigned char lsb; /* 0..255 */
+};
+
+struct vs10xx_scibatch {
+	unsigned int count; /* 1..VS10XX_SCI_MAXOPS, ops are executed in order under one lock */
+	struct vs10xx_sciop ops[VS10XX_SCI_MAXOPS];
+};
+
 struct vs10xx_clockf {
 	unsigned int mul; /* 0..7    fixed clock multiplication factor */
 	unsigned int add; /* 0..3    additional multiplication factor  */
@@ -68,6 +103,16 @@ struct vs10xx_volume {
 	unsigned int rght; /* 0..255 */
 };
 
+#define VS10XX_RAMP_LINEAR 0 /* equal steps in dB          */
+#define VS10XX_RAMP_SCURVE 1 /* slow start and slow finish */
+
+struct vs10xx_ramp {
+	unsigned int left;  /* 0..255 target volume                    */
+	unsigned int rght;  /* 0..255 target volume                    */
+	unsigned int msec;  /* duration of the ramp, 0 sets the target */
+	unsigned int curve; /* VS10XX_RAMP_LINEAR or VS10XX_RAMP_SCURVE */
+};
+
 struct vs10xx_tone {
 	unsigned int trebboost; /* 0..15 (x 1.5 dB) amount of boost for high frequencies       */
 	unsigned int treblimit; /* 0..15 (x 1  kHz) frequency above which amplitude is boosted */
@@ -84,5 +129,92 @@ struct vs10xx_info {
 	vs10xx_fmt_t fmt;
 };
 
+/* events are latched until read with VS10XX_CTL_GETEVENTS, poll() reports POLLPRI while any is pending */
+#define VS10XX_EVT_RAMP     0x0001 /* volume ramp completed                 */
+#define VS10XX_EVT_RATE     0x0002 /* consumption rate estimate changed >6% */
+#define VS10XX_EVT_UNDERRUN 0x0004 /* decoder starved, see vs10xx_rebuf     */
+#define VS10XX_EVT_RECOVER  0x0008 /* watchdog reset a stalled decoder       */
+#define VS10XX_EVT_DROPPED  0x0010 /* recovery dropped a non-mp3 stream      */
+
+struct vs10xx_events {
+	unsigned int mask;
+};
+
+/* playback (re)starts when the queue holds level % of its size, also after an underrun */
+struct vs10xx_rebuf {
+	unsigned int level;  /* 1..100, default 100                   */
+	unsigned int notify; /* 1: raise VS10XX_EVT_UNDERRUN for poll */
+};
+
+/* devices in a sync group prebuffer and stay paused until VS10XX_CTL_GROUPSTART releases them all
+   at once, after that each member rebuffers on its own again. The group is kept across streams. */
+struct vs10xx_group {
+	unsigned int group; /* 1..VS10XX_MAX_GROUPS, 0: leave the group */
+};
+
+struct vs10xx_groupstart {
+	unsigned int group;      /* in:  group to start                                     */
+	unsigned int timeout;    /* in:  [ms] wait for all members to prebuffer, 0: 5000    */
+	unsigned long long when; /* in:  [ns] CLOCK_MONOTONIC start, 0: as soon as buffered */
+	unsigned int members;    /* out: devices started                                    */
+	unsigned int skew;       /* out: [us] first to last member sending                  */
+	unsigned int late;       /* out: [us] first member sending after when (or release)  */
+	unsigned int reserved;
+};
+
+/* fan-out: writes to the device go once into a ring shared by all members, each member's device
+   thread consumes it at its own pace. The other members are claimed like an open() and end their
+   streams when the device is closed. A member that falls a full ring behind blocks the writer or
+   skips ahead, see policy. */
+#define VS10XX_FANOUT_BLOCK 0 /* the writer waits for the slowest member                          */
+#define VS10XX_FANOUT_DROP  1 /* the writer waits for its own device, others drop 1/8 of the ring */
+
+struct vs10xx_fanout {
+	unsigned int members; /* bit n: device n, must include the own device, 0: end */
+	unsigned int policy;  /* VS10XX_FANOUT_BLOCK or VS10XX_FANOUT_DROP           */
+};
+
+/* move the stream of a writing file to another device: the queued chunks change owner, the old
+   device is cancelled and released, the target starts right away and takes the later writes.
+   Mid-stream only mp3 can move, the target starts at the first frame header in the queue. */
+struct vs10xx_move {
+	unsigned int target;  /* in:  device to continue on, must not be open   */
+	unsigned int bytes;   /* out: queued bytes handed over                   */
+	unsigned int skipped; /* out: bytes skipped up to the first frame header */
+};
+
+/* data between write() and the decoder output: the queue plus an estimate of the on-chip stream buffer */
+struct vs10xx_delay {
+	unsigned int bytes; /* queued + estimated in the stream buffer          */
+	unsigned int usec;  /* bytes at the current rate, 0 when rate unknown    */
+	unsigned int rate;  /* [bytes/s] measured consumption, else HDAT bitrate */
+};
+
+/* device thread states, in the status page and the vs10xx_pump_state trace event */
+#define VS10XX_PUMP_PAUSED   0 /* waiting for the queue to fill */
+#define VS10XX_PUMP_WAITING  1 /* waiting for DREQ              */
+#define VS10XX_PUMP_SENDING  2 /* sending queued data           */
+#define VS10XX_PUMP_UNDERRUN 3 /* queue ran empty while playing */
+#define VS10XX_PUMP_CLOSING  4 /* ending the stream             */
+
+/* mmap() the device read-only at offset 0 to get the status page. The device thread rewrites
+   it every statusrate ms, seq is odd while it does. A reader copies the page and retries when
+   seq was odd or differs after the copy, see the ioctl tool for an example. */
+struct vs10xx_status {
+	unsigned int seq;
+	unsigned int state;      /* VS10XX_PUMP_*                        */
+	unsigned int fmt;        /* vs10xx_fmt_t                         */
+	unsigned int decodetime; /* [s] SCI_DECODE_TIME                  */
+	unsigned int bitrate;    /* [bit/s] from HDAT0/1, 0 when unknown */
+	unsigned int samplerate; /* [Hz] from SCI_AUDATA                 */
+	unsigned int channels;   /* 1 or 2                               */
+	unsigned int hdat0;      /* raw SCI_HDAT0                        */
+	unsigned int hdat1;      /* raw SCI_HDAT1                        */
+	unsigned int level;      /* queued chunks                        */
+	unsigned int underruns;  /* since module load                    */
+	unsigned int reserved;
+	unsigned long long sent; /* [bytes] sent to the decoder since open */
+};
+
 #endif
 
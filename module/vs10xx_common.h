@@ -25,6 +25,7 @@
 #include <linux/list.h>
 #include <linux/device.h>
 #include <linux/kdev_t.h>
+#include <linux/version.h>
 
 #define VS10XX_NAME "vs10xx"
 
@@ -35,6 +36,16 @@
 #define MIN(a,b) ((a)<(b) ? (a) : (b))
 #define MAX(a,b) ((a)>(b) ? (a) : (b))
 
+/* flags polled without the device lock, ACCESS_ONCE was replaced by READ_ONCE in 4.15 */
+#ifndef ACCESS_ONCE
+#define ACCESS_ONCE(x) READ_ONCE(x)
+#endif
+
+/* the writer side of such a flag, WRITE_ONCE came in 3.19 */
+#ifndef WRITE_ONCE
+#define WRITE_ONCE(x, val) (ACCESS_ONCE(x) = (val))
+#endif
+
 #define vs10xx_printk(level, fmt, arg...) \
         printk(level "%s: " fmt "\n", __func__, ## arg)
 
@@ -47,19 +58,31 @@
 #define vs10xx_inf(fmt, arg...) \
         vs10xx_printk(KERN_INFO, fmt, ## arg)
 
+/* debug levels are tested through static keys, with debugging off the
+   log statements are patched out of the hot path. Older kernels have no
+   jump labels, there a read-mostly flag is tested instead. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
+#include <linux/jump_label.h>
+DECLARE_STATIC_KEY_FALSE(vs10xx_debug_dbg);
+DECLARE_STATIC_KEY_FALSE(vs10xx_debug_nsy);
+#define vs10xx_debug_on(level) static_branch_unlikely(&vs10xx_debug_##level)
+#else
+extern int vs10xx_debug_dbg;
+extern int vs10xx_debug_nsy;
+#define vs10xx_debug_on(level) unlikely(vs10xx_debug_##level)
+#endif
+
 #define vs10xx_dbg(fmt, arg...)                     \
 	do {                                            \
-		if (*vs10xx_debug > 0)                      \
+		if (vs10xx_debug_on(dbg))                   \
 			vs10xx_printk(KERN_DEBUG, fmt, ## arg); \
         } while (0)
 
 #define vs10xx_nsy(fmt, arg...)                     \
 	do {                                            \
-		if (*vs10xx_debug > 1)                      \
+		if (vs10xx_debug_on(nsy))                   \
 			vs10xx_printk(KERN_DEBUG, fmt, ## arg); \
         } while (0)
 
-extern int *vs10xx_debug;
-
 #endif
 
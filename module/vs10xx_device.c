@@ -21,10 +21,22 @@
 #include "vs10xx_iocomm.h"
 #include "vs10xx_queue.h"
 #include "vs10xx_device.h"
+#include "vs10xx_stats.h"
+#include "vs10xx_trace.h"
 #include "vs10xx_plugins.h"
 
 #include <linux/delay.h>
+#include <linux/device.h>
+#include <linux/hrtimer.h>
 #include <linux/kthread.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/cpumask.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)
+#include <uapi/linux/sched/types.h>
+#endif
 
 /* clockf value */
 static int clockf = 0xc000;
@@ -38,27 +50,229 @@ module_param(plugin, int, 0644);
 static int wclose = 0;
 module_param(wclose, int, 0644);
 
+/* volume ramp step [ms] */
+static int rampstep = 10;
+module_param(rampstep, int, 0644);
+
+/* status page update interval [ms], 0: off */
+static int statusrate = 200;
+module_param(statusrate, int, 0644);
+
+/* failed sdi transfers of a chunk before it is dropped */
+static int spiretry = 3;
+module_param(spiretry, int, 0644);
+
+/* watchdog [ms], reset a decoder that stalls with data queued, 0: off */
+static int watchdog = 2000;
+module_param(watchdog, int, 0644);
+
+/* drift correction period [ms] for vs1063 sync groups, 0: off */
+static int ratetune = 0;
+module_param(ratetune, int, 0644);
+
+/* SCHED_FIFO priority of new device threads, 0: SCHED_OTHER, see sysfs sched */
+static int rtprio = 0;
+module_param(rtprio, int, 0644);
+
+/* decoder stream buffer [bytes] */
+#define VS10XX_DEVICE_FIFO 2048
+
+struct vs10xx_device_fifo_t {
+	ktime_t stamp;      /* time of the fill estimate                */
+	unsigned int fill;  /* estimated stream buffer fill at stamp    */
+	ktime_t full;       /* last time the buffer was seen full       */
+	int fullvalid;      /* streamed continuously since full         */
+	unsigned int since; /* bytes sent since full                    */
+	unsigned int rate;  /* measured consumption [bytes/s], 0: none  */
+	unsigned int told;  /* rate at the last VS10XX_EVT_RATE         */
+};
+
+/* a fault lasts from the first failed transfer or dreq timeout to the next good sdi transfer */
+struct vs10xx_device_fault_t {
+	int active;
+	int retries;        /* failed transfers of the chunk at the queue head */
+	ktime_t start;      /* first failure                                   */
+	s64 usec;           /* audio the decoder still held at the start       */
+};
+
+/* the watchdog clocks restart whenever the pump is not streaming */
+struct vs10xx_device_wdog_t {
+	unsigned long progress;    /* last time dreq let data through     */
+	unsigned long moved;       /* last time SCI_DECODE_TIME changed   */
+	unsigned short decodetime; /* SCI_DECODE_TIME at moved            */
+	unsigned long recoveries;
+};
+
+/* sync group membership, see VS10XX_CTL_GROUPSTART */
+struct vs10xx_device_group_t {
+	int num;         /* 0: no group                                   */
+	int armed;       /* paused until the group starts                 */
+	int pending;     /* released, first sdi transfer not done yet     */
+	ktime_t started; /* first sdi transfer after the release          */
+};
+
+/* rateTune [ppm] limit and the time [s] to close a measured offset */
+#define VS10XX_DEVICE_TUNEMAX 1000
+#define VS10XX_DEVICE_TUNEHOR 10
+
+/* drift against the group reference, the device thread is the only writer */
+struct vs10xx_device_tune_t {
+	unsigned long next;
+	int ref;            /* reference device, -1: none                  */
+	int valid;          /* offset holds a measurement                  */
+	ktime_t stamp;      /* time of the measurement                     */
+	s64 offset;         /* [us] ahead of the reference                 */
+	int drift;          /* [ppm] offset change, averaged over periods  */
+	int ratetune;       /* [ppm] written to the parametric rateTune    */
+};
+
+struct vs10xx_device_ramp_t {
+	int active;
+	int curve;
+	unsigned int msec;
+	unsigned long start;
+	unsigned long next;
+	struct vs10xx_volume from;
+	struct vs10xx_volume to;
+};
+
 struct vs10xx_device_t {
+	/* tested by the device thread on every chunk, kept in the leading cache lines */
 	int id;
-	int open;
+	struct vs10xx_chip *chip;
+	struct vs10xx_queue_t *queue;
+	struct vs10xx_stats_dev_t *stats;
+	int open;                         /* open, start and finish: WRITE_ONCE under the lock, read lockless */
 	int valid;
 	int start;
 	int finish;
+	int written;
+	int dry;
+	int rebuf;
+	int state;
+	int version;
+	atomic_t ctrlreq;
+	unsigned long underrun;
+	unsigned long long sent;
+	struct vs10xx_device_fifo_t fifo;
+	wait_queue_head_t wq;
+	/* control paths */
+	int closing;
+	unsigned long closeby;
+	unsigned char endfill;
 	struct mutex lock;
+	ktime_t locked;
+	spinlock_t ctrllock;
+	struct vs10xx_hist_t ctrlwait;
 	struct device *dev;
 	struct task_struct *kthread;
-	wait_queue_head_t wq;
-	unsigned long underrun;
-	int version;
-};
+	wait_queue_head_t pollq;
+	spinlock_t evlock;
+	unsigned int events;
+	struct vs10xx_status *page;
+	unsigned long pagenext;
+	int rebufevt;
+	struct vs10xx_volume volume;
+	struct vs10xx_device_ramp_t ramp;
+	struct vs10xx_device_fault_t fault;
+	struct vs10xx_device_wdog_t wdog;
+	struct vs10xx_device_group_t group;
+	struct vs10xx_device_tune_t tune;
+	int fanout;           /* devices in fanto[], fed by the writes to this one, 0: none */
+	struct vs10xx_device_t *fanto[VS10XX_MAX_MEMBERS]; /* in id order               */
+	struct vs10xx_device_t *writer; /* device whose writers wait for this one */
+	struct list_head list;
+	unsigned short bass;
+	unsigned short clock;
+	cpumask_var_t cpus;   /* affinity of the device thread                  */
+} ____cacheline_aligned;
+
+/* the devices that are up, see vs10xx_device_init */
+static LIST_HEAD(vs10xx_devices);
+
+/* guards vs10xx_devices, taken before any device lock */
+static DEFINE_MUTEX(vs10xx_device_listlock);
+
+/* one group start at a time */
+static DEFINE_MUTEX(vs10xx_device_grouplock);
+
+/* one scheduling change at a time */
+static DEFINE_MUTEX(vs10xx_device_schedlock);
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX DEVICE LOCKING                                                                                                         */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static inline void vs10xx_device_take(struct vs10xx_device_t *device) {
+
+	mutex_lock(&device->lock);
+	device->locked = ktime_get();
+}
+
+static inline void vs10xx_device_give(struct vs10xx_device_t *device) {
+
+	vs10xx_stats_add(device->stats, lock_ns, ktime_to_ns(ktime_sub(ktime_get(), device->locked)));
+	mutex_unlock(&device->lock);
+}
+
+static void vs10xx_device_lock(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  Take the device lock for a control operation. The pending request makes the
+ *          device thread step aside after the chunk that it is transmitting.
+ *  Return: -
+ */
+
+	ktime_t posted = ktime_get();
+
+	atomic_inc(&device->ctrlreq);
 
-static struct vs10xx_device_t vs10xx_device[VS10XX_MAX_DEVICES];
+	vs10xx_device_take(device);
+
+	if (atomic_dec_and_test(&device->ctrlreq)) {
+		wake_up(&device->wq);
+	}
+
+	spin_lock(&device->ctrllock);
+	vs10xx_hist_add(&device->ctrlwait, ktime_us_delta(device->locked, posted));
+	spin_unlock(&device->ctrllock);
+}
+
+static void vs10xx_device_unlock(struct vs10xx_device_t *device) {
+
+	vs10xx_device_give(device);
+}
+
+static void vs10xx_device_yield(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  Called by the device thread with the lock held, lets pending control operations go first
+ *  Return: -
+ */
+
+	if (atomic_read(&device->ctrlreq)) {
+
+		vs10xx_device_give(device);
+
+		wait_event_timeout(device->wq, !atomic_read(&device->ctrlreq), msecs_to_jiffies(10));
+
+		vs10xx_device_take(device);
+	}
+}
+
+static inline void vs10xx_device_wdogkick(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  Restart the watchdog clocks, also after control operations that reset the chip
+ *  Return: -
+ */
+
+	device->wdog.progress = jiffies;
+	device->wdog.moved = jiffies;
+}
 
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 /* VS10XX DEVICE READ/WRITE SCI REGISTERS                                                                                        */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
-static int vs10xx_device_w_sci_reg(int id, unsigned char reg, unsigned char msb, unsigned char lsb) {
+static int vs10xx_device_w_sci_reg(struct vs10xx_device_t *device, unsigned char reg, unsigned char msb, unsigned char lsb) {
 
 	int status = 0;
 
@@ -66,13 +280,32 @@ static int vs10xx_device_w_sci_reg(int id, unsigned char reg, unsigned char msb,
 
 	if (status == 0) {
 
-		status = vs10xx_io_ctrl_xf(id, cmd, sizeof(cmd), NULL, 0);
+		status = vs10xx_io_ctrl_xf(device->chip, cmd, sizeof(cmd), NULL, 0);
+
+		vs10xx_nsy("id:%d %02X %02X%02X", device->id, (int)cmd[1], (int)cmd[2], (int)cmd[3]);
+
+		if (status == 0 && reg == 0x0B) {
+
+			/* keep track of SCI_VOL */
+			device->volume.left = 255 - msb;
+			device->volume.rght = 255 - lsb;
+		}
+
+		if (status == 0 && reg == 0x02) {
+
+			/* keep track of SCI_BASS, restored by the watchdog */
+			device->bass = (msb << 8) | lsb;
+		}
+
+		if (status == 0 && reg == 0x03) {
 
-		vs10xx_nsy("id:%d %02X %02X%02X", id, (int)cmd[1], (int)cmd[2], (int)cmd[3]);
+			/* keep track of SCI_CLOCKF, restored by the watchdog */
+			device->clock = (msb << 8) | lsb;
+		}
 
-		if (!vs10xx_io_wtready(id, 10)) {
+		if (!vs10xx_io_wtready(device->chip, 10)) {
 
-			vs10xx_err("id:%d timeout (reg=%x)", id, reg);
+			vs10xx_err("id:%d timeout (reg=%x)", device->id, reg);
 
 			status = -1;
 		}
@@ -81,7 +314,7 @@ static int vs10xx_device_w_sci_reg(int id, unsigned char reg, unsigned char msb,
 	return status;
 }
 
-static int vs10xx_device_r_sci_reg(int id, unsigned char reg, unsigned char* msb, unsigned char* lsb) {
+static int vs10xx_device_r_sci_reg(struct vs10xx_device_t *device, unsigned char reg, unsigned char* msb, unsigned char* lsb) {
 
 	int status = 0;
 
@@ -90,16 +323,49 @@ static int vs10xx_device_r_sci_reg(int id, unsigned char reg, unsigned char* msb
 
 	if (status == 0) {
 
-		status = vs10xx_io_ctrl_xf(id, cmd, sizeof(cmd), res, sizeof(res));
+		status = vs10xx_io_ctrl_xf(device->chip, cmd, sizeof(cmd), res, sizeof(res));
 
 		*msb = res[0];
 		*lsb = res[1];
 
-		vs10xx_nsy("id:%d %02X %02X%02X", id, (int)cmd[1], (int)res[0], (int)res[1]);
+		vs10xx_nsy("id:%d %02X %02X%02X", device->id, (int)cmd[1], (int)res[0], (int)res[1]);
+
+		if (!vs10xx_io_wtready(device->chip, 10)) {
+
+			vs10xx_err("id:%d timeout (reg=%x)", device->id, reg);
+			status = -1;
+		}
+	}
+
+	return status;
+}
+
+static int vs10xx_device_r_sci_regv(struct vs10xx_device_t *device, struct vs10xx_sciop *ops, int n) {
+
+	int i, status = 0;
+
+	unsigned char cmd[2 * VS10XX_SCI_MAXOPS];
+	unsigned char res[2 * VS10XX_SCI_MAXOPS];
+
+	if (status == 0) {
+
+		/* reads leave DREQ high, so they go out back-to-back in one message */
+		for (i = 0; i < n; i++) {
+			cmd[2*i] = 0x03;
+			cmd[2*i+1] = ops[i].reg & 0x0F;
+		}
+
+		status = vs10xx_io_ctrl_xfv(device->chip, cmd, 2, res, 2, n);
+
+		for (i = 0; i < n; i++) {
+			ops[i].msb = res[2*i];
+			ops[i].lsb = res[2*i+1];
+			vs10xx_nsy("id:%d %02X %02X%02X", device->id, (int)cmd[2*i+1], (int)res[2*i], (int)res[2*i+1]);
+		}
 
-		if (!vs10xx_io_wtready(id, 10)) {
+		if (!vs10xx_io_wtready(device->chip, 10)) {
 
-			vs10xx_err("id:%d timeout (reg=%x)", id, reg);
+			vs10xx_err("id:%d timeout (%d regs)", device->id, n);
 			status = -1;
 		}
 	}
@@ -112,11 +378,11 @@ static int vs10xx_device_r_sci_reg(int id, unsigned char reg, unsigned char* msb
 /* VS10XX DEVICE LOAD PLUGIN                                                                                                     */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
-static int vs10xx_device_plugin(int id, const unsigned short* vs10xx_plugin, int n) {
+static int vs10xx_device_plugin(struct vs10xx_device_t *device, const unsigned short* vs10xx_plugin, int n) {
 
 	int i = 0, status = 0;
 
-	vs10xx_dbg("start:%d", id);
+	vs10xx_dbg("start:%d", device->id);
 
 	if (vs10xx_plugin) {
 
@@ -131,21 +397,21 @@ static int vs10xx_device_plugin(int id, const unsigned short* vs10xx_plugin, int
 				val = vs10xx_plugin[i++];
 				while (status == 0 && m--) {
 					/* replicate m samples */
-					status = vs10xx_device_w_sci_reg(id, addr, (val >> 8) & 0x00ff, val & 0x00ff);
+					status = vs10xx_device_w_sci_reg(device, addr, (val >> 8) & 0x00ff, val & 0x00ff);
 				}
 			} else {
 				/* Copy run */
 				while (status == 0 && m--) {
 					 /* copy m samples */
 					val = vs10xx_plugin[i++];
-					status = vs10xx_device_w_sci_reg(id, addr, (val >> 8) & 0x00ff, val & 0x00ff);
+					status = vs10xx_device_w_sci_reg(device, addr, (val >> 8) & 0x00ff, val & 0x00ff);
 				}
 			}
 		}
 
 		if (i < n) {
 
-			vs10xx_err("id:%d plugin incomplete (%d/%d bytes)", id, i, n);
+			vs10xx_err("id:%d plugin incomplete (%d/%d bytes)", device->id, i, n);
 
 			status = -1;
 
@@ -153,18 +419,18 @@ static int vs10xx_device_plugin(int id, const unsigned short* vs10xx_plugin, int
 
 			if (status == 0) {
 
-				vs10xx_inf("id:%d plugin loaded (%d/%d bytes)", id, i, n);
+				vs10xx_inf("id:%d plugin loaded (%d/%d bytes)", device->id, i, n);
 
 			} else {
 
-				vs10xx_err("id:%d plugin failed", id);
+				vs10xx_err("id:%d plugin failed", device->id);
 			}
 
 		}
 
 	}
 
-	vs10xx_dbg("done:%d", id);
+	vs10xx_dbg("done:%d", device->id);
 
 	return status;
 }
@@ -173,697 +439,2719 @@ static int vs10xx_device_plugin(int id, const unsigned short* vs10xx_plugin, int
 /* VS10XX DEVICE RESET                                                                                                           */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
-static void vs10xx_device_hwreset(int id) {
+static void vs10xx_device_hwreset(struct vs10xx_device_t *device) {
 
-	vs10xx_dbg("start:%d", id);
+	vs10xx_dbg("start:%d", device->id);
 
-	vs10xx_io_reset(id);
+	vs10xx_io_reset(device->chip);
 
-	if (!vs10xx_io_wtready(id, 50)) {
+	if (!vs10xx_io_wtready(device->chip, 50)) {
 
-		vs10xx_wrn("id:%d timeout", id);
+		vs10xx_wrn("id:%d timeout", device->id);
 	}
 
-	vs10xx_dbg("done:%d", id);
+	vs10xx_dbg("done:%d", device->id);
 }
 
-static int vs10xx_device_swreset(int id, int testmode) {
+static int vs10xx_device_swreset(struct vs10xx_device_t *device, int testmode) {
 
 	int status = 0;
 
-	vs10xx_dbg("start:%d", id);
+	vs10xx_dbg("start:%d", device->id);
 
 	if (testmode) {
 
 		// WRITE MODE SM_SDINEW | SM_RESET | SM_TESTS
-		status = vs10xx_device_w_sci_reg(id, 0x00, 0x08, 0x24);
+		status = vs10xx_device_w_sci_reg(device, 0x00, 0x08, 0x24);
 
 	} else {
 
 		// WRITE MODE SM_SDINEW | !SM_RESET | SM_TESTS
-		status = vs10xx_device_w_sci_reg(id, 0x00, 0x08, 0x04);
+		status = vs10xx_device_w_sci_reg(device, 0x00, 0x08, 0x04);
 	}
 
 	if (status == 0 && clockf != 0) {
 
 		// WRITE CLOCKF
-		status = vs10xx_device_w_sci_reg(id, 0x03, (clockf & 0xff00) >> 8, (clockf & 0xff));
+		status = vs10xx_device_w_sci_reg(device, 0x03, (clockf & 0xff00) >> 8, (clockf & 0xff));
 	}
 
-	vs10xx_dbg("done:%d", id);
+	vs10xx_dbg("done:%d", device->id);
 
 	return status;
 }
 
 /* ----------------------------------------------------------------------------------------------------------------------------- */
-/* VS10XX DEVICE OPERATIONS                                                                                                      */
+/* VS10XX DEVICE STREAM END                                                                                                      */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
-int vs10xx_device_reset(int id) {
+static int vs10xx_device_r_fmt(struct vs10xx_device_t *device, vs10xx_fmt_t *fmt) {
 
 	int status = 0;
+	unsigned char msb=0, lsb=0;
 
-	vs10xx_dbg("start:%d", id);
-
-	mutex_lock(&vs10xx_device[id].lock);
+	status = vs10xx_device_r_sci_reg(device, 0x09, &msb, &lsb);
 
-	vs10xx_queue_flush(id);
+	if (msb==0x76 && lsb==0x65) *fmt = VS10XX_FMT_WAV;
+	else if (msb==0x41 && lsb==0x54) *fmt = VS10XX_FMT_AAC;
+	else if (msb==0x41 && lsb==0x44) *fmt = VS10XX_FMT_AAC;
+	else if (msb==0x4D && lsb==0x34) *fmt = VS10XX_FMT_AAC;
+	else if (msb==0x57 && lsb==0x4D) *fmt = VS10XX_FMT_WMA;
+	else if (msb==0x4D && lsb==0x54) *fmt = VS10XX_FMT_MID;
+	else if (msb==0x4F && lsb==0x67) *fmt = VS10XX_FMT_OGG;
+	else if (msb==0x66 && lsb==0x4C) *fmt = VS10XX_FMT_FLC;
+	else if (msb==0xFF && lsb>=0xE0) *fmt = VS10XX_FMT_MP3;
+	else *fmt = VS10XX_FMT_NUL;
 
-	vs10xx_device_hwreset(id);
+	return status;
+}
 
-	status = vs10xx_device_swreset(id, 0);
+static int vs10xx_device_r_endfill(struct vs10xx_device_t *device, unsigned char *endfill) {
 
-	if (status != 0) {
+	int status = 0;
+	unsigned char msb;
 
-		vs10xx_device_hwreset(id);
-		status = vs10xx_device_swreset(id, 0);
-	}
+	// READ PARAMETRIC endFillByte (X:0x1E06)
+	status = vs10xx_device_w_sci_reg(device, 0x07, 0x1e, 0x06);
 
 	if (status == 0) {
-
-		unsigned char msb, lsb;
-		status = vs10xx_device_r_sci_reg(id, 0x01, &msb, &lsb);
-		vs10xx_device[id].version = (lsb & 0xf0) >> 4;
+		status = vs10xx_device_r_sci_reg(device, 0x06, &msb, endfill);
 	}
 
-	if (status == 0) {
-
-		switch (vs10xx_device[id].version) {
-			case 4:
-				vs10xx_inf("id:%d found vs1053 device", id);
-				if (plugin) {
-					status = vs10xx_device_plugin(id, vs1053_plugin, sizeof(vs1053_plugin)/sizeof(vs1053_plugin[0]));
-				}
-				break;
-			case 6:
-				vs10xx_inf("id:%d found vs1063 device", id);
-				if (plugin) {
-					status = vs10xx_device_plugin(id, vs1063_plugin, sizeof(vs1063_plugin)/sizeof(vs1063_plugin[0]));
-				}
-				break;
-			default:
-				vs10xx_err("id:%d unsupported device (vrs=%d)", id, vs10xx_device[id].version);
-				status = -1;
-				break;
-		}
-	}
+	return status;
+}
 
-	if (status == 0) {
+static int vs10xx_device_r_param32(struct vs10xx_device_t *device, unsigned short addr, u32 *val, ktime_t *stamp) {
+/*
+ *  Descr:  Read a 32 bit parametric variable (VS1063), the high word is read
+ *          before and after the low word so that a carry in between is seen.
+ *          The time of the low word read goes to stamp, if not NULL.
+ *  Return: status
+ */
 
-		unsigned char buffer[2] = { 0, 0 };
-		status = vs10xx_io_data_tx(id, buffer, 2);
-	}
+	int status = 0, retry = 3;
+	unsigned char hi0[2] = {0, 0}, hi1[2] = {0, 0}, lo[2] = {0, 0};
 
-	mutex_unlock(&vs10xx_device[id].lock);
+	do {
+		status = vs10xx_device_w_sci_reg(device, 0x07, (addr + 1) >> 8, (addr + 1) & 0xff);
+		if (status == 0) status = vs10xx_device_r_sci_reg(device, 0x06, &hi0[0], &hi0[1]);
+		if (status == 0) status = vs10xx_device_w_sci_reg(device, 0x07, addr >> 8, addr & 0xff);
+		if (status == 0 && stamp != NULL) *stamp = ktime_get();
+		if (status == 0) status = vs10xx_device_r_sci_reg(device, 0x06, &lo[0], &lo[1]);
+		if (status == 0) status = vs10xx_device_r_sci_reg(device, 0x06, &hi1[0], &hi1[1]);
+	} while (status == 0 && memcmp(hi0, hi1, 2) != 0 && --retry > 0);
 
-	vs10xx_dbg("done:%d", id);
+	*val = (hi1[0] << 24) | (hi1[1] << 16) | (lo[0] << 8) | lo[1];
 
 	return status;
 }
 
-
-int vs10xx_device_sinetest(int id) {
+static int vs10xx_device_w_param32(struct vs10xx_device_t *device, unsigned short addr, u32 val) {
 
 	int status = 0;
 
-	vs10xx_inf("id:%d started sine test", id);
-
-	mutex_lock(&vs10xx_device[id].lock);
-
-	vs10xx_queue_flush(id);
-
-	vs10xx_device_hwreset(id);
-
-	status = vs10xx_device_swreset(id, 1);
-
-	if (status != 0) {
-
-		vs10xx_device_hwreset(id);
-		status = vs10xx_device_swreset(id, 1);
-	}
+	status = vs10xx_device_w_sci_reg(device, 0x07, addr >> 8, addr & 0xff);
 
 	if (status == 0) {
-
-		// SET VOLUME TO 75%
-		status = vs10xx_device_w_sci_reg(id, 0x0B, 64, 64);
+		status = vs10xx_device_w_sci_reg(device, 0x06, (val >> 8) & 0xff, val & 0xff);
 	}
 
 	if (status == 0) {
-
-		// GENERATE SINE
-		unsigned char test[] = {0x53, 0xef, 0x6e, 0xa3, 0x00, 0x00, 0x00, 0x00};
-		status = vs10xx_io_data_tx(id, test, sizeof(test));
+		status = vs10xx_device_w_sci_reg(device, 0x06, (val >> 24) & 0xff, (val >> 16) & 0xff);
 	}
 
-	mutex_unlock(&vs10xx_device[id].lock);
-
 	return status;
 }
 
+static int vs10xx_device_sendfill(struct vs10xx_device_t *device, unsigned char endfill, int n) {
 
-int vs10xx_device_memtest(int id) {
-
+	struct vs10xx_queue_buf_t buffer;
 	int status = 0;
-	unsigned char msb, lsb;
-
-	vs10xx_inf("id:%d started mem test", id);
-
-	mutex_lock(&vs10xx_device[id].lock);
-
-	vs10xx_queue_flush(id);
 
-	vs10xx_device_hwreset(id);
+	buffer.len = sizeof(buffer.data);
+	memset(buffer.data, endfill, buffer.len);
 
-	status = vs10xx_device_swreset(id, 1);
+	while (n-- > 0) {
 
-	if (status != 0) {
+		vs10xx_io_wtready(device->chip, 10);
 
-		vs10xx_device_hwreset(id);
-		status = vs10xx_device_swreset(id, 0);
+		status = vs10xx_io_data_tx(device->chip, buffer.data, buffer.len);
 	}
 
-	if (status == 0) {
+	return status;
+}
 
-		// TEST MEMORY
-		unsigned char test[] = {0x4d, 0xea, 0x6d, 0x54, 0x00, 0x00, 0x00, 0x00};
-		status = vs10xx_io_data_tx(id, test, sizeof(test));
-	}
+static int vs10xx_device_smcancel(struct vs10xx_device_t *device, unsigned char endfill) {
+/*
+ *  Descr:  Set SM_CANCEL and feed endfill bytes until the decoder acknowledges,
+ *          falls back to a software reset after 2048 bytes. Device lock held.
+ *  Return: status
+ */
 
-	if (status == 0) {
+	struct vs10xx_queue_buf_t buffer;
+	unsigned char msb = 0, lsb = 0;
+	int i, status = 0;
 
-		msleep(VS10XX_MSEC(1100000));
+	buffer.len = sizeof(buffer.data);
+	memset(buffer.data, endfill, buffer.len);
 
-		// READ HDAT0
-		status = vs10xx_device_r_sci_reg(id, 0x08, &msb, &lsb);
-		msb = msb & 0x83; /* bits 14:10 are unsued */
-	}
+	// set SM CANCEL
+	status = vs10xx_device_w_sci_reg(device, 0x00, 0x08, 0x08);
 
-	mutex_unlock(&vs10xx_device[id].lock);
+	// send endfillbytes awaiting cancel confimation
+	// bufsize = 32 => send 64 buffers
+	for (i = 0; i < 64; i++) {
 
-	if (status == 0) {
+		status = vs10xx_io_data_tx(device->chip, buffer.data, buffer.len);
 
-		vs10xx_inf("id:%d mem test complete - result:%02X%02X", id, (int)msb, (int)lsb);
-	}
+		vs10xx_io_wtready(device->chip, 10);
 
-	return status;
-}
+		status = vs10xx_device_r_sci_reg(device, 0x00, &msb, &lsb);
 
+		if ((lsb & 0x08) == 0) {
 
-int vs10xx_device_getscireg(int id, struct vs10xx_scireg *scireg) {
+			break;
+		}
+	}
 
-	int status = 0;
+	if ((lsb & 0x08) != 0) {
 
-	mutex_lock(&vs10xx_device[id].lock);
+		status = vs10xx_device_swreset(device, 0);
+		vs10xx_wrn("id:%d device did not cancel, swreset issued!", device->id);
 
-	status = vs10xx_device_r_sci_reg(id, scireg->reg & 0x0F, &scireg->msb, &scireg->lsb);
+	} else {
 
-	mutex_unlock(&vs10xx_device[id].lock);
+		vs10xx_dbg("id:%d cancelled after %d bytes", device->id, (i + 1) * buffer.len);
+	}
 
 	return status;
 }
 
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX DEVICE EVENTS                                                                                                          */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
 
-int vs10xx_device_setscireg(int id, struct vs10xx_scireg *scireg) {
-
-	int status = 0;
-
-	mutex_lock(&vs10xx_device[id].lock);
+static void vs10xx_device_setevent(struct vs10xx_device_t *device, unsigned int event) {
 
-	status = vs10xx_device_w_sci_reg(id, scireg->reg & 0x0F, scireg->msb, scireg->lsb);
+	unsigned long flags;
 
-	mutex_unlock(&vs10xx_device[id].lock);
+	spin_lock_irqsave(&device->evlock, flags);
+	device->events |= event;
+	spin_unlock_irqrestore(&device->evlock, flags);
 
-	return status;
+	wake_up_interruptible(&device->pollq);
 }
 
+int vs10xx_device_getevents(struct vs10xx_device_t *device, struct vs10xx_events *events) {
 
-int vs10xx_device_getclockf(int id, struct vs10xx_clockf *clkf) {
+	unsigned long flags;
 
-	int status = 0;
-	unsigned char msb, lsb;
+	spin_lock_irqsave(&device->evlock, flags);
+	events->mask = device->events;
+	device->events = 0;
+	spin_unlock_irqrestore(&device->evlock, flags);
 
-	mutex_lock(&vs10xx_device[id].lock);
-
-	status = vs10xx_device_r_sci_reg(id, 0x03, &msb, &lsb);
+	return 0;
+}
 
-	mutex_unlock(&vs10xx_device[id].lock);
+unsigned int vs10xx_device_poll(struct vs10xx_device_t *device, struct file *file, poll_table *wait) {
 
-	clkf->mul = (msb >> 5) & 0x07;
-	clkf->add = (msb >> 3) & 0x03;
-	clkf->clk = (msb & 0x07) << 8 | lsb;
+	unsigned int mask = 0;
 
-	return status;
-}
+	poll_wait(file, &device->pollq, wait);
 
+	if (!vs10xx_queue_isfull(device->queue)) {
+		mask |= POLLOUT | POLLWRNORM;
+	}
 
-int vs10xx_device_setclockf(int id, struct vs10xx_clockf *clkf) {
+	if (device->events) {
+		mask |= POLLPRI;
+	}
 
-	int status = 0;
-	unsigned char msb = ((clkf->mul & 0x07) << 5) | ((clkf->add & 0x03) << 3) | ((clkf->clk >> 8) & 0x07);
-	unsigned char lsb = clkf->clk & 0xff;
+	return mask;
+}
 
-	mutex_lock(&vs10xx_device[id].lock);
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX DEVICE STATUS PAGE                                                                                                     */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
 
-	status = vs10xx_device_w_sci_reg(id, 0x03, msb, lsb);
+/* mp3 bitrates [kbit/s] by version (0: mpeg1, 1: mpeg2/2.5), layer (0: I, 1: II, 2: III) and index */
+static const unsigned short vs10xx_device_mp3rate[2][3][16] = {
+	{
+		{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+		{ 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+		{ 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 0 },
+	}, {
+		{ 0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+		{ 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160, 0 },
+		{ 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160, 0 },
+	}
+};
 
-	mutex_unlock(&vs10xx_device[id].lock);
+static unsigned int vs10xx_device_bitrate(vs10xx_fmt_t fmt, unsigned int hdat0, unsigned int hdat1) {
+/*
+ *  Descr:  Bitrate from the stream header data
+ *  Return: bitrate [bit/s], 0 when unknown
+ */
 
-	return status;
-}
+	unsigned int version = (hdat1 >> 3) & 0x03;
+	unsigned int layer = (hdat1 >> 1) & 0x03;
 
+	switch (fmt) {
 
-int vs10xx_device_getvolume(int id, struct vs10xx_volume *volume) {
+		case VS10XX_FMT_MP3:
+			/* layer 0 is reserved */
+			return (layer ? vs10xx_device_mp3rate[version == 3 ? 0 : 1][3 - layer][hdat0 >> 12] * 1000 : 0);
 
-	int status = 0;
-	unsigned char msb, lsb;
+		case VS10XX_FMT_WAV:
+		case VS10XX_FMT_AAC:
+		case VS10XX_FMT_WMA:
+		case VS10XX_FMT_OGG:
+		case VS10XX_FMT_FLC:
+			/* hdat0 holds the byte rate */
+			return hdat0 * 8;
 
-	mutex_lock(&vs10xx_device[id].lock);
+		default:
+			return 0;
+	}
+}
 
-	status = vs10xx_device_r_sci_reg(id, 0x0B, &msb, &lsb);
+static void vs10xx_device_statuspage(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  Refresh the status page, the device thread is the only writer
+ *  Return: -
+ */
 
-	mutex_unlock(&vs10xx_device[id].lock);
+	struct vs10xx_status *page = device->page;
+	struct vs10xx_sciop ops[4] = {
+		{ VS10XX_SCI_READ, 0x04 }, { VS10XX_SCI_READ, 0x05 }, { VS10XX_SCI_READ, 0x08 }, { VS10XX_SCI_READ, 0x09 },
+	};
+	int status = -1;
 
-	volume->left = 255 - msb;
-	volume->rght = 255 - lsb;
+	device->pagenext = jiffies + msecs_to_jiffies(statusrate);
 
-	return status;
-}
+	if (ACCESS_ONCE(device->open) || ACCESS_ONCE(device->closing)) {
 
+		/* decoder registers only change while streaming */
+		vs10xx_device_take(device);
+		status = vs10xx_device_r_sci_regv(device, ops, 4);
+		vs10xx_device_give(device);
+	}
 
-int vs10xx_device_setvolume(int id, struct vs10xx_volume *volume) {
+	page->seq++;
+	smp_wmb();
 
-	int status = 0;
-	unsigned char msb = 255 - (volume->left & 0xff);
-	unsigned char lsb = 255 - (volume->rght & 0xff);
+	if (status == 0) {
 
-	mutex_lock(&vs10xx_device[id].lock);
+		page->decodetime = (ops[0].msb << 8) | ops[0].lsb;
 
-	status = vs10xx_device_w_sci_reg(id, 0x0B, msb, lsb);
+		if (page->decodetime != device->wdog.decodetime) {
+			device->wdog.decodetime = page->decodetime;
+			device->wdog.moved = jiffies;
+		}
+		page->samplerate = ((ops[1].msb << 8) | ops[1].lsb) & 0xFFFE;
+		page->channels = (ops[1].lsb & 0x01) + 1;
+		page->hdat0 = (ops[2].msb << 8) | ops[2].lsb;
+		page->hdat1 = (ops[3].msb << 8) | ops[3].lsb;
+
+		if (page->hdat1 == 0x7665) page->fmt = VS10XX_FMT_WAV;
+		else if (page->hdat1 == 0x4154 || page->hdat1 == 0x4144 || page->hdat1 == 0x4D34) page->fmt = VS10XX_FMT_AAC;
+		else if (page->hdat1 == 0x574D) page->fmt = VS10XX_FMT_WMA;
+		else if (page->hdat1 == 0x4D54) page->fmt = VS10XX_FMT_MID;
+		else if (page->hdat1 == 0x4F67) page->fmt = VS10XX_FMT_OGG;
+		else if (page->hdat1 == 0x664C) page->fmt = VS10XX_FMT_FLC;
+		else if (page->hdat1 >= 0xFFE0) page->fmt = VS10XX_FMT_MP3;
+		else page->fmt = VS10XX_FMT_NUL;
+
+		page->bitrate = vs10xx_device_bitrate(page->fmt, page->hdat0, page->hdat1);
+	}
 
-	mutex_unlock(&vs10xx_device[id].lock);
+	page->state = device->state;
+	page->level = vs10xx_queue_getlevel(device->queue);
+	page->underruns = device->underrun;
+	page->sent = device->sent;
 
-	return status;
+	smp_wmb();
+	page->seq++;
 }
 
+int vs10xx_device_mmap(struct vs10xx_device_t *device, struct vm_area_struct *vma) {
 
-int vs10xx_device_gettone(int id, struct vs10xx_tone *tone) {
+	unsigned long size = vma->vm_end - vma->vm_start;
 
-	int status = 0;
-	unsigned char msb, lsb;
+	if (vma->vm_pgoff != 0 || size > PAGE_SIZE || (vma->vm_flags & VM_WRITE)) {
+		return -EINVAL;
+	}
 
-	mutex_lock(&vs10xx_device[id].lock);
+	/* read-only, also for mprotect */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,3,0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
 
-	status = vs10xx_device_r_sci_reg(id, 0x02, &msb, &lsb);
+	return remap_pfn_range(vma, vma->vm_start, virt_to_phys(device->page) >> PAGE_SHIFT, size, vma->vm_page_prot);
+}
 
-	mutex_unlock(&vs10xx_device[id].lock);
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX DEVICE OUTPUT DELAY                                                                                                    */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
 
-	tone->trebboost = (msb >> 4) & 0x0f;
-	tone->treblimit = msb & 0x0f;
-	tone->bassboost = (lsb >> 4) & 0x0f;
-	tone->basslimit = lsb & 0x0f;
+static unsigned int vs10xx_device_fifofill(struct vs10xx_device_fifo_t *fifo, ktime_t now) {
+/*
+ *  Descr:  Stream buffer fill at now, draining from stamp at the measured rate
+ *  Return: estimated fill [bytes]
+ */
 
-	return status;
+	s64 usec = ktime_us_delta(now, fifo->stamp);
+	u64 used = (usec > 0 ? div_u64((u64)fifo->rate * usec, 1000000) : 0);
+
+	return (used < fifo->fill ? fifo->fill - (unsigned int)used : 0);
 }
 
+static void vs10xx_device_fifo(struct vs10xx_device_t *device, unsigned int sent) {
+/*
+ *  Descr:  Update the stream buffer model after a burst of sent bytes. A burst that
+ *          ends with DREQ low left the buffer full, so everything sent since the
+ *          previous full point was consumed in between: that gives the rate.
+ *  Return: -
+ */
 
-int vs10xx_device_settone(int id, struct vs10xx_tone *tone) {
+	struct vs10xx_device_fifo_t *fifo = &device->fifo;
+	ktime_t now = ktime_get();
+	unsigned long flags;
+	unsigned int sample;
+	int event = 0;
+	s64 usec;
 
-	int status = 0;
-	unsigned char msb = ((tone->trebboost & 0x0f) << 4) | (tone->treblimit & 0x0f);
-	unsigned char lsb = ((tone->bassboost & 0x0f) << 4) | (tone->basslimit & 0x0f);
+	spin_lock_irqsave(&device->evlock, flags);
 
-	mutex_lock(&vs10xx_device[id].lock);
+	fifo->since += sent;
 
-	status = vs10xx_device_w_sci_reg(id, 0x02, msb, lsb);
+	if (!vs10xx_io_isready(device->chip)) {
 
-	mutex_unlock(&vs10xx_device[id].lock);
+		usec = ktime_us_delta(now, fifo->full);
 
-	return status;
-}
+		if (fifo->fullvalid && usec > 1000 && usec < 10000000) {
 
-int vs10xx_device_getinfo(int id, struct vs10xx_info *info) {
+			/* moving average, 1/8 weight per sample */
+			sample = (unsigned int)div_u64((u64)fifo->since * 1000000, usec);
+			fifo->rate = (fifo->rate ? fifo->rate - fifo->rate / 8 + sample / 8 : sample);
 
-	int status = 0;
-	unsigned char msb=0, lsb=0;
+			if (fifo->rate > fifo->told + fifo->told / 16 || fifo->rate < fifo->told - fifo->told / 16) {
+				fifo->told = fifo->rate;
+				event = 1;
+			}
+		}
+
+		fifo->fill = VS10XX_DEVICE_FIFO;
+		fifo->full = now;
+		fifo->fullvalid = 1;
+		fifo->since = 0;
 
-	mutex_lock(&vs10xx_device[id].lock);
+	} else {
 
-	status = vs10xx_device_r_sci_reg(id, 0x09, &msb, &lsb);
+		fifo->fill = MIN(vs10xx_device_fifofill(fifo, now) + sent, VS10XX_DEVICE_FIFO);
+	}
 
-	mutex_unlock(&vs10xx_device[id].lock);
+	fifo->stamp = now;
 
-	if (msb==0x76 && lsb==0x65) info->fmt = VS10XX_FMT_WAV;
-	else if (msb==0x41 && lsb==0x54) info->fmt = VS10XX_FMT_AAC;
-	else if (msb==0x41 && lsb==0x44) info->fmt = VS10XX_FMT_AAC;
-	else if (msb==0x4D && lsb==0x34) info->fmt = VS10XX_FMT_AAC;
-	else if (msb==0x57 && lsb==0x4D) info->fmt = VS10XX_FMT_WMA;
-	else if (msb==0x4D && lsb==0x54) info->fmt = VS10XX_FMT_MID;
-	else if (msb==0x4F && lsb==0x67) info->fmt = VS10XX_FMT_OGG;
-	else if (msb==0x66 && lsb==0x4C) info->fmt = VS10XX_FMT_FLC;
-	else if (msb==0xFF && lsb>=0xE0) info->fmt = VS10XX_FMT_MP3;
-	else info->fmt = VS10XX_FMT_NUL;
+	spin_unlock_irqrestore(&device->evlock, flags);
 
-	return status;
+	if (event) {
+		vs10xx_device_setevent(device, VS10XX_EVT_RATE);
+	}
 }
 
-/* ----------------------------------------------------------------------------------------------------------------------------- */
-/* VS10XX DEVICE THREAD                                                                                                          */
-/* ----------------------------------------------------------------------------------------------------------------------------- */
+static void vs10xx_device_fiforeset(struct vs10xx_device_t *device, int empty) {
+/*
+ *  Descr:  Stop timing the stream buffer, on pause or when it was emptied
+ *  Return: -
+ */
 
-static inline void vs10xx_device_setopen(int id) {
+	unsigned long flags;
 
-	mutex_lock(&vs10xx_device[id].lock);
-	vs10xx_device[id].open = 1;
-	mutex_unlock(&vs10xx_device[id].lock);
-}
+	spin_lock_irqsave(&device->evlock, flags);
 
-static inline void vs10xx_device_clropen(int id) {
+	device->fifo.fullvalid = 0;
 
-	mutex_lock(&vs10xx_device[id].lock);
-	vs10xx_device[id].open = 0;
-	mutex_unlock(&vs10xx_device[id].lock);
+	if (empty) {
+		device->fifo.fill = 0;
+		device->fifo.stamp = ktime_get();
+	}
 
-	wake_up(&vs10xx_device[id].wq);
+	spin_unlock_irqrestore(&device->evlock, flags);
 }
 
-static inline int vs10xx_device_getopen(int id) {
-
-	return vs10xx_device[id].open;
-}
+static unsigned int vs10xx_device_fifolevel(struct vs10xx_device_t *device, unsigned int *rate) {
+/*
+ *  Descr:  Current stream buffer estimate and the rate it drains at
+ *  Return: estimated fill [bytes], rate 0 when unknown
+ */
 
-static inline void vs10xx_device_setpause(int id) {
+	struct vs10xx_device_fifo_t *fifo = &device->fifo;
+	unsigned long flags;
+	unsigned int fill;
 
-	mutex_lock(&vs10xx_device[id].lock);
-	vs10xx_device[id].start = 0;
-	mutex_unlock(&vs10xx_device[id].lock);
-}
+	spin_lock_irqsave(&device->evlock, flags);
+	fill = vs10xx_device_fifofill(fifo, ktime_get());
+	*rate = fifo->rate;
+	spin_unlock_irqrestore(&device->evlock, flags);
 
-static inline void vs10xx_device_clrpause(int id) {
+	if (*rate == 0 && device->page != NULL) {
 
-	mutex_lock(&vs10xx_device[id].lock);
-	vs10xx_device[id].start = 1;
-	mutex_unlock(&vs10xx_device[id].lock);
+		/* nothing measured yet, use the stream header */
+		*rate = device->page->bitrate / 8;
+	}
 
-	wake_up(&vs10xx_device[id].wq);
+	return fill;
 }
 
-static inline int vs10xx_device_getpause(int id) {
+int vs10xx_device_getdelay(struct vs10xx_device_t *device, struct vs10xx_delay *delay) {
 
-	return (vs10xx_device[id].start ? 0 : 1);
-}
+	unsigned int fill = vs10xx_device_fifolevel(device, &delay->rate);
 
-static inline void vs10xx_device_setfinish(int id) {
+	delay->bytes = vs10xx_queue_getbytes(device->queue) + fill;
+	delay->usec = (delay->rate ? (unsigned int)div_u64((u64)delay->bytes * 1000000, delay->rate) : 0);
 
-	mutex_lock(&vs10xx_device[id].lock);
-	vs10xx_device[id].finish = 1;
-	mutex_unlock(&vs10xx_device[id].lock);
+	return 0;
 }
 
-static inline void vs10xx_device_clrfinish(int id) {
-
-	mutex_lock(&vs10xx_device[id].lock);
-	vs10xx_device[id].finish = 0;
-	mutex_unlock(&vs10xx_device[id].lock);
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX DEVICE OPERATIONS                                                                                                      */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
 
-	wake_up(&vs10xx_device[id].wq);
-}
+static int vs10xx_device_boot(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  Reset the chip and load the plugin, device lock held
+ *  Return: status
+ */
 
-static inline int vs10xx_device_getfinish(int id) {
+	int status = 0;
 
-	return vs10xx_device[id].finish;
-}
+	vs10xx_device_hwreset(device);
 
+	status = vs10xx_device_swreset(device, 0);
 
-static int vs10xx_device_kthread(void *arg) {
+	if (status != 0) {
 
-	struct vs10xx_device_t *device = (struct vs10xx_device_t*)arg;
+		vs10xx_device_hwreset(device);
+		status = vs10xx_device_swreset(device, 0);
+	}
 
-	do {
+	if (status == 0) {
+
+		unsigned char msb, lsb;
+		status = vs10xx_device_r_sci_reg(device, 0x01, &msb, &lsb);
+		device->version = (lsb & 0xf0) >> 4;
+	}
+
+	if (status == 0) {
+
+		switch (device->version) {
+			case 4:
+				vs10xx_inf("id:%d found vs1053 device", device->id);
+				if (plugin) {
+					status = vs10xx_device_plugin(device, vs1053_plugin, sizeof(vs1053_plugin)/sizeof(vs1053_plugin[0]));
+				}
+				break;
+			case 6:
+				vs10xx_inf("id:%d found vs1063 device", device->id);
+				if (plugin) {
+					status = vs10xx_device_plugin(device, vs1063_plugin, sizeof(vs1063_plugin)/sizeof(vs1063_plugin[0]));
+				}
+				break;
+			default:
+				vs10xx_err("id:%d unsupported device (vrs=%d)", device->id, device->version);
+				status = -1;
+				break;
+		}
+	}
+
+	if (status == 0) {
+
+		/* endfill byte is needed at the end of every stream */
+		status = vs10xx_device_r_endfill(device, &device->endfill);
+	}
+
+	if (status == 0) {
+
+		unsigned char buffer[2] = { 0, 0 };
+		status = vs10xx_io_data_tx(device->chip, buffer, 2);
+	}
+
+	return status;
+}
+
+int vs10xx_device_reset(struct vs10xx_device_t *device) {
+
+	int status = 0;
+
+	vs10xx_dbg("start:%d", device->id);
+
+	vs10xx_device_lock(device);
+
+	vs10xx_queue_flush(device->queue);
+
+	/* SCI_VOL and SCI_BASS return to their defaults */
+	device->ramp.active = 0;
+	device->volume.left = 255;
+	device->volume.rght = 255;
+	device->bass = 0;
+
+	status = vs10xx_device_boot(device);
+
+	device->written = 0;
+
+	vs10xx_device_wdogkick(device);
+
+	vs10xx_device_unlock(device);
+
+	vs10xx_dbg("done:%d", device->id);
+
+	return status;
+}
+
+
+int vs10xx_device_sinetest(struct vs10xx_device_t *device) {
+
+	int status = 0;
+
+	vs10xx_inf("id:%d started sine test", device->id);
+
+	vs10xx_device_lock(device);
+
+	vs10xx_queue_flush(device->queue);
+
+	vs10xx_device_hwreset(device);
+
+	status = vs10xx_device_swreset(device, 1);
+
+	if (status != 0) {
+
+		vs10xx_device_hwreset(device);
+		status = vs10xx_device_swreset(device, 1);
+	}
+
+	if (status == 0) {
+
+		// SET VOLUME TO 75%
+		status = vs10xx_device_w_sci_reg(device, 0x0B, 64, 64);
+	}
+
+	if (status == 0) {
+
+		// GENERATE SINE
+		unsigned char test[] = {0x53, 0xef, 0x6e, 0xa3, 0x00, 0x00, 0x00, 0x00};
+		status = vs10xx_io_data_tx(device->chip, test, sizeof(test));
+	}
+
+	vs10xx_device_wdogkick(device);
+
+	vs10xx_device_unlock(device);
+
+	return status;
+}
+
+
+int vs10xx_device_memtest(struct vs10xx_device_t *device) {
+
+	int status = 0;
+	unsigned char msb, lsb;
+
+	vs10xx_inf("id:%d started mem test", device->id);
+
+	vs10xx_device_lock(device);
+
+	vs10xx_queue_flush(device->queue);
+
+	vs10xx_device_hwreset(device);
+
+	status = vs10xx_device_swreset(device, 1);
+
+	if (status != 0) {
+
+		vs10xx_device_hwreset(device);
+		status = vs10xx_device_swreset(device, 0);
+	}
+
+	if (status == 0) {
+
+		// TEST MEMORY
+		unsigned char test[] = {0x4d, 0xea, 0x6d, 0x54, 0x00, 0x00, 0x00, 0x00};
+		status = vs10xx_io_data_tx(device->chip, test, sizeof(test));
+	}
+
+	if (status == 0) {
+
+		msleep(VS10XX_MSEC(1100000));
+
+		// READ HDAT0
+		status = vs10xx_device_r_sci_reg(device, 0x08, &msb, &lsb);
+		msb = msb & 0x83; /* bits 14:10 are unsued */
+	}
+
+	vs10xx_device_wdogkick(device);
+
+	vs10xx_device_unlock(device);
+
+	if (status == 0) {
+
+		vs10xx_inf("id:%d mem test complete - result:%02X%02X", device->id, (int)msb, (int)lsb);
+	}
+
+	return status;
+}
+
+
+int vs10xx_device_getscireg(struct vs10xx_device_t *device, struct vs10xx_scireg *scireg) {
+
+	int status = 0;
+
+	vs10xx_device_lock(device);
+
+	status = vs10xx_device_r_sci_reg(device, scireg->reg & 0x0F, &scireg->msb, &scireg->lsb);
+
+	vs10xx_device_unlock(device);
+
+	return status;
+}
+
+
+int vs10xx_device_setscireg(struct vs10xx_device_t *device, struct vs10xx_scireg *scireg) {
+
+	int status = 0;
+
+	vs10xx_device_lock(device);
+
+	status = vs10xx_device_w_sci_reg(device, scireg->reg & 0x0F, scireg->msb, scireg->lsb);
+
+	vs10xx_device_unlock(device);
+
+	return status;
+}
+
+
+int vs10xx_device_scibatch(struct vs10xx_device_t *device, struct vs10xx_scibatch *scibatch) {
+
+	int i = 0, n, status = 0;
+	struct vs10xx_sciop *ops = scibatch->ops;
+
+	if (scibatch->count == 0 || scibatch->count > VS10XX_SCI_MAXOPS) {
+
+		return -EINVAL;
+	}
+
+	vs10xx_device_lock(device);
+
+	while (status == 0 && i < scibatch->count) {
+
+		if (ops[i].op == VS10XX_SCI_WRITE) {
+
+			/* writes pull DREQ low, issue them one by one */
+			status = vs10xx_device_w_sci_reg(device, ops[i].reg & 0x0F, ops[i].msb, ops[i].lsb);
+			i++;
+
+		} else {
+
+			/* collect a run of reads */
+			for (n = 1; i + n < scibatch->count && ops[i + n].op != VS10XX_SCI_WRITE; n++);
+
+			status = vs10xx_device_r_sci_regv(device, &ops[i], n);
+			i += n;
+		}
+	}
+
+	vs10xx_device_unlock(device);
+
+	return status;
+}
+
+
+int vs10xx_device_getclockf(struct vs10xx_device_t *device, struct vs10xx_clockf *clkf) {
+
+	int status = 0;
+	unsigned char msb, lsb;
+
+	vs10xx_device_lock(device);
+
+	status = vs10xx_device_r_sci_reg(device, 0x03, &msb, &lsb);
+
+	vs10xx_device_unlock(device);
+
+	clkf->mul = (msb >> 5) & 0x07;
+	clkf->add = (msb >> 3) & 0x03;
+	clkf->clk = (msb & 0x07) << 8 | lsb;
+
+	return status;
+}
+
+
+int vs10xx_device_setclockf(struct vs10xx_device_t *device, struct vs10xx_clockf *clkf) {
+
+	int status = 0;
+	unsigned char msb = ((clkf->mul & 0x07) << 5) | ((clkf->add & 0x03) << 3) | ((clkf->clk >> 8) & 0x07);
+	unsigned char lsb = clkf->clk & 0xff;
+
+	vs10xx_device_lock(device);
+
+	status = vs10xx_device_w_sci_reg(device, 0x03, msb, lsb);
+
+	vs10xx_device_unlock(device);
+
+	return status;
+}
+
+
+int vs10xx_device_getvolume(struct vs10xx_device_t *device, struct vs10xx_volume *volume) {
+
+	int status = 0;
+	unsigned char msb, lsb;
+
+	vs10xx_device_lock(device);
+
+	status = vs10xx_device_r_sci_reg(device, 0x0B, &msb, &lsb);
+
+	vs10xx_device_unlock(device);
+
+	volume->left = 255 - msb;
+	volume->rght = 255 - lsb;
+
+	return status;
+}
+
+
+int vs10xx_device_setvolume(struct vs10xx_device_t *device, struct vs10xx_volume *volume) {
+
+	int status = 0;
+	unsigned char msb = 255 - (volume->left & 0xff);
+	unsigned char lsb = 255 - (volume->rght & 0xff);
+
+	vs10xx_device_lock(device);
+
+	device->ramp.active = 0;
+
+	status = vs10xx_device_w_sci_reg(device, 0x0B, msb, lsb);
+
+	vs10xx_device_unlock(device);
+
+	return status;
+}
+
+
+int vs10xx_device_setramp(struct vs10xx_device_t *device, struct vs10xx_ramp *ramp) {
+
+	struct vs10xx_device_ramp_t *r = &device->ramp;
+	struct vs10xx_volume volume;
+	int status = 0;
+
+	if (ramp->msec == 0) {
+
+		volume.left = ramp->left;
+		volume.rght = ramp->rght;
+		status = vs10xx_device_setvolume(device, &volume);
+
+		if (status == 0) {
+			vs10xx_device_setevent(device, VS10XX_EVT_RAMP);
+		}
+
+		return status;
+	}
+
+	vs10xx_device_lock(device);
+
+	/* start from the current level, also when a ramp is in progress */
+	r->from = device->volume;
+	r->to.left = ramp->left & 0xff;
+	r->to.rght = ramp->rght & 0xff;
+	r->msec = ramp->msec;
+	r->curve = ramp->curve;
+	r->start = jiffies;
+	r->next = jiffies;
+	r->active = 1;
+
+	vs10xx_device_unlock(device);
+
+	wake_up(&device->wq);
+
+	vs10xx_dbg("id:%d ramp %u/%u -> %u/%u in %u ms", device->id, r->from.left, r->from.rght, r->to.left, r->to.rght, r->msec);
+
+	return status;
+}
+
+
+int vs10xx_device_gettone(struct vs10xx_device_t *device, struct vs10xx_tone *tone) {
+
+	int status = 0;
+	unsigned char msb, lsb;
+
+	vs10xx_device_lock(device);
+
+	status = vs10xx_device_r_sci_reg(device, 0x02, &msb, &lsb);
+
+	vs10xx_device_unlock(device);
+
+	tone->trebboost = (msb >> 4) & 0x0f;
+	tone->treblimit = msb & 0x0f;
+	tone->bassboost = (lsb >> 4) & 0x0f;
+	tone->basslimit = lsb & 0x0f;
+
+	return status;
+}
+
+
+int vs10xx_device_settone(struct vs10xx_device_t *device, struct vs10xx_tone *tone) {
+
+	int status = 0;
+	unsigned char msb = ((tone->trebboost & 0x0f) << 4) | (tone->treblimit & 0x0f);
+	unsigned char lsb = ((tone->bassboost & 0x0f) << 4) | (tone->basslimit & 0x0f);
+
+	vs10xx_device_lock(device);
+
+	status = vs10xx_device_w_sci_reg(device, 0x02, msb, lsb);
+
+	vs10xx_device_unlock(device);
+
+	return status;
+}
+
+int vs10xx_device_getinfo(struct vs10xx_device_t *device, struct vs10xx_info *info) {
+
+	int status = 0;
+
+	vs10xx_device_lock(device);
+
+	status = vs10xx_device_r_fmt(device, &info->fmt);
+
+	vs10xx_device_unlock(device);
+
+	return status;
+}
+
+
+static inline int vs10xx_device_members(struct vs10xx_device_t *device, struct vs10xx_device_t **members) {
+/*
+ *  Descr:  Devices that stream control of device applies to, in id order
+ *  Return: number of devices in members
+ */
+
+	int n = ACCESS_ONCE(device->fanout);
+
+	if (n == 0) {
+		members[0] = device;
+		return 1;
+	}
+
+	memcpy(members, device->fanto, n * sizeof(*members));
+
+	return n;
+}
+
+int vs10xx_device_flush(struct vs10xx_device_t *device) {
+
+	struct vs10xx_device_t *members[VS10XX_MAX_MEMBERS];
+	int m, n = vs10xx_device_members(device, members);
+
+	for (m = 0; m < n; m++) {
+
+		vs10xx_device_lock(members[m]);
+
+		/* drop queued data, the decoder plays what it already has */
+		vs10xx_queue_flush(members[m]->queue);
+		WRITE_ONCE(members[m]->start, 0);
+
+		vs10xx_device_unlock(members[m]);
+	}
+
+	return 0;
+}
+
+
+static int vs10xx_device_abort(struct vs10xx_device_t *device, int seek) {
+
+	int status = 0;
+	vs10xx_fmt_t fmt = VS10XX_FMT_NUL;
+
+	vs10xx_device_lock(device);
+
+	vs10xx_queue_flush(device->queue);
+	WRITE_ONCE(device->start, 0);
+	WRITE_ONCE(device->finish, 0);
+	device->dry = 0;
+
+	status = vs10xx_device_r_fmt(device, &fmt);
+
+	if (status == 0 && seek && (fmt == VS10XX_FMT_MP3 || fmt == VS10XX_FMT_NUL)) {
+
+		/* mp3 resynchronizes on the next frame header, no need to cancel */
+		vs10xx_dbg("id:%d seek in stream", device->id);
+
+	} else {
+
+		device->written = 0;
+
+		if (status == 0) {
+			status = vs10xx_device_smcancel(device, device->endfill);
+		}
+
+		vs10xx_device_fiforeset(device, 1);
+
+		if (status == 0) {
+
+			// CLEAR DECODE TIME (written twice as per datasheet)
+			status = vs10xx_device_w_sci_reg(device, 0x04, 0x00, 0x00);
+			status = vs10xx_device_w_sci_reg(device, 0x04, 0x00, 0x00);
+		}
+	}
+
+	vs10xx_device_wdogkick(device);
+
+	vs10xx_device_unlock(device);
+
+	return status;
+}
+
+static int vs10xx_device_abortall(struct vs10xx_device_t *device, int seek) {
+
+	struct vs10xx_device_t *members[VS10XX_MAX_MEMBERS];
+	int m, n = vs10xx_device_members(device, members), status = 0;
+
+	for (m = 0; m < n; m++) {
+		if (vs10xx_device_abort(members[m], seek) < 0) {
+			status = -1;
+		}
+	}
+
+	return status;
+}
+
+int vs10xx_device_cancel(struct vs10xx_device_t *device) {
+
+	vs10xx_dbg("id:%d", device->id);
+
+	return vs10xx_device_abortall(device, 0);
+}
+
+int vs10xx_device_seek(struct vs10xx_device_t *device) {
+
+	vs10xx_dbg("id:%d", device->id);
+
+	return vs10xx_device_abortall(device, 1);
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX DEVICE THREAD                                                                                                          */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static inline void vs10xx_device_setopen(struct vs10xx_device_t *device) {
+
+	mutex_lock(&device->lock);
+	WRITE_ONCE(device->open, 1);
+	mutex_unlock(&device->lock);
+}
+
+static inline void vs10xx_device_clropen(struct vs10xx_device_t *device) {
+
+	mutex_lock(&device->lock);
+	WRITE_ONCE(device->open, 0);
+	mutex_unlock(&device->lock);
+
+	wake_up(&device->wq);
+}
+
+static inline int vs10xx_device_getopen(struct vs10xx_device_t *device) {
+
+	return ACCESS_ONCE(device->open);
+}
+
+static inline void vs10xx_device_setpause(struct vs10xx_device_t *device) {
+
+	mutex_lock(&device->lock);
+	WRITE_ONCE(device->start, 0);
+	mutex_unlock(&device->lock);
+}
+
+static inline void vs10xx_device_clrpause(struct vs10xx_device_t *device) {
+
+	mutex_lock(&device->lock);
+	WRITE_ONCE(device->start, 1);
+	mutex_unlock(&device->lock);
+
+	wake_up(&device->wq);
+}
+
+static inline int vs10xx_device_getpause(struct vs10xx_device_t *device) {
+
+	return (ACCESS_ONCE(device->start) ? 0 : 1);
+}
+
+static inline void vs10xx_device_setfinish(struct vs10xx_device_t *device) {
+
+	mutex_lock(&device->lock);
+	WRITE_ONCE(device->finish, 1);
+	mutex_unlock(&device->lock);
+}
+
+static inline void vs10xx_device_clrfinish(struct vs10xx_device_t *device) {
+
+	mutex_lock(&device->lock);
+	WRITE_ONCE(device->finish, 0);
+	mutex_unlock(&device->lock);
+
+	wake_up(&device->wq);
+}
+
+static inline int vs10xx_device_getfinish(struct vs10xx_device_t *device) {
+
+	return ACCESS_ONCE(device->finish);
+}
+
+
+static void vs10xx_device_ramp(struct vs10xx_device_t *device) {
+
+	struct vs10xx_device_ramp_t *r = &device->ramp;
+	unsigned int elapsed, pos;
+	int left, rght, done = 0;
+
+	vs10xx_device_take(device);
+
+	if (r->active && time_after_eq(jiffies, r->next)) {
+
+		/* position on the ramp, 0..1024, in 64 bit as elapsed * 1024 wraps after 70 minutes */
+		elapsed = jiffies_to_msecs(jiffies - r->start);
+		pos = (elapsed >= r->msec) ? 1024 : (unsigned int)div_u64((u64)elapsed * 1024, r->msec);
+
+		if (r->curve == VS10XX_RAMP_SCURVE) {
+			/* smoothstep: 3p^2 - 2p^3 */
+			pos = (((pos * pos) >> 10) * (3 * 1024 - 2 * pos)) >> 10;
+		}
+
+		/* the volume register is in 0.5 dB steps, so this is linear in dB */
+		left = (int)r->from.left + ((((int)r->to.left - (int)r->from.left) * (int)pos) / 1024);
+		rght = (int)r->from.rght + ((((int)r->to.rght - (int)r->from.rght) * (int)pos) / 1024);
+
+		if (left != device->volume.left || rght != device->volume.rght) {
+			vs10xx_device_w_sci_reg(device, 0x0B, 255 - left, 255 - rght);
+		}
+
+		if (elapsed >= r->msec) {
+			r->active = 0;
+			done = 1;
+		}
+
+		r->next = jiffies + msecs_to_jiffies(rampstep);
+	}
+
+	vs10xx_device_give(device);
+
+	if (done) {
+
+		vs10xx_dbg("id:%d ramp done", device->id);
+		vs10xx_device_setevent(device, VS10XX_EVT_RAMP);
+	}
+}
+
+static void vs10xx_device_endstream(struct vs10xx_device_t *device) {
+
+	vs10xx_fmt_t fmt = VS10XX_FMT_NUL;
+	int i;
+
+	if (!vs10xx_queue_isempty(device->queue)) {
+
+		vs10xx_dbg("id:%d queue not empty, closing anyway", device->id);
+	}
+
+	vs10xx_device_take(device);
+	vs10xx_queue_flush(device->queue);
+	vs10xx_queue_unshare(device->queue);
+	device->writer = device;
+	WRITE_ONCE(device->start, 0);
+	vs10xx_device_give(device);
+
+	vs10xx_io_wtready(device->chip, 250);
+
+	vs10xx_device_take(device);
+
+	vs10xx_device_r_fmt(device, &fmt);
+
+	// send endfillbytes to end file
+	// bufsize = 32 => send 384 (FLAC) of 65 (other) buffers
+	for (i = (fmt==VS10XX_FMT_FLC?384:65); i > 0; i--) {
+
+		vs10xx_device_yield(device);
+		vs10xx_device_sendfill(device, device->endfill, 1);
+	}
+
+	vs10xx_device_smcancel(device, device->endfill);
+
+	device->written = 0;
+	WRITE_ONCE(device->finish, 0);
+	WRITE_ONCE(device->closing, 0);
+
+	vs10xx_device_give(device);
+
+	vs10xx_dbg("id:%d stream closed", device->id);
+
+	/* a pending open may proceed */
+	wake_up(&device->wq);
+}
+
+static inline void vs10xx_device_setstate(struct vs10xx_device_t *device, int state) {
+
+	if (device->state != state) {
+
+		device->state = state;
+		trace_vs10xx_pump_state(device->id, state, vs10xx_queue_getlevel(device->queue));
+
+		if (state != VS10XX_PUMP_SENDING && state != VS10XX_PUMP_WAITING) {
+
+			/* the decoder drains while we stand still, rate samples would be off */
+			vs10xx_device_fiforeset(device, state == VS10XX_PUMP_CLOSING);
+		}
+	}
+}
+
+static void vs10xx_device_starve(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  The queue ran dry while playing, the decoder only underruns once DREQ
+ *          is high and the stream buffer estimate is used up. Counted once per
+ *          dry spell, data arriving in time is no underrun. Nothing is counted
+ *          while the rate is unknown.
+ *  Return: -
+ */
+
+	unsigned int rate;
+	unsigned int fill = vs10xx_device_fifolevel(device, &rate);
+
+	if (rate == 0) {
+
+		/* no rate measured nor in the header yet: stay dry and look again next pass */
+		return;
+	}
+
+	if (vs10xx_io_isready(device->chip) && fill == 0) {
+
+		device->dry = 0;
+		device->underrun++;
+		vs10xx_device_setstate(device, VS10XX_PUMP_UNDERRUN);
+
+		if (device->rebufevt) {
+			vs10xx_device_setevent(device, VS10XX_EVT_UNDERRUN);
+		}
+	}
+}
+
+static void vs10xx_device_faulted(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  A transfer failed or dreq timed out with data queued, start timing the recovery
+ *  Return: -
+ */
+
+	unsigned int rate;
+	unsigned int fill;
+
+	if (!device->fault.active) {
+
+		fill = vs10xx_device_fifolevel(device, &rate);
+
+		device->fault.active = 1;
+		device->fault.start = ktime_get();
+		device->fault.usec = (rate ? (s64)div_u64((u64)fill * 1000000, rate) : 0);
+
+		vs10xx_stats_inc(device->stats, faults);
+	}
+}
+
+static void vs10xx_device_recovered(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  First good sdi transfer after a fault, the decoder went silent for whatever
+ *          part of the fault its stream buffer could not cover
+ *  Return: -
+ */
+
+	s64 usec;
+
+	if (device->fault.active) {
+
+		usec = ktime_us_delta(ktime_get(), device->fault.start);
+
+		vs10xx_stats_latency(device->stats, VS10XX_LAT_RECOV, device->fault.start);
+
+		if (usec > device->fault.usec) {
+			vs10xx_stats_add(device->stats, silent_us, usec - device->fault.usec);
+		}
+
+		vs10xx_dbg("id:%d recovered after %lld us", device->id, (long long)usec);
+
+		device->fault.active = 0;
+	}
+}
+
+static int vs10xx_device_senderr(struct vs10xx_device_t *device, struct vs10xx_queue_buf_t *buffer) {
+/*
+ *  Descr:  A chunk failed to go out, retry it up to spiretry times and then drop it
+ *          so that a broken transfer cannot stall the stream forever
+ *  Return: 1 --> chunk dropped
+ *          0 --> retry
+ */
+
+	vs10xx_device_faulted(device);
+
+	if (++device->fault.retries <= spiretry) {
+		return 0;
+	}
+
+	vs10xx_wrn("id:%d dropped %d bytes after %d retries", device->id, (int)buffer->len, spiretry);
+
+	vs10xx_stats_inc(device->stats, drops);
+	vs10xx_stats_add(device->stats, drop_bytes, buffer->len);
+
+	device->fault.retries = 0;
+
+	return 1;
+}
+
+static const char *vs10xx_device_stalled(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  Check for a decoder that stopped taking data (DREQ stuck low) or stopped
+ *          decoding it (SCI_DECODE_TIME frozen) while the pump has data to send.
+ *          Decode time counts whole seconds, so it gets one second extra.
+ *  Return: reason or NULL when the decoder is fine
+ */
+
+	if ((device->state != VS10XX_PUMP_SENDING && device->state != VS10XX_PUMP_WAITING) || vs10xx_queue_isempty(device->queue)) {
+
+		vs10xx_device_wdogkick(device);
+		return NULL;
+	}
+
+	if (time_after(jiffies, device->wdog.progress + msecs_to_jiffies(watchdog))) {
+		return "dreq";
+	}
+
+	if (statusrate > 0 && time_after(jiffies, device->wdog.moved + msecs_to_jiffies(watchdog + 1000))) {
+		return "decodetime";
+	}
+
+	return NULL;
+}
+
+static void vs10xx_device_resync(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  Drop queued data up to the next mp3 frame header so the restarted decoder
+ *          picks up at a frame boundary. Bytes before the header in the same chunk
+ *          are replaced by endfill. Device lock held.
+ *  Return: -
+ */
+
+	struct vs10xx_queue_buf_t *buffer;
+	unsigned int i, dropped = 0;
+
+	while (!vs10xx_queue_isempty(device->queue)) {
+
+		buffer = vs10xx_queue_gethead(device->queue);
+
+		for (i = 0; i + 1 < buffer->len; i++) {
+			if ((unsigned char)buffer->data[i] == 0xFF && ((unsigned char)buffer->data[i+1] & 0xE0) == 0xE0) {
+				break;
+			}
+		}
+
+		if (i + 1 < buffer->len) {
+			memset(buffer->data, device->endfill, i);
+			break;
+		}
+
+		dropped += buffer->len;
+		vs10xx_queue_dequeue(device->queue);
+	}
+
+	if (dropped > 0) {
+		vs10xx_stats_add(device->stats, drop_bytes, dropped);
+	}
+
+	vs10xx_dbg("id:%d resync dropped %u bytes", device->id, dropped);
+}
+
+static unsigned int vs10xx_device_discard(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  Drop the queued rest of a stream that the restarted decoder cannot pick up
+ *          halfway: wav, flac and the container formats only carry their setup in the
+ *          header. The writer sees an empty, paused queue. Device lock held.
+ *  Return: bytes dropped
+ */
+
+	unsigned int dropped = vs10xx_queue_getbytes(device->queue);
+
+	vs10xx_queue_flush(device->queue);
+	WRITE_ONCE(device->start, 0);
+	WRITE_ONCE(device->finish, 0);
+	device->written = 0;
+	device->dry = 0;
+	vs10xx_device_fiforeset(device, 1);
+
+	if (dropped > 0) {
+		vs10xx_stats_add(device->stats, drop_bytes, dropped);
+	}
+
+	vs10xx_dbg("id:%d discard dropped %u bytes", device->id, dropped);
+
+	return dropped;
+}
+
+static void vs10xx_device_recover(struct vs10xx_device_t *device, const char *reason) {
+/*
+ *  Descr:  Watchdog: reset the stalled decoder, restore volume, tone and clock and carry
+ *          on with the queued data. Unlike VS10XX_CTL_RESET the stream is not dropped,
+ *          except for formats that cannot resync, see vs10xx_device_discard.
+ *  Return: -
+ */
+
+	vs10xx_fmt_t fmt = (device->page ? device->page->fmt : VS10XX_FMT_NUL);
+	struct vs10xx_volume volume;
+	unsigned short bass, clock;
+	char event[48], count[32];
+	char *envp[] = { event, count, NULL };
+	int status, discard = 0;
+
+	vs10xx_wrn("id:%d decoder stalled (%s), resetting", device->id, reason);
+
+	vs10xx_device_take(device);
+
+	volume = device->volume;
+	bass = device->bass;
+	clock = device->clock;
+
+	status = vs10xx_device_boot(device);
+
+	if (status == 0) {
+		status = vs10xx_device_w_sci_reg(device, 0x0B, 255 - volume.left, 255 - volume.rght);
+	}
+
+	if (status == 0) {
+		status = vs10xx_device_w_sci_reg(device, 0x02, bass >> 8, bass & 0xff);
+	}
+
+	if (status == 0 && clock != 0) {
+		status = vs10xx_device_w_sci_reg(device, 0x03, clock >> 8, clock & 0xff);
+	}
+
+	if (fmt == VS10XX_FMT_MP3) {
+		vs10xx_device_resync(device);
+	} else if (fmt != VS10XX_FMT_NUL) {
+		vs10xx_wrn("id:%d format %d cannot resync, dropped %u bytes", device->id, fmt, vs10xx_device_discard(device));
+		discard = 1;
+	}
+
+	vs10xx_device_give(device);
+
+	if (discard) {
+		/* writers waiting for room, on the fan-out device if fed by one */
+		wake_up_interruptible(&ACCESS_ONCE(device->writer)->pollq);
+		vs10xx_device_setevent(device, VS10XX_EVT_DROPPED);
+	}
+
+	if (status != 0) {
+		vs10xx_err("id:%d watchdog reset failed", device->id);
+	}
+
+	device->wdog.recoveries++;
+	vs10xx_stats_inc(device->stats, watchdogs);
+	vs10xx_device_wdogkick(device);
+
+	vs10xx_device_setevent(device, VS10XX_EVT_RECOVER);
+
+	snprintf(event, sizeof(event), "VS10XX_RECOVER=%s%s", reason, discard ? ",dropped" : "");
+	snprintf(count, sizeof(count), "VS10XX_RECOVERIES=%lu", device->wdog.recoveries);
+	if (device->dev != NULL) {
+		kobject_uevent_env(&device->dev->kobj, KOBJ_CHANGE, envp);
+	}
+}
+
+static struct vs10xx_device_t *vs10xx_device_groupref(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  Find the drift reference of the group of a device: the lowest numbered VS1063 member that streams
+ *  Return: device, NULL --> none
+ */
+
+	struct vs10xx_device_t *member, *ref = NULL;
+
+	mutex_lock(&vs10xx_device_listlock);
+
+	list_for_each_entry(member, &vs10xx_devices, list) {
+
+		if (member->valid && member->version == 6 && ACCESS_ONCE(member->group.num) == device->group.num &&
+			!ACCESS_ONCE(member->group.armed) && !ACCESS_ONCE(member->group.pending) &&
+			(ACCESS_ONCE(member->state) == VS10XX_PUMP_SENDING || ACCESS_ONCE(member->state) == VS10XX_PUMP_WAITING) &&
+			(ref == NULL || member->id < ref->id)) {
+			ref = member;
+		}
+	}
+
+	mutex_unlock(&vs10xx_device_listlock);
+
+	return ref;
+}
+
+static int vs10xx_device_samples(struct vs10xx_device_t *device, struct vs10xx_device_t *other, u32 *samples, ktime_t *stamp) {
+/*
+ *  Descr:  Read the VS1063 sampleCounter of device other from the thread of device
+ *  Return: status
+ */
+
+	int status;
+
+	if (other == device) {
+		vs10xx_device_take(device);
+	} else {
+		vs10xx_device_lock(other);
+	}
+
+	/* the sci writes wait for dreq, only the low word read is timed */
+	status = vs10xx_device_r_param32(other, 0x1e0a, samples, stamp);
+
+	if (other == device) {
+		vs10xx_device_give(device);
+	} else {
+		vs10xx_device_unlock(other);
+	}
+
+	return status;
+}
+
+static void vs10xx_device_ratetune(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  Pull a sync group member towards the decode position of the group reference through the
+ *          VS1063 parametric rateTune. The offset is closed within VS10XX_DEVICE_TUNEHOR seconds
+ *          while the drift term cancels the crystal error. The tune is rewritten on every step, a
+ *          chip reset clears it.
+ *  Return: -
+ */
+
+	struct vs10xx_device_tune_t *tune = &device->tune;
+	unsigned int rate = device->page->samplerate;
+	u32 own = 0, other = 0;
+	ktime_t town, tother;
+	s64 offset, period;
+	struct vs10xx_device_t *ref;
+	int refid, drift, value, status;
+	unsigned long flags;
+
+	tune->next = jiffies + msecs_to_jiffies(ratetune);
+
+	ref = (device->group.num != 0 ? vs10xx_device_groupref(device) : NULL);
+	refid = (ref != NULL ? ref->id : -1);
+
+	if (ref == NULL || ref == device || rate == 0 || ref->page->samplerate != rate ||
+		(device->state != VS10XX_PUMP_SENDING && device->state != VS10XX_PUMP_WAITING) || device->group.armed || device->group.pending) {
+
+		/* nothing to follow, run at the nominal rate */
+		if (tune->ratetune != 0) {
+			vs10xx_device_take(device);
+			vs10xx_device_w_param32(device, 0x1e07, 0);
+			vs10xx_device_give(device);
+		}
+
+		spin_lock_irqsave(&device->evlock, flags);
+		tune->ref = refid;
+		tune->valid = 0;
+		tune->offset = 0;
+		tune->drift = 0;
+		tune->ratetune = 0;
+		spin_unlock_irqrestore(&device->evlock, flags);
+		return;
+	}
+
+	/* back-to-back, the reference thread steps aside after its chunk */
+	status = vs10xx_device_samples(device, device, &own, &town);
+	if (status == 0) {
+		status = vs10xx_device_samples(device, ref, &other, &tother);
+	}
+
+	if (status < 0) {
+		return;
+	}
+
+	/* [us] ahead of the reference, at the time of the own read */
+	offset = div_s64((s64)(s32)(own - other) * USEC_PER_SEC, rate) - ktime_us_delta(town, tother);
+
+	drift = 0;
+	value = 0;
+
+	if (tune->valid && tune->ref == refid) {
+
+		period = ktime_us_delta(town, tune->stamp);
+
+		drift = tune->drift;
+
+		if (period > 0) {
+			/* smoothed, a single period is dominated by the read jitter */
+			drift += ((int)div_s64((offset - tune->offset) * USEC_PER_SEC, period) - drift) / 4;
+		}
+
+		value = tune->ratetune - drift / 2;
+	}
+
+	value -= (int)div_s64(offset, VS10XX_DEVICE_TUNEHOR);
+	value = MAX(-VS10XX_DEVICE_TUNEMAX, MIN(VS10XX_DEVICE_TUNEMAX, value));
+
+	vs10xx_device_take(device);
+	vs10xx_device_w_param32(device, 0x1e07, (u32)value);
+	vs10xx_device_give(device);
+
+	spin_lock_irqsave(&device->evlock, flags);
+	tune->ref = refid;
+	tune->valid = 1;
+	tune->stamp = town;
+	tune->offset = offset;
+	tune->drift = drift;
+	tune->ratetune = value;
+	spin_unlock_irqrestore(&device->evlock, flags);
+
+	vs10xx_nsy("id:%d ref %d offset %lld us drift %d ppm ratetune %d ppm", device->id, refid, (long long)offset, drift, value);
+}
+
+static int vs10xx_device_kthread(void *arg) {
+
+	struct vs10xx_device_t *device = (struct vs10xx_device_t*)arg;
+
+	do {
 
 		int status = 0;
 
-		if (vs10xx_device_getpause(device->id)) {
+		vs10xx_stats_inc(device->stats, wakeups);
+
+		if (ACCESS_ONCE(device->ramp.active)) {
+
+			/* step volume ramp */
+			vs10xx_device_ramp(device);
+		}
+
+		if (statusrate > 0 && time_after_eq(jiffies, device->pagenext)) {
+
+			/* refresh mmap status page */
+			vs10xx_device_statuspage(device);
+		}
+
+		if (watchdog > 0) {
+
+			const char *reason = vs10xx_device_stalled(device);
+
+			if (reason != NULL) {
+
+				/* hung decoder, reset it and carry on with the queued data */
+				vs10xx_device_recover(device, reason);
+			}
+		}
+
+		if (ratetune > 0 && device->version == 6 && (ACCESS_ONCE(device->group.num) != 0 || device->tune.ratetune != 0) &&
+			time_after_eq(jiffies, device->tune.next)) {
+
+			/* keep in step with the group */
+			vs10xx_device_ratetune(device);
+		}
+
+		if (ACCESS_ONCE(device->closing) && (vs10xx_queue_isempty(device->queue) || time_after_eq(jiffies, device->closeby))) {
+
+			/* released, end the stream */
+			vs10xx_device_setstate(device, VS10XX_PUMP_CLOSING);
+			vs10xx_device_endstream(device);
+
+		} else if (vs10xx_device_getpause(device)) {
+
+			if (device->dry) {
+
+				/* rebuffering, see if the decoder starves first */
+				vs10xx_device_starve(device);
+			}
+
+			if (device->state != VS10XX_PUMP_UNDERRUN) {
+
+				/* on hold, wait for start */
+				vs10xx_device_setstate(device, VS10XX_PUMP_PAUSED);
+			}
+
+			/* the decoder waits for us, not the other way round */
+			vs10xx_io_idle(device->chip);
+
+			wait_event_timeout(device->wq, !vs10xx_device_getpause(device) || ACCESS_ONCE(device->closing), msecs_to_jiffies(10));
+
+		}
+		else if (vs10xx_queue_isempty(device->queue)) {
+
+			/* nothing left to recover */
+			device->fault.active = 0;
+			device->fault.retries = 0;
+			vs10xx_io_idle(device->chip);
+
+			/* no data --> pause */
+			if (vs10xx_device_getopen(device)) {
+
+				vs10xx_nsy("id:%d no data", device->id);
+				vs10xx_device_setpause(device);
+
+				if (!vs10xx_device_getfinish(device)) {
+
+					/* may become an underrun, see vs10xx_device_starve */
+					device->dry = 1;
+
+				} else {
+
+					/* drained, wake up VS10XX_CTL_DRAIN */
+					wake_up(&device->wq);
+				}
+			}
+
+		} else if (!vs10xx_io_wtready(device->chip, 10)) {
+
+			/* io not ready to receive */
+			vs10xx_nsy("id:%d not ready", device->id);
+			vs10xx_device_setstate(device, VS10XX_PUMP_WAITING);
+			vs10xx_device_faulted(device);
+
+		} else {
+
+			unsigned int burst = 0;
+
+			device->dry = 0;
+
+			vs10xx_device_setstate(device, VS10XX_PUMP_SENDING);
+			vs10xx_device_take(device);
+
+			while (status == 0 && vs10xx_io_isready(device->chip) && !vs10xx_queue_isempty(device->queue)) {
+
+				/* transmit data */
+				struct vs10xx_queue_buf_t *buffer;
+				buffer = vs10xx_queue_gethead(device->queue);
+				status = vs10xx_io_data_tx(device->chip, buffer->data, buffer->len);
+				if (status == 0) {
+					if (device->group.pending) {
+						/* first audio after a group start, for the skew */
+						device->group.started = ktime_get();
+						device->group.pending = 0;
+					}
+					vs10xx_device_recovered(device);
+					device->fault.retries = 0;
+					burst += buffer->len;
+					device->sent += buffer->len;
+					vs10xx_queue_dequeue(device->queue);
+				} else if (vs10xx_device_senderr(device, buffer)) {
+					vs10xx_queue_dequeue(device->queue);
+				}
+
+				/* control operations go in between chunks */
+				vs10xx_device_yield(device);
+			}
+
+			vs10xx_stats_level(device->stats, vs10xx_queue_getlevel(device->queue));
+
+			vs10xx_device_give(device);
+
+			if (burst > 0) {
+				device->wdog.progress = jiffies;
+			}
+
+			vs10xx_device_fifo(device, burst);
+
+			if (status < 0) {
+
+				/* give the bus a moment before the retry */
+				msleep(1);
+			}
+
+			if (waitqueue_active(&ACCESS_ONCE(device->writer)->pollq)) {
+
+				/* writers polling for space, on the fan-out device if fed by one */
+				wake_up_interruptible(&ACCESS_ONCE(device->writer)->pollq);
+			}
+		}
+
+	} while (!kthread_should_stop());
+
+	return 0;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX DEV INTERFACE                                                                                                          */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+int vs10xx_device_isvalid(struct vs10xx_device_t *device) {
+
+	return (device != NULL && device->valid);
+}
+
+struct vs10xx_device_t *vs10xx_device_get(int id) {
+/*
+ *  Descr:  Look up a device by its id, for the ioctls that name other devices
+ *  Return: device or NULL
+ */
+
+	struct vs10xx_device_t *device, *found = NULL;
+
+	mutex_lock(&vs10xx_device_listlock);
+
+	list_for_each_entry(device, &vs10xx_devices, list) {
+		if (device->id == id) {
+			found = device;
+			break;
+		}
+	}
+
+	mutex_unlock(&vs10xx_device_listlock);
+
+	return found;
+}
+
+int vs10xx_device_id(const struct vs10xx_device_t *device) {
+
+	return (device ? device->id : -1);
+}
+
+struct vs10xx_stats_dev_t *vs10xx_device_stats(const struct vs10xx_device_t *device) {
+
+	return device->stats;
+}
+
+int vs10xx_device_open(struct vs10xx_device_t *device) {
+
+	unsigned long flags;
+	int status = 0;
+
+	if (!vs10xx_device_isvalid(device) || vs10xx_device_getopen(device)) {
+
+		status = -1;
+
+	} else if (ACCESS_ONCE(device->closing) && !wait_event_timeout(device->wq, !ACCESS_ONCE(device->closing), msecs_to_jiffies(2000))) {
+
+		vs10xx_wrn("id:%d previous stream did not end", device->id);
+		status = -1;
+
+	} else {
+
+		/* the irq and the device thread raise events, start the stream with none */
+		spin_lock_irqsave(&device->evlock, flags);
+		device->events = 0;
+		spin_unlock_irqrestore(&device->evlock, flags);
+
+		/* the device thread may still be refreshing the status page */
+		mutex_lock(&device->lock);
+		device->sent = 0;
+		device->dry = 0;
+		device->group.armed = (device->group.num != 0);
+		if (device->group.num != 0 && device->version == 6) {
+			/* members count samples from the group start */
+			vs10xx_device_w_param32(device, 0x1e0a, 0);
+		}
+		mutex_unlock(&device->lock);
+
+		vs10xx_device_setopen(device);
+	}
+
+	return status;
+}
+
+static void vs10xx_device_close(struct vs10xx_device_t *device) {
+
+	mutex_lock(&device->lock);
+
+	if (device->written) {
+
+		/* the device thread drains the queue for up to wclose ms and ends the stream */
+		device->closeby = jiffies + msecs_to_jiffies(wclose);
+		WRITE_ONCE(device->finish, 1);
+		WRITE_ONCE(device->start, 1);
+		WRITE_ONCE(device->closing, 1);
+
+	} else {
+
+		/* nothing was sent to the decoder */
+		vs10xx_queue_flush(device->queue);
+		vs10xx_queue_unshare(device->queue);
+		device->writer = device;
+		WRITE_ONCE(device->start, 0);
+	}
+
+	WRITE_ONCE(device->fanout, 0);
+
+	mutex_unlock(&device->lock);
+
+	vs10xx_device_clropen(device);
+}
+
+int vs10xx_device_release(struct vs10xx_device_t *device) {
+
+	struct vs10xx_device_t *members[VS10XX_MAX_MEMBERS];
+	int m, n = vs10xx_device_members(device, members);
+
+	/* fan-out members end their streams along with this one */
+	for (m = 0; m < n; m++) {
+		vs10xx_device_close(members[m]);
+	}
+
+	return 0;
+}
+
+struct vs10xx_queue_buf_t* vs10xx_device_getbuf(struct vs10xx_device_t *device) {
+
+	struct vs10xx_queue_buf_t *buffer = NULL;
+
+	if (!vs10xx_queue_isfull(device->queue)) {
+		mutex_lock(&device->lock);
+		buffer = vs10xx_queue_getslot(device->queue);
+		mutex_unlock(&device->lock);
+	}
+
+	return buffer;
+}
+
+static void vs10xx_device_queued(struct vs10xx_device_t *device, int enqueue) {
+/*
+ *  Descr:  Account for a chunk written to device, or to the fan-out device feeding it, and
+ *          start playback once (re)buffered
+ *  Return: -
+ */
+
+	int level;
+
+	mutex_lock(&device->lock);
+	if (enqueue) {
+		vs10xx_queue_enqueue(device->queue);
+	}
+	device->written = 1;
+	WRITE_ONCE(device->finish, 0);
+	level = vs10xx_queue_getlevel(device->queue);
+	vs10xx_stats_level(device->stats, level);
+	mutex_unlock(&device->lock);
+
+	if (vs10xx_device_getpause(device) && !ACCESS_ONCE(device->group.armed) &&
+			level * 100 >= (level + vs10xx_queue_getfree(device->queue)) * device->rebuf) {
 
-			/* on hold, wait for start */
-			wait_event_timeout(device->wq, device->start, msecs_to_jiffies(10));
+		/* (re)buffered up to the rebuffer level */
+		vs10xx_device_clrpause(device);
+	}
+}
 
-		}
-		else if (vs10xx_queue_isempty(device->id)) {
+int vs10xx_device_write(struct vs10xx_device_t *device) {
 
-			/* no data --> pause */
-			if (vs10xx_device_getopen(device->id)) {
+	int m, n = ACCESS_ONCE(device->fanout);
 
-				vs10xx_nsy("id:%d no data", device->id);
-				vs10xx_device_setpause(device->id);
+	vs10xx_device_queued(device, 1);
 
-				if (!vs10xx_device_getfinish(device->id)) {
+	for (m = 0; m < n; m++) {
+		if (device->fanto[m] != device) {
+			vs10xx_device_queued(device->fanto[m], 0);
+		}
+	}
 
-					/* log underrun */
-					device->underrun++;
-				}
-			}
+	return 0;
+}
 
-		} else if (!vs10xx_io_wtready(device->id, 10)) {
+int vs10xx_device_finish(struct vs10xx_device_t *device) {
 
-			/* io not ready to receive */
-			vs10xx_nsy("id:%d not ready", device->id);
+	struct vs10xx_device_t *members[VS10XX_MAX_MEMBERS];
+	int m, n = vs10xx_device_members(device, members), status = 0;
 
-		} else {
+	vs10xx_dbg("id:%d", device->id);
 
-			mutex_lock(&device->lock);
+	for (m = 0; m < n; m++) {
 
-			while (vs10xx_io_isready(device->id) && !vs10xx_queue_isempty(device->id)) {
+		/* end of stream: play what is queued, the queue running dry is no underrun */
+		vs10xx_device_setfinish(members[m]);
+		vs10xx_device_clrpause(members[m]);
+	}
 
-				/* transmit data */
-				struct vs10xx_queue_buf_t *buffer;
-				buffer = vs10xx_queue_gethead(device->id);
-				status = vs10xx_io_data_tx(device->id, buffer->data, buffer->len);
-				if (status == 0) {
-					vs10xx_queue_dequeue(device->id);
-				}
-			}
+	for (m = 0; m < n; m++) {
 
-			mutex_unlock(&device->lock);
+		while (status == 0 && vs10xx_device_getfinish(members[m]) && !vs10xx_queue_isempty(members[m]->queue)) {
+
+			if (wait_event_interruptible_timeout(members[m]->wq,
+					!vs10xx_device_getfinish(members[m]) || vs10xx_queue_isempty(members[m]->queue), msecs_to_jiffies(100)) < 0) {
+				/* signal, the stream plays on, the caller may drain again */
+				status = -ERESTARTSYS;
+			}
 		}
+	}
 
-	} while (!kthread_should_stop());
+	return status;
+}
+
+int vs10xx_device_setrebuf(struct vs10xx_device_t *device, struct vs10xx_rebuf *rebuf) {
+
+	vs10xx_device_lock(device);
+
+	device->rebuf = MAX(1, MIN(100, rebuf->level));
+	device->rebufevt = (rebuf->notify ? 1 : 0);
+
+	vs10xx_device_unlock(device);
 
 	return 0;
 }
 
-/* ----------------------------------------------------------------------------------------------------------------------------- */
-/* VS10XX DEV INTERFACE                                                                                                          */
-/* ----------------------------------------------------------------------------------------------------------------------------- */
+int vs10xx_device_setgroup(struct vs10xx_device_t *device, struct vs10xx_group *group) {
+
+	if (group->group > VS10XX_MAX_GROUPS) {
+		return -1;
+	}
+
+	vs10xx_device_lock(device);
 
-int vs10xx_device_isvalid(int id) {
+	device->group.num = group->group;
+	device->group.armed = (group->group != 0 && !device->start);
 
-	return !(id < 0 || id >= VS10XX_MAX_DEVICES || !vs10xx_device[id].valid);
+	vs10xx_device_unlock(device);
+
+	return 0;
 }
 
-int vs10xx_device_open(int id) {
+int vs10xx_device_setfanout(struct vs10xx_device_t *device, struct vs10xx_fanout *fanout) {
+/*
+ *  Descr:  Feed the devices in fanout->members from the writes to device, which must be open
+ *          for a new stream. The other members are claimed like an open().
+ *  Return: status
+ */
+
+	struct vs10xx_device_t *members[VS10XX_MAX_MEMBERS], *member;
+	struct vs10xx_queue_t *queues[VS10XX_MAX_MEMBERS];
+	unsigned int mask = fanout->members;
+	int m, n = 0, status = 0;
+
+	if (mask == 0) {
+
+		/* end the fan-out, the other members finish their streams */
+		n = vs10xx_device_members(device, members);
+		for (m = 0; m < n; m++) {
+			if (members[m] != device) {
+				vs10xx_device_close(members[m]);
+			}
+		}
 
-	int status = 0;
+		/* back to its own queue, what it did not play yet of the ring goes with it */
+		vs10xx_device_lock(device);
+		vs10xx_queue_flush(device->queue);
+		vs10xx_queue_unshare(device->queue);
+		WRITE_ONCE(device->fanout, 0);
+		vs10xx_device_unlock(device);
 
-	if (vs10xx_device_getopen(id)) {
+		return 0;
+	}
 
-		status = -1;
+	if (device->id >= VS10XX_MAX_MEMBERS || !(mask & (1U << device->id)) || fanout->policy > VS10XX_FANOUT_DROP ||
+		!vs10xx_device_getopen(device) || device->written || device->fanout != 0) {
+		return -1;
+	}
 
-	} else {
+	for (m = 0; status == 0 && m < VS10XX_MAX_MEMBERS; m++) {
+		if (m == device->id) {
+			members[n++] = device;
+		} else if (mask & (1U << m)) {
+			member = vs10xx_device_get(m);
+			if (!vs10xx_device_isvalid(member) || vs10xx_device_open(member) < 0) {
+				vs10xx_wrn("id:%d fan-out member %d not available", device->id, m);
+				status = -1;
+			} else {
+				members[n++] = member;
+			}
+		}
+	}
+
+	if (status == 0) {
+
+		/* in id order, the only place that holds more than one device lock */
+		for (m = 0; m < n; m++) {
+			vs10xx_device_lock(members[m]);
+			queues[m] = members[m]->queue;
+		}
+
+		status = vs10xx_queue_share(device->queue, queues, n, fanout->policy);
+
+		if (status == 0) {
+			for (m = 0; m < n; m++) {
+				members[m]->writer = device;
+			}
+			memcpy(device->fanto, members, n * sizeof(*members));
+			WRITE_ONCE(device->fanout, n);
+		}
+
+		for (m = n - 1; m >= 0; m--) {
+			vs10xx_device_unlock(members[m]);
+		}
+	}
+
+	if (status < 0) {
 
-		vs10xx_device_setopen(id);
+		/* give back the claimed members */
+		for (m = 0; m < n; m++) {
+			if (members[m] != device) {
+				vs10xx_device_close(members[m]);
+			}
+		}
 	}
 
 	return status;
 }
 
-int vs10xx_device_release(int id) {
+int vs10xx_device_move(struct vs10xx_device_t *device, struct vs10xx_move *move) {
+/*
+ *  Descr:  Hand the stream of device over to move->target: the queued chunks change owner, the
+ *          target starts right away and device is cancelled and released. On success the
+ *          caller's file writes to the target from now on.
+ *  Return: status
+ */
+
+	struct vs10xx_device_t *src = device;
+	struct vs10xx_device_t *dst = vs10xx_device_get(move->target);
+	vs10xx_fmt_t fmt = VS10XX_FMT_NUL;
+	unsigned int level;
+	int midstream, status = 0;
+
+	move->bytes = 0;
+	move->skipped = 0;
+
+	if (dst == src || !vs10xx_device_isvalid(dst) || !vs10xx_device_getopen(device) ||
+		src->fanout != 0 || vs10xx_queue_isshared(device->queue) || src->group.armed) {
+		return -1;
+	}
 
-	struct vs10xx_scireg scireg_addr = { 0x07, 0x1e, 0x06 };
-	struct vs10xx_scireg scireg_data = { 0x06, 0x00, 0x00 };
-	struct vs10xx_queue_buf_t buffer;
-	struct vs10xx_info info;
-	unsigned char msb, lsb;
-	int i = wclose, status = 0;
+	/* claim the target like an open() */
+	if (vs10xx_device_open(dst) < 0) {
+		vs10xx_wrn("id:%d move target %d not available", device->id, dst->id);
+		return -1;
+	}
+
+	/* both locks in id order, like the fan-out setup */
+	vs10xx_device_lock(src->id < dst->id ? src : dst);
+	vs10xx_device_lock(src->id < dst->id ? dst : src);
 
-	while ((i-- > 0) && !vs10xx_queue_isempty(id)) {
+	midstream = (src->sent > 0);
 
-		msleep(1);
+	if (midstream) {
+		status = vs10xx_device_r_fmt(device, &fmt);
 	}
 
-	if (!vs10xx_queue_isempty(id)) {
+	if (status == 0 && midstream && fmt != VS10XX_FMT_MP3 && fmt != VS10XX_FMT_NUL) {
 
-		vs10xx_dbg("id:%d queue not empty, closing anyway", id);
+		/* the target would miss the stream headers */
+		vs10xx_wrn("id:%d cannot move a format %d stream mid-stream", device->id, fmt);
+		status = -1;
 	}
 
-	mutex_lock(&vs10xx_device[id].lock);
-	vs10xx_queue_flush(id);
-	mutex_unlock(&vs10xx_device[id].lock);
+	if (status == 0) {
 
-	vs10xx_device_setpause(id);
+		move->bytes = vs10xx_queue_move(src->queue, dst->queue);
 
-	// get stream type and endfillbytes
-	vs10xx_io_wtready(id, 250);
-	vs10xx_device_getinfo(id, &info);
-	status = vs10xx_device_setscireg(id, &scireg_addr);
-	status = vs10xx_device_getscireg(id, &scireg_data);
+		dst->rebuf = src->rebuf;
+		dst->rebufevt = src->rebufevt;
+		dst->written = (move->bytes > 0);
+		WRITE_ONCE(dst->finish, src->finish);
 
-	buffer.len = sizeof(buffer.data);
-	memset(buffer.data, scireg_data.lsb, buffer.len);
+		if (midstream) {
 
-	// send endfillbytes to end file
-	// bufsize = 32 => send 384 (FLAC) of 65 (other) buffers
-	for (i = (info.fmt==VS10XX_FMT_FLC?384:65); i > 0; i--) {
+			/* the decoder of the target has never seen this stream, start at a frame */
+			level = vs10xx_queue_getbytes(dst->queue);
+			vs10xx_device_resync(dst);
+			move->skipped = level - vs10xx_queue_getbytes(dst->queue);
+		}
 
-		vs10xx_io_wtready(id, 10);
+		/* no prebuffering, the data is there */
+		WRITE_ONCE(dst->start, !vs10xx_queue_isempty(dst->queue));
 
-		status = vs10xx_io_data_tx(id, buffer.data, buffer.len);
+		vs10xx_queue_flush(device->queue);
+		WRITE_ONCE(src->start, 0);
+		WRITE_ONCE(src->finish, 0);
 	}
 
-	// set SM CANCEL
-	status = vs10xx_device_w_sci_reg(id, 0x00, 0x08, 0x08);
+	vs10xx_device_unlock(src->id < dst->id ? dst : src);
+	vs10xx_device_unlock(src->id < dst->id ? src : dst);
 
-	// send endfillbytes awaiting cancel confimation
-	// bufsize = 32 => send 64 buffers
-	for (i = 0; i < 64; i++) {
+	if (status < 0) {
 
-		status = vs10xx_io_data_tx(id, buffer.data, buffer.len);
+		vs10xx_device_close(dst);
+		return status;
+	}
 
-		vs10xx_io_wtready(id, 10);
+	wake_up(&dst->wq);
 
-		status = vs10xx_device_r_sci_reg(id, 0x00, &msb, &lsb);
+	/* fast cancel, the old room stops at once */
+	vs10xx_device_abort(device, 0);
+	vs10xx_device_clropen(device);
 
-		if ((lsb & 0x08) == 0) {
+	vs10xx_dbg("id:%d moved to %d: %u bytes, %u skipped", device->id, dst->id, move->bytes, move->skipped);
 
-			break;
-		}
+	return 0;
+}
+
+static int vs10xx_device_groupready(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  Test if a group member has prebuffered, see vs10xx_device_write
+ *  Return: 1 --> ready to start
+ *          0 --> still buffering
+ */
+
+	int level = vs10xx_queue_getlevel(device->queue);
+
+	return (vs10xx_device_getopen(device) &&
+		(ACCESS_ONCE(device->finish) || level * 100 >= (level + vs10xx_queue_getfree(device->queue)) * device->rebuf));
+}
+
+int vs10xx_device_groupstart(struct vs10xx_device_t *device, struct vs10xx_groupstart *gs) {
+/*
+ *  Descr:  Wait for all members of a group to prebuffer, sleep until gs->when and release
+ *          them together. Reports the spread of the first sdi transfers of the members.
+ *  Return: status
+ */
+
+	unsigned long end = jiffies + msecs_to_jiffies(gs->timeout ? gs->timeout : 5000);
+	struct vs10xx_device_t *member;
+	ktime_t when, first, last;
+	int members, ready, status = 0;
+
+	if (gs->group == 0 || gs->group > VS10XX_MAX_GROUPS) {
+		return -1;
 	}
 
-	if ((lsb & 0x08) == 1) {
+	mutex_lock(&vs10xx_device_grouplock);
+
+	/* prebuffer */
+	do {
+		members = ready = 0;
+		mutex_lock(&vs10xx_device_listlock);
+		list_for_each_entry(member, &vs10xx_devices, list) {
+			if (vs10xx_device_isvalid(member) && member->group.num == gs->group) {
+				members++;
+				ready += vs10xx_device_groupready(member);
+			}
+		}
+		mutex_unlock(&vs10xx_device_listlock);
+		if (members == 0 || ready < members) {
+			msleep(5);
+		}
+	} while ((members == 0 || ready < members) && time_before(jiffies, end) && !signal_pending(current));
+
+	if (signal_pending(current)) {
+
+		/* interrupted, the members stay armed for another GROUPSTART */
+		status = -ERESTARTSYS;
 
-		vs10xx_device_swreset(id, 0);
-		vs10xx_wrn("id:%d device did not cancel, swreset issued!", id);
+	} else if (members == 0 || ready < members) {
+
+		vs10xx_wrn("id:%d group %u: %d of %d members buffered", device->id, gs->group, ready, members);
+		status = -1;
 	}
 
-	vs10xx_device_clropen(id);
+	if (status == 0 && gs->when != 0) {
 
-	return status;
-}
+		/* start at the requested instant */
+		when = ns_to_ktime(gs->when);
+		while (ktime_to_ns(ktime_sub(when, ktime_get())) > 0 && !signal_pending(current)) {
+			set_current_state(TASK_INTERRUPTIBLE);
+			schedule_hrtimeout(&when, HRTIMER_MODE_ABS);
+		}
+		__set_current_state(TASK_RUNNING);
 
-struct vs10xx_queue_buf_t* vs10xx_device_getbuf(int id) {
+		if (signal_pending(current)) {
 
-	struct vs10xx_queue_buf_t *buffer = NULL;
+			/* not the requested instant, leave the members armed */
+			status = -ERESTARTSYS;
+		}
+
+	} else {
 
-	if (!vs10xx_queue_isfull(id)) {
-		mutex_lock(&vs10xx_device[id].lock);
-		buffer = vs10xx_queue_getslot(id);
-		mutex_unlock(&vs10xx_device[id].lock);
+		when = ktime_get();
 	}
 
-	return buffer;
-}
+	if (status == 0) {
 
-int vs10xx_device_write(int id) {
+		/* release, the device threads are woken back-to-back afterwards */
+		mutex_lock(&vs10xx_device_listlock);
 
-	int status = 0;
+		list_for_each_entry(member, &vs10xx_devices, list) {
+			if (vs10xx_device_isvalid(member) && member->group.num == gs->group) {
+				mutex_lock(&member->lock);
+				member->group.armed = 0;
+				member->group.pending = 1;
+				WRITE_ONCE(member->start, 1);
+				mutex_unlock(&member->lock);
+			}
+		}
+
+		list_for_each_entry(member, &vs10xx_devices, list) {
+			if (vs10xx_device_isvalid(member) && member->group.num == gs->group) {
+				wake_up(&member->wq);
+			}
+		}
+
+		mutex_unlock(&vs10xx_device_listlock);
+
+		/* wait for the first transfers */
+		end = jiffies + msecs_to_jiffies(500);
+		do {
+			msleep(1);
+			ready = 0;
+			mutex_lock(&vs10xx_device_listlock);
+			list_for_each_entry(member, &vs10xx_devices, list) {
+				if (vs10xx_device_isvalid(member) && member->group.num == gs->group) {
+					ready += !ACCESS_ONCE(member->group.pending);
+				}
+			}
+			mutex_unlock(&vs10xx_device_listlock);
+		} while (ready < members && time_before(jiffies, end));
+
+		first = last = ktime_set(0, 0);
+		mutex_lock(&vs10xx_device_listlock);
+		list_for_each_entry(member, &vs10xx_devices, list) {
+			if (vs10xx_device_isvalid(member) && member->group.num == gs->group && !member->group.pending) {
+				if (ktime_to_ns(first) == 0 || ktime_to_ns(member->group.started) < ktime_to_ns(first)) {
+					first = member->group.started;
+				}
+				if (ktime_to_ns(member->group.started) > ktime_to_ns(last)) {
+					last = member->group.started;
+				}
+			}
+		}
+		mutex_unlock(&vs10xx_device_listlock);
 
-	mutex_lock(&vs10xx_device[id].lock);
-	vs10xx_queue_enqueue(id);
-	mutex_unlock(&vs10xx_device[id].lock);
+		gs->members = members;
+		gs->skew = (unsigned int)ktime_us_delta(last, first);
+		gs->late = (ktime_to_ns(first) > ktime_to_ns(when) ? (unsigned int)ktime_us_delta(first, when) : 0);
 
-	if (vs10xx_device_getpause(id) && vs10xx_queue_isfull(id)) {
+		if (ready < members) {
+			vs10xx_wrn("id:%d group %u: %d of %d members started", device->id, gs->group, ready, members);
+			status = -1;
+		}
 
-		vs10xx_device_clrpause(id);
+		vs10xx_dbg("id:%d group %u: %d members, skew %u us, late %u us", device->id, gs->group, members, gs->skew, gs->late);
 	}
 
+	mutex_unlock(&vs10xx_device_grouplock);
+
 	return status;
 }
 
-int vs10xx_device_getfree(int id) {
+int vs10xx_device_getfree(struct vs10xx_device_t *device) {
 
-	return vs10xx_queue_getfree(id);
+	return vs10xx_queue_getfree(device->queue);
 }
 
-int vs10xx_device_status(int id, char* buf) {
+int vs10xx_device_getlevel(struct vs10xx_device_t *device) {
+
+	return vs10xx_queue_getlevel(device->queue);
+}
+
+int vs10xx_device_status(struct vs10xx_device_t *device, char* buf) {
 
 	struct vs10xx_info info;
 
-	vs10xx_device_getinfo(id, &info);
+	vs10xx_device_getinfo(device, &info);
 
 	return sprintf(buf, "xversion: %d\nplaystat: %s\nstrmtype: %d\ndreq/rdy: %d\nunderrun: %lu\n",
-		vs10xx_device[id].version,
-		vs10xx_device[id].start ? (vs10xx_device[id].finish ? "F" : "P") : "S",
+		device->version,
+		!vs10xx_device_getpause(device) ? (vs10xx_device_getfinish(device) ? "F" : "P") : "S",
 		info.fmt,
-		vs10xx_io_isready(id),
-		vs10xx_device[id].underrun
+		vs10xx_io_isready(device->chip),
+		device->underrun
+	);
+}
+
+int vs10xx_device_drift(struct vs10xx_device_t *device, char* buf) {
+
+	struct vs10xx_device_tune_t tune;
+	unsigned long flags;
+
+	spin_lock_irqsave(&device->evlock, flags);
+	tune = device->tune;
+	spin_unlock_irqrestore(&device->evlock, flags);
+
+	return sprintf(buf, "group   : %d\nrefdev  : %d\noffsetus: %lld\ndriftppm: %d\nratetune: %d\n",
+		device->group.num,
+		tune.ref,
+		tune.valid ? (long long)tune.offset : 0LL,
+		tune.drift,
+		tune.ratetune
 	);
 }
 
+int vs10xx_device_ctrlwait(struct vs10xx_device_t *device, char* buf) {
+
+	struct vs10xx_hist_t hist;
+
+	/* print a snapshot, formatting under the device lock would hold up the pump */
+	spin_lock(&device->ctrllock);
+	hist = device->ctrlwait;
+	spin_unlock(&device->ctrllock);
+
+	return vs10xx_hist_print(&hist, "us", buf, PAGE_SIZE);
+}
+
+void vs10xx_device_clrctrlwait(struct vs10xx_device_t *device) {
+
+	spin_lock(&device->ctrllock);
+	vs10xx_hist_clear(&device->ctrlwait);
+	spin_unlock(&device->ctrllock);
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX DEVICE SCHEDULING                                                                                                      */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static int vs10xx_device_policy(struct task_struct *task, int policy, int prio) {
+/*
+ *  Descr:  Set the scheduling class of a device thread, prio is the SCHED_FIFO priority or the nice value.
+ *          Since 5.9 modules only get two fifo priorities, 1 below MAX_RT_PRIO/2 and MAX_RT_PRIO/2 above.
+ *  Return: status
+ */
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,9,0)
+
+	if (policy == SCHED_FIFO && prio < MAX_RT_PRIO / 2) {
+		sched_set_fifo_low(task);
+	} else if (policy == SCHED_FIFO) {
+		sched_set_fifo(task);
+	} else {
+		sched_set_normal(task, prio);
+	}
+
+	return 0;
+
+#else
+
+	struct sched_param param = { .sched_priority = (policy == SCHED_FIFO ? prio : 0) };
+	int status;
+
+	status = sched_setscheduler(task, policy, &param);
+
+	if (status == 0 && policy == SCHED_NORMAL) {
+		set_user_nice(task, prio);
+	}
+
+	return status;
+
+#endif
+}
+
+int vs10xx_device_sched(struct vs10xx_device_t *device, char* buf) {
+/*
+ *  Descr:  Print the scheduling class of the device thread, in the format vs10xx_device_setsched takes
+ *  Return: length
+ */
+
+	struct task_struct *task;
+	int len = 0;
+
+	if (!vs10xx_device_isvalid(device)) {
+		return 0;
+	}
+
+	task = device->kthread;
+
+	mutex_lock(&vs10xx_device_schedlock);
+
+	if (task->policy == SCHED_FIFO || task->policy == SCHED_RR) {
+		len = sprintf(buf, "%s %u\n", (task->policy == SCHED_FIFO ? "fifo" : "rr"), task->rt_priority);
+	} else {
+		len = sprintf(buf, "other %d\n", task_nice(task));
+	}
+
+	mutex_unlock(&vs10xx_device_schedlock);
+
+	return len;
+}
+
+int vs10xx_device_setsched(struct vs10xx_device_t *device, const char* buf) {
+/*
+ *  Descr:  Run the device thread at "fifo <1..99>" or at "other <nice -20..19>"
+ *  Return: status
+ */
+
+	char class[8];
+	int policy, prio, status;
+
+	if (!vs10xx_device_isvalid(device) || sscanf(buf, "%7s %d", class, &prio) != 2) {
+		return -1;
+	}
+
+	if (strcmp(class, "fifo") == 0 && prio > 0 && prio < MAX_RT_PRIO) {
+		policy = SCHED_FIFO;
+	} else if (strcmp(class, "other") == 0 && prio >= -20 && prio <= 19) {
+		policy = SCHED_NORMAL;
+	} else {
+		return -1;
+	}
+
+	mutex_lock(&vs10xx_device_schedlock);
+	status = vs10xx_device_policy(device->kthread, policy, prio);
+	mutex_unlock(&vs10xx_device_schedlock);
+
+	if (status < 0) {
+		vs10xx_err("id:%d %s %d (%d)", device->id, class, prio, status);
+	} else {
+		vs10xx_inf("id:%d %s %d", device->id, class, prio);
+	}
+
+	return status;
+}
+
+int vs10xx_device_cpus(struct vs10xx_device_t *device, char* buf) {
+/*
+ *  Descr:  Print the cpus the device thread may run on as a list
+ *  Return: length
+ */
+
+	int len;
+
+	if (!vs10xx_device_isvalid(device)) {
+		return 0;
+	}
+
+	mutex_lock(&vs10xx_device_schedlock);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,0,0)
+	len = cpumap_print_to_pagebuf(true, buf, device->cpus);
+#else
+	len = cpulist_scnprintf(buf, PAGE_SIZE - 2, device->cpus);
+	len += sprintf(buf + len, "\n");
+#endif
+	mutex_unlock(&vs10xx_device_schedlock);
+
+	return len;
+}
+
+int vs10xx_device_setcpus(struct vs10xx_device_t *device, const char* buf) {
+/*
+ *  Descr:  Bind the device thread to a list of cpus, e.g. "1" or "2-3"
+ *  Return: status
+ */
+
+	cpumask_var_t cpus;
+	int status;
+
+	if (!vs10xx_device_isvalid(device) || !alloc_cpumask_var(&cpus, GFP_KERNEL)) {
+		return -1;
+	}
+
+	status = cpulist_parse(buf, cpus);
+
+	if (status == 0 && cpumask_empty(cpus)) {
+		status = -EINVAL;
+	}
+
+	if (status == 0) {
+		mutex_lock(&vs10xx_device_schedlock);
+		status = set_cpus_allowed_ptr(device->kthread, cpus);
+		if (status == 0) {
+			cpumask_copy(device->cpus, cpus);
+		}
+		mutex_unlock(&vs10xx_device_schedlock);
+	}
+
+	if (status < 0) {
+		vs10xx_err("id:%d cpus %s (%d)", device->id, buf, status);
+	}
+
+	free_cpumask_var(cpus);
+
+	return status;
+}
+
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 /* VS10XX DEVICE INIT/EXIT                                                                                                       */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
-int vs10xx_device_init(int id, struct device *dev) {
+int vs10xx_device_init(int id, struct vs10xx_chip *chip, struct device *dev, struct vs10xx_device_t **context) {
+/*
+ *  Descr:  Set up the device of a probed chip with its stats, io path and queue. The context is
+ *          returned also when this fails halfway, vs10xx_device_exit takes it down.
+ *  Return: status
+ */
 
+	struct vs10xx_device_t *device;
 	int status = 0;
 
 	vs10xx_dbg("start:%d", id);
 
-	vs10xx_device[id].id = id;
-	vs10xx_device[id].open = 0;
-	vs10xx_device[id].valid = 0;
-	vs10xx_device[id].start = 0;
-	vs10xx_device[id].finish = 0;
-	vs10xx_device[id].underrun = 0;
-	vs10xx_device[id].version = -1;
+	device = kzalloc(sizeof(struct vs10xx_device_t), GFP_KERNEL);
+	*context = device;
+	if (device == NULL) {
+		vs10xx_err("id:%d kzalloc", id);
+		return -1;
+	}
 
-	vs10xx_device[id].dev = dev;
+	device->id = id;
+	device->chip = chip;
+	device->open = 0;
+	device->valid = 0;
+	device->start = 0;
+	device->finish = 0;
+	device->written = 0;
+	device->closing = 0;
+	device->endfill = 0;
+	device->underrun = 0;
+	device->sent = 0;
+	device->pagenext = jiffies;
+	device->dry = 0;
+	device->rebuf = 100;
+	device->rebufevt = 0;
+	device->state = VS10XX_PUMP_PAUSED;
+	device->version = -1;
+	device->events = 0;
+	device->ramp.active = 0;
+	device->fault.active = 0;
+	device->fault.retries = 0;
+	device->wdog.progress = jiffies;
+	device->wdog.moved = jiffies;
+	device->wdog.decodetime = 0;
+	device->wdog.recoveries = 0;
+	device->bass = 0;
+	device->clock = 0;
+	device->group.num = 0;
+	device->group.armed = 0;
+	device->group.pending = 0;
+	device->tune.next = jiffies;
+	device->tune.ref = -1;
+	device->tune.valid = 0;
+	device->tune.offset = 0;
+	device->tune.drift = 0;
+	device->tune.ratetune = 0;
+	device->fanout = 0;
+	device->writer = device;
+	INIT_LIST_HEAD(&device->list);
+
+	device->dev = dev;
 
 	/* initialize mutex */
-	mutex_init(&vs10xx_device[id].lock);
+	mutex_init(&device->lock);
+	atomic_set(&device->ctrlreq, 0);
+	spin_lock_init(&device->ctrllock);
+	vs10xx_hist_clear(&device->ctrlwait);
+
+	/* initialize wait queues */
+	init_waitqueue_head(&device->wq);
+	init_waitqueue_head(&device->pollq);
+
+	/* initialize event lock */
+	spin_lock_init(&device->evlock);
+
+	/* device thread affinity, kthreads start on all cpus */
+	if (!zalloc_cpumask_var(&device->cpus, GFP_KERNEL)) {
+		vs10xx_err("id:%d zalloc_cpumask_var", device->id);
+		status = -1;
+	} else {
+		cpumask_copy(device->cpus, cpu_possible_mask);
+	}
+
+	if (status == 0) {
+		/* init stats, the io path adds its fault files to their debugfs directory */
+		status = vs10xx_stats_init(id, &device->stats);
+	}
 
-	/* initialize wait queue */
-	init_waitqueue_head(&vs10xx_device[id].wq);
+	if (status == 0) {
+		/* init io path */
+		status = vs10xx_io_init(chip, device->stats);
+	}
+
+	if (status == 0) {
+		/* init queue */
+		status = vs10xx_queue_init(id, device->stats, &device->queue);
+	}
+
+	if (status == 0) {
+		/* allocate status page, reserved so it can be remapped to userspace */
+		device->page = (struct vs10xx_status *)get_zeroed_page(GFP_KERNEL);
+		if (device->page == NULL) {
+			vs10xx_err("id:%d get_zeroed_page", device->id);
+			status = -1;
+		} else {
+			SetPageReserved(virt_to_page(device->page));
+		}
+	}
 
-	/* reset device */
-	status = vs10xx_device_reset(id);
+	if (status == 0) {
+		/* reset device */
+		status = vs10xx_device_reset(device);
+	}
 
 	if (status == 0) {
 
 		/* start device thread */
-		vs10xx_device[id].kthread = kthread_run(vs10xx_device_kthread, &vs10xx_device[id], "%s-%d", VS10XX_NAME, id);
+		device->kthread = kthread_run(vs10xx_device_kthread, device, "%s-%d", VS10XX_NAME, id);
 
-		if (vs10xx_device[id].kthread == NULL) {
+		if (device->kthread == NULL) {
 
-			vs10xx_err("id:%d kthread_run", id);
+			vs10xx_err("id:%d kthread_run", device->id);
 			status = -1;
+
+		} else if (rtprio > 0 && vs10xx_device_policy(device->kthread, SCHED_FIFO, MIN(rtprio, MAX_RT_PRIO - 1)) < 0) {
+
+			/* still works, just without the priority */
+			vs10xx_wrn("id:%d rtprio:%d not set", device->id, rtprio);
 		}
 	}
 
 	if (status == 0) {
 
 		/* flag valid */
-		vs10xx_device[id].valid = 1;
+		device->valid = 1;
+
+		mutex_lock(&vs10xx_device_listlock);
+		list_add_tail(&device->list, &vs10xx_devices);
+		mutex_unlock(&vs10xx_device_listlock);
 	}
 
-	vs10xx_dbg("done:%d", id);
+	vs10xx_dbg("done:%d", device->id);
 
 	return status;
 }
 
-void vs10xx_device_exit(int id) {
+void vs10xx_device_stop(struct vs10xx_device_t *device) {
+/*
+ *  Descr:  Stop the device thread. The threads look at the other members of their groups, so all
+ *          of them are stopped before the first device goes.
+ *  Return: -
+ */
 
-	if (vs10xx_device_isvalid(id)) {
+	if (vs10xx_device_isvalid(device)) {
 
 		/* reset device */
-		vs10xx_device_hwreset(id);
+		vs10xx_device_hwreset(device);
 
-		if (vs10xx_device[id].kthread != NULL) {
+		if (device->kthread != NULL) {
 
 			/* stop device thread */
-			kthread_stop(vs10xx_device[id].kthread);
+			kthread_stop(device->kthread);
 		}
-	}
 
-	vs10xx_device[id].valid = 0;
+		device->valid = 0;
+	}
 }
 
+void vs10xx_device_exit(struct vs10xx_device_t *device) {
+
+	if (device == NULL) {
+		return;
+	}
+
+	vs10xx_device_stop(device);
+
+	mutex_lock(&vs10xx_device_listlock);
+	list_del_init(&device->list);
+	mutex_unlock(&vs10xx_device_listlock);
+
+	if (device->page != NULL) {
+
+		/* release status page */
+		ClearPageReserved(virt_to_page(device->page));
+		free_page((unsigned long)device->page);
+		device->page = NULL;
+	}
+
+	free_cpumask_var(device->cpus);
+
+	/* exit queue */
+	vs10xx_queue_exit(device->queue);
+
+	/* exit io */
+	vs10xx_io_exit(device->chip);
+
+	/* exit stats */
+	vs10xx_stats_exit(device->stats);
+
+	kfree(device);
+}
@@ -20,35 +20,72 @@
 #ifndef VS10XX_DEVICE_H
 #define VS10XX_DEVICE_H
 
-int vs10xx_device_init(int id, struct device *dev);
-void vs10xx_device_exit(int id);
+#include <linux/poll.h>
+#include <linux/mm.h>
 
-int vs10xx_device_open(int id);
-int vs10xx_device_release(int id);
-int vs10xx_device_write(int id);
+/* the files and the sysfs nodes hold the context, the functions below take it */
+struct vs10xx_device_t;
+struct vs10xx_stats_dev_t;
+struct vs10xx_chip;
+struct device;
 
-int vs10xx_device_isvalid(int id);
-int vs10xx_device_status(int id, char* buf);
+int vs10xx_device_init(int id, struct vs10xx_chip *chip, struct device *dev, struct vs10xx_device_t **device);
+void vs10xx_device_stop(struct vs10xx_device_t *device);
+void vs10xx_device_exit(struct vs10xx_device_t *device);
 
-struct vs10xx_queue_buf_t* vs10xx_device_getbuf(int id);
-int vs10xx_device_getfree(int id);
+int vs10xx_device_open(struct vs10xx_device_t *device);
+int vs10xx_device_release(struct vs10xx_device_t *device);
+int vs10xx_device_write(struct vs10xx_device_t *device);
 
-int vs10xx_device_reset(int id);
+int vs10xx_device_isvalid(struct vs10xx_device_t *device);
+struct vs10xx_device_t *vs10xx_device_get(int id);
+int vs10xx_device_id(const struct vs10xx_device_t *device);
+struct vs10xx_stats_dev_t *vs10xx_device_stats(const struct vs10xx_device_t *device);
+int vs10xx_device_status(struct vs10xx_device_t *device, char* buf);
+int vs10xx_device_ctrlwait(struct vs10xx_device_t *device, char* buf);
+int vs10xx_device_drift(struct vs10xx_device_t *device, char* buf);
+void vs10xx_device_clrctrlwait(struct vs10xx_device_t *device);
+int vs10xx_device_sched(struct vs10xx_device_t *device, char* buf);
+int vs10xx_device_setsched(struct vs10xx_device_t *device, const char* buf);
+int vs10xx_device_cpus(struct vs10xx_device_t *device, char* buf);
+int vs10xx_device_setcpus(struct vs10xx_device_t *device, const char* buf);
 
-int vs10xx_device_sinetest(int id);
-int vs10xx_device_memtest(int id);
+struct vs10xx_queue_buf_t* vs10xx_device_getbuf(struct vs10xx_device_t *device);
+int vs10xx_device_getfree(struct vs10xx_device_t *device);
+int vs10xx_device_getlevel(struct vs10xx_device_t *device);
 
-int vs10xx_device_getscireg(int id, struct vs10xx_scireg *scireg);
-int vs10xx_device_setscireg(int id, struct vs10xx_scireg *scireg);
+int vs10xx_device_reset(struct vs10xx_device_t *device);
+int vs10xx_device_flush(struct vs10xx_device_t *device);
+int vs10xx_device_cancel(struct vs10xx_device_t *device);
+int vs10xx_device_seek(struct vs10xx_device_t *device);
 
-int vs10xx_device_getclockf(int id, struct vs10xx_clockf *clkf);
-int vs10xx_device_setclockf(int id, struct vs10xx_clockf *clkf);
+int vs10xx_device_sinetest(struct vs10xx_device_t *device);
+int vs10xx_device_memtest(struct vs10xx_device_t *device);
 
-int vs10xx_device_getvolume(int id, struct vs10xx_volume *volume);
-int vs10xx_device_setvolume(int id, struct vs10xx_volume *volume);
-int vs10xx_device_gettone(int id, struct vs10xx_tone *tone);
-int vs10xx_device_settone(int id, struct vs10xx_tone *tone);
+int vs10xx_device_getscireg(struct vs10xx_device_t *device, struct vs10xx_scireg *scireg);
+int vs10xx_device_setscireg(struct vs10xx_device_t *device, struct vs10xx_scireg *scireg);
+int vs10xx_device_scibatch(struct vs10xx_device_t *device, struct vs10xx_scibatch *scibatch);
 
-int vs10xx_device_getinfo(int id, struct vs10xx_info *info);
+int vs10xx_device_getclockf(struct vs10xx_device_t *device, struct vs10xx_clockf *clkf);
+int vs10xx_device_setclockf(struct vs10xx_device_t *device, struct vs10xx_clockf *clkf);
+
+int vs10xx_device_getvolume(struct vs10xx_device_t *device, struct vs10xx_volume *volume);
+int vs10xx_device_setvolume(struct vs10xx_device_t *device, struct vs10xx_volume *volume);
+int vs10xx_device_setramp(struct vs10xx_device_t *device, struct vs10xx_ramp *ramp);
+int vs10xx_device_gettone(struct vs10xx_device_t *device, struct vs10xx_tone *tone);
+int vs10xx_device_settone(struct vs10xx_device_t *device, struct vs10xx_tone *tone);
+
+int vs10xx_device_getinfo(struct vs10xx_device_t *device, struct vs10xx_info *info);
+int vs10xx_device_getevents(struct vs10xx_device_t *device, struct vs10xx_events *events);
+
+unsigned int vs10xx_device_poll(struct vs10xx_device_t *device, struct file *file, poll_table *wait);
+int vs10xx_device_mmap(struct vs10xx_device_t *device, struct vm_area_struct *vma);
+int vs10xx_device_getdelay(struct vs10xx_device_t *device, struct vs10xx_delay *delay);
+int vs10xx_device_finish(struct vs10xx_device_t *device);
+int vs10xx_device_setrebuf(struct vs10xx_device_t *device, struct vs10xx_rebuf *rebuf);
+int vs10xx_device_setgroup(struct vs10xx_device_t *device, struct vs10xx_group *group);
+int vs10xx_device_groupstart(struct vs10xx_device_t *device, struct vs10xx_groupstart *groupstart);
+int vs10xx_device_setfanout(struct vs10xx_device_t *device, struct vs10xx_fanout *fanout);
+int vs10xx_device_move(struct vs10xx_device_t *device, struct vs10xx_move *move);
 
 #endif
@@ -19,11 +19,16 @@
 
 #include "vs10xx_common.h"
 #include "vs10xx_iocomm.h"
+#include "vs10xx_stats.h"
+#include "vs10xx_device.h"
+#include "vs10xx_trace.h"
 
 #include <linux/gpio.h>
+#include <linux/slab.h>
 #include <linux/delay.h>
 #include <linux/spi/spi.h>
 #include <linux/interrupt.h>
+#include <linux/debugfs.h>
 
 /* interrupt mode */
 static int irqmode = 1;
@@ -37,90 +42,220 @@ module_param(skipdreq, int, 0644);
 static int hwreset = 0;
 module_param(hwreset, int, 0644);
 
+/* injected faults, set through debugfs */
+struct vs10xx_chip_fault {
+	u32 spifail;   /* fail the next n spi messages   */
+	u32 dreqstuck; /* dreq reads low while set       */
+	u32 scigarble; /* garble the next n sci reads    */
+	struct dentry *dir;
+};
+
 struct vs10xx_chip {
+	int id;
+	struct list_head list;
+	struct vs10xx_stats_dev_t *stats;
 	int dreq_val;
+	int dreq_rise;
+	ktime_t dreq_time;
+	ktime_t dreq_wake;
 	int gpio_reset;
 	int gpio_dreq;
 	int irq_dreq;
 	struct spi_device *spi_ctrl;
 	struct spi_device *spi_data;
 	wait_queue_head_t wq;
-};
+	struct vs10xx_chip_fault fault;
+	/* for vs10xx_io_ctrl_xfv, sci transfers are serialised by the device lock */
+	struct spi_transfer xfv[2 * VS10XX_SCI_MAXOPS];
+} ____cacheline_aligned;
 
-static struct vs10xx_chip vs10xx_chips[VS10XX_MAX_DEVICES];
+/* allocated when the first spi device of a chip is probed, freed by vs10xx_io_unregister */
+static LIST_HEAD(vs10xx_chips);
+
+/* called once both spi devices of a chip are there, see vs10xx_io_register */
+static int (*vs10xx_io_attach)(struct vs10xx_chip *chip, int id);
+
+/* probes may run concurrently */
+static DEFINE_MUTEX(vs10xx_io_lock);
 
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 /* VS10XX SPI MISC                                                                                                               */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
+static int vs10xx_io_fault(u32 *count) {
+/*
+ *  Descr:  Consume one injected fault
+ *  Return: 1 --> fail this operation
+ *          0 --> no fault pending
+ */
+
+	if (ACCESS_ONCE(*count) == 0) {
+		return 0;
+	}
+
+	(*count)--;
+
+	return 1;
+}
+
+static int vs10xx_io_spi_sync(struct vs10xx_chip *chip, struct spi_device *device, struct spi_message *mesg) {
+/*
+ *  Descr:  spi_sync, unless a spi failure is injected
+ *  Return: spi_sync status
+ */
+
+	int status;
+
+	if (vs10xx_io_fault(&chip->fault.spifail)) {
+		status = -EIO;
+	} else {
+		status = spi_sync(device, mesg);
+	}
+
+	if (status < 0) {
+		vs10xx_stats_inc(chip->stats, spi_errors);
+	}
+
+	return status;
+}
+
+static void vs10xx_io_garble(struct vs10xx_chip *chip, char *rxbuf, unsigned rxlen) {
+/*
+ *  Descr:  Flip the bits of a register read when a garbled read is injected
+ *  Return: -
+ */
+
+	unsigned i;
+
+	if (vs10xx_io_fault(&chip->fault.scigarble)) {
+		for (i = 0; i < rxlen; i++) {
+			rxbuf[i] ^= 0xA5;
+		}
+	}
+}
+
 static irqreturn_t vs10xx_io_irq(int irq, void *arg) {
 /*
  *  Descr:  interrupt handler, record DREQ value and wakeup waiting task
  *  Return: irq handled
  */
 
-	int id = (int)arg;
+	struct vs10xx_chip *chip = arg;
+
+	vs10xx_stats_inc(chip->stats, irqs);
 
-	vs10xx_chips[id].dreq_val = gpio_get_value(vs10xx_chips[id].gpio_dreq);
+	chip->dreq_val = gpio_get_value(chip->gpio_dreq);
 
-	if (vs10xx_chips[id].dreq_val) {
-		wake_up(&vs10xx_chips[id].wq);
+	trace_vs10xx_io_irq(chip->id, chip->dreq_val);
+
+	if (chip->dreq_val) {
+		/* refill latency is measured from here */
+		if (!chip->dreq_rise) {
+			chip->dreq_time = ktime_get();
+			chip->dreq_rise = 1;
+		}
+		/* wakeup latency from the latest edge */
+		chip->dreq_wake = ktime_get();
+		wake_up(&chip->wq);
 	}
 
 	return IRQ_HANDLED;
 }
 
-int vs10xx_io_isready(int id) {
+int vs10xx_io_isready(struct vs10xx_chip *chip) {
 /*
  *  Descr:  Test if DREQ is high
  *  Return: 1 --> DREQ is high (ready)
  *          0 --> DREQ is low (busy)
  */
 
-	int dreq_val = (irqmode ? vs10xx_chips[id].dreq_val : gpio_get_value(vs10xx_chips[id].gpio_dreq));
+	int dreq_val = (irqmode ? chip->dreq_val : gpio_get_value(chip->gpio_dreq));
 
-	vs10xx_nsy("id:%d dreq_val:%d", id, dreq_val);
+	if (ACCESS_ONCE(chip->fault.dreqstuck)) {
+		dreq_val = 0;
+	}
+
+	vs10xx_nsy("id:%d dreq_val:%d", chip->id, dreq_val);
 
 	return (skipdreq ? 1 : dreq_val);
 }
 
-int vs10xx_io_wtready(int id, unsigned timeout) {
+void vs10xx_io_idle(struct vs10xx_chip *chip) {
+/*
+ *  Descr:  The pump has nothing to send, a DREQ rise from here on is no refill request
+ *  Return: -
+ */
+
+	chip->dreq_rise = 0;
+}
+
+int vs10xx_io_wtready(struct vs10xx_chip *chip, unsigned timeout) {
 /*
  *  Descr:  Wait timeout [msec] for DREQ to become high
  *  Return: 1 --> DREQ is high (ready)
  *          0 --> timeout (busy)
  */
 
+	int ready;
+
 	if (irqmode) {
 
-		if (!vs10xx_chips[id].dreq_val) {
+		if (!vs10xx_io_isready(chip)) {
+
+			vs10xx_stats_inc(chip->stats, dreq_waits);
+
+			wait_event_timeout(chip->wq, vs10xx_io_isready(chip), msecs_to_jiffies(timeout));
 
-			wait_event_timeout(vs10xx_chips[id].wq, vs10xx_chips[id].dreq_val, msecs_to_jiffies(timeout));
+			if (vs10xx_io_isready(chip)) {
+				/* dreq rose while waiting, the edge woke us */
+				vs10xx_stats_latency(chip->stats, VS10XX_LAT_WAKE, chip->dreq_wake);
+			}
 		}
 
 	} else {
 
 		unsigned long end = jiffies + msecs_to_jiffies(timeout);
+		ktime_t due = ktime_set(0, 0);
+
+		if (!vs10xx_io_isready(chip)) {
 
-		while ( !vs10xx_io_isready(id) && (jiffies < end) ) {
+			vs10xx_stats_inc(chip->stats, dreq_waits);
+		}
+
+		while ( !vs10xx_io_isready(chip) && (jiffies < end) ) {
 
+			due = ktime_add_us(ktime_get(), 1000);
 			msleep(1);
 		}
+
+		if (ktime_to_ns(due) != 0 && vs10xx_io_isready(chip)) {
+
+			/* one sample per wait: dreq rose during the last sleep at the latest, timer
+			   rounding plus the time the thread waited for a cpu */
+			vs10xx_stats_latency(chip->stats, VS10XX_LAT_WAKE, due);
+		}
 	}
 
-	return vs10xx_io_isready(id);
+	ready = vs10xx_io_isready(chip);
+
+	if (!ready) {
+
+		vs10xx_stats_inc(chip->stats, dreq_timeouts);
+	}
+
+	return ready;
 }
 
-void vs10xx_io_reset(int id) {
+void vs10xx_io_reset(struct vs10xx_chip *chip) {
 /*
  *  Descr:  Reset by pulling down gpio
  *  Return: -
  */
 
 	if (hwreset) {
-		gpio_set_value(vs10xx_chips[id].gpio_reset, 0);
+		gpio_set_value(chip->gpio_reset, 0);
 		udelay(50);
-		gpio_set_value(vs10xx_chips[id].gpio_reset, 1);
+		gpio_set_value(chip->gpio_reset, 1);
 		udelay(1800);
 	}
 }
@@ -129,12 +264,13 @@ void vs10xx_io_reset(int id) {
 /* VS10XX SPI TRANSFER                                                                                                           */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
-int vs10xx_io_ctrl_xf(int id, const char *txbuf, unsigned txlen, char *rxbuf, unsigned rxlen) {
+int vs10xx_io_ctrl_xf(struct vs10xx_chip *chip, const char *txbuf, unsigned txlen, char *rxbuf, unsigned rxlen) {
 
-	struct spi_device *device = vs10xx_chips[id].spi_ctrl;
+	struct spi_device *device = chip->spi_ctrl;
 	struct spi_message	spi_mesg;
 	struct spi_transfer	spi_xfer_tx;
 	struct spi_transfer	spi_xfer_rx;
+	ktime_t start;
 	int status = 0;
 
 	spi_message_init(&spi_mesg);
@@ -155,17 +291,71 @@ int vs10xx_io_ctrl_xf(int id, const char *txbuf, unsigned txlen, char *rxbuf, un
 		spi_message_add_tail(&spi_xfer_rx, &spi_mesg);
 	}
 
-	status = spi_sync(device, &spi_mesg);
+	start = ktime_get();
+	status = vs10xx_io_spi_sync(chip, device, &spi_mesg);
+	trace_vs10xx_io_ctrl_xf(chip->id, txlen, rxlen, 1, status, ktime_to_ns(start));
+	vs10xx_stats_latency(chip->stats, VS10XX_LAT_SPI, start);
+	vs10xx_stats_inc(chip->stats, spi_xfers);
+	if (status < 0) {
+		vs10xx_err("id:%d spi_sync failed", chip->id);
+	} else if (rxbuf) {
+		vs10xx_io_garble(chip, rxbuf, rxlen);
+	}
+
+	return status;
+}
+
+int vs10xx_io_ctrl_xfv(struct vs10xx_chip *chip, const char *txbuf, unsigned txlen, char *rxbuf, unsigned rxlen, unsigned n) {
+/*
+ *  Descr:  Transfer n consecutive commands of txlen/rxlen bytes in one spi message,
+ *          chip select is toggled between the commands
+ *  Return: spi_sync status
+ */
+
+	struct spi_device *device = chip->spi_ctrl;
+	struct spi_message	spi_mesg;
+	struct spi_transfer	*spi_xfer = chip->xfv;
+	ktime_t start;
+	unsigned i;
+	int status = 0;
+
+	if (n == 0 || n > VS10XX_SCI_MAXOPS) {
+		return -EINVAL;
+	}
+
+	memset(spi_xfer, 0, 2 * n * sizeof *spi_xfer);
+	spi_message_init(&spi_mesg);
+
+	for (i = 0; i < n; i++) {
+
+		spi_xfer[2*i].tx_buf = txbuf + i * txlen;
+		spi_xfer[2*i].len = txlen;
+		spi_message_add_tail(&spi_xfer[2*i], &spi_mesg);
+
+		spi_xfer[2*i+1].rx_buf = rxbuf + i * rxlen;
+		spi_xfer[2*i+1].len = rxlen;
+		spi_xfer[2*i+1].delay_usecs = 10;
+		spi_xfer[2*i+1].cs_change = (i < n - 1) ? 1 : 0;
+		spi_message_add_tail(&spi_xfer[2*i+1], &spi_mesg);
+	}
+
+	start = ktime_get();
+	status = vs10xx_io_spi_sync(chip, device, &spi_mesg);
+	trace_vs10xx_io_ctrl_xf(chip->id, txlen, rxlen, n, status, ktime_to_ns(start));
+	vs10xx_stats_latency(chip->stats, VS10XX_LAT_SPI, start);
+	vs10xx_stats_inc(chip->stats, spi_xfers);
 	if (status < 0) {
-		vs10xx_err("id:%d spi_sync failed", id);
+		vs10xx_err("id:%d spi_sync failed", chip->id);
+	} else {
+		vs10xx_io_garble(chip, rxbuf, n * rxlen);
 	}
 
 	return status;
 }
 
-int vs10xx_io_data_rx(int id, char *rxbuf, unsigned rxlen) {
+int vs10xx_io_data_rx(struct vs10xx_chip *chip, char *rxbuf, unsigned rxlen) {
 
-	struct spi_device *device = vs10xx_chips[id].spi_data;
+	struct spi_device *device = chip->spi_data;
 	struct spi_message	spi_mesg;
 	struct spi_transfer	spi_xfer_rx;
 	int status = 0;
@@ -178,19 +368,21 @@ int vs10xx_io_data_rx(int id, char *rxbuf, unsigned rxlen) {
 	//spi_xfer_rx.delay_usecs = 0;
 	spi_message_add_tail(&spi_xfer_rx, &spi_mesg);
 
-	status = spi_sync(device, &spi_mesg);
+	status = vs10xx_io_spi_sync(chip, device, &spi_mesg);
+	vs10xx_stats_inc(chip->stats, spi_xfers);
 	if (status < 0) {
-		vs10xx_err("id:%d spi_sync failed", id);
+		vs10xx_err("id:%d spi_sync failed", chip->id);
 	}
 
 	return status;
 }
 
-int vs10xx_io_data_tx(int id, const char *txbuf, unsigned txlen) {
+int vs10xx_io_data_tx(struct vs10xx_chip *chip, const char *txbuf, unsigned txlen) {
 
-	struct spi_device *device = vs10xx_chips[id].spi_data;
+	struct spi_device *device = chip->spi_data;
 	struct spi_message	spi_mesg;
 	struct spi_transfer	spi_xfer_tx;
+	ktime_t start;
 	int status = 0;
 
 	spi_message_init(&spi_mesg);
@@ -201,9 +393,20 @@ int vs10xx_io_data_tx(int id, const char *txbuf, unsigned txlen) {
 	//spi_xfer_tx.delay_usecs = 0;
 	spi_message_add_tail(&spi_xfer_tx, &spi_mesg);
 
-	status = spi_sync(device, &spi_mesg);
+	start = ktime_get();
+	if (chip->dreq_rise) {
+		/* first transfer since dreq went high */
+		chip->dreq_rise = 0;
+		vs10xx_stats_latency(chip->stats, VS10XX_LAT_REFILL, chip->dreq_time);
+	}
+	status = vs10xx_io_spi_sync(chip, device, &spi_mesg);
+	trace_vs10xx_io_data_tx(chip->id, txlen, status, ktime_to_ns(start));
+	vs10xx_stats_latency(chip->stats, VS10XX_LAT_SPI, start);
+	vs10xx_stats_inc(chip->stats, spi_xfers);
 	if (status < 0) {
-		vs10xx_err("id:%d spi_sync failed", id);
+		vs10xx_err("id:%d spi_sync failed", chip->id);
+	} else {
+		vs10xx_stats_xfer(chip->stats, txlen);
 	}
 
 	return status;
@@ -213,32 +416,79 @@ int vs10xx_io_data_tx(int id, const char *txbuf, unsigned txlen) {
 /* VS10XX SPI PROBES                                                                                                             */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
-static int vs10xx_spi_ctrl_probe(struct spi_device *spi) {
+static struct vs10xx_chip *vs10xx_spi_chip(struct vs10xx_board_info* boardinfo, const char *name) {
+/*
+ *  Descr:  Look up the chip of a probed spi device, the first of its two devices allocates it.
+ *          The caller holds vs10xx_io_lock.
+ *  Return: chip or NULL
+ */
 
-	int status = 0;
-	struct vs10xx_board_info* boardinfo = (struct vs10xx_board_info*) spi->dev.platform_data;
+	struct vs10xx_chip *chip;
+	int id;
 
 	if (boardinfo == NULL) {
-		vs10xx_err("no board info provided for vs10xx-ctrl device");
-		status = -1;
+		vs10xx_err("no board info provided for %s device", name);
+		return NULL;
 	}
 
-	if (status == 0) {
-		if (boardinfo->device_id < 0 || boardinfo->device_id >= VS10XX_MAX_DEVICES) {
-			vs10xx_err("id out of range:%d", boardinfo->device_id);
-			status = -1;
+	id = boardinfo->device_id;
+
+	if (id < 0) {
+		vs10xx_err("id out of range:%d", id);
+		return NULL;
+	}
+
+	list_for_each_entry(chip, &vs10xx_chips, list) {
+		if (chip->id == id) {
+			return chip;
 		}
 	}
 
+	chip = kzalloc(sizeof(struct vs10xx_chip), GFP_KERNEL);
+
+	if (chip == NULL) {
+		vs10xx_err("id:%d kzalloc chip", id);
+	} else {
+		chip->id = id;
+		list_add_tail(&chip->list, &vs10xx_chips);
+	}
+
+	return chip;
+}
+
+static int vs10xx_spi_ctrl_probe(struct spi_device *spi) {
+
+	int status = 0;
+	struct vs10xx_board_info* boardinfo = (struct vs10xx_board_info*) spi->dev.platform_data;
+	struct vs10xx_chip *chip;
+
+	mutex_lock(&vs10xx_io_lock);
+
+	chip = vs10xx_spi_chip(boardinfo, VS10XX_SPI_CTRL);
+
+	if (chip == NULL) {
+		status = -1;
+	}
+
 	if (status == 0) {
-		vs10xx_chips[boardinfo->device_id].spi_ctrl = spi;
-		vs10xx_chips[boardinfo->device_id].gpio_reset = boardinfo->gpio_reset;
-		vs10xx_chips[boardinfo->device_id].gpio_dreq = boardinfo->gpio_dreq;
+		chip->spi_ctrl = spi;
+		chip->gpio_reset = boardinfo->gpio_reset;
+		chip->gpio_dreq = boardinfo->gpio_dreq;
 
 		vs10xx_inf("id:%d ctrl spi:%d.%d gpio_reset:%d gpio_dreq:%d",
 			boardinfo->device_id, spi->master->bus_num, spi->chip_select, boardinfo->gpio_reset, boardinfo->gpio_dreq);
+
+		/* the device comes up with its second spi device */
+		if (chip->spi_data != NULL) {
+			status = vs10xx_io_attach(chip, chip->id);
+			if (status < 0) {
+				chip->spi_ctrl = NULL;
+			}
+		}
 	}
 
+	mutex_unlock(&vs10xx_io_lock);
+
 	return status;
 }
 
@@ -257,26 +507,33 @@ static int vs10xx_spi_data_probe(struct spi_device *spi) {
 
 	int status = 0;
 	struct vs10xx_board_info* boardinfo = (struct vs10xx_board_info*) spi->dev.platform_data;
+	struct vs10xx_chip *chip;
 
-	if (boardinfo == NULL) {
-		vs10xx_err("no board info provided for vs10xx-data device");
-		status = -1;
-	}
+	mutex_lock(&vs10xx_io_lock);
 
-	if (status == 0) {
-		if (boardinfo->device_id < 0 || boardinfo->device_id >= VS10XX_MAX_DEVICES) {
-			vs10xx_err("id out of range:%d", boardinfo->device_id);
-			status = -1;
-		}
+	chip = vs10xx_spi_chip(boardinfo, VS10XX_SPI_DATA);
+
+	if (chip == NULL) {
+		status = -1;
 	}
 
 	if (status == 0) {
-		vs10xx_chips[boardinfo->device_id].spi_data = spi;
+		chip->spi_data = spi;
 
 		vs10xx_inf("id:%d data spi:%d.%d gpio_reset:%d gpio_dreq:%d",
 			boardinfo->device_id, spi->master->bus_num, spi->chip_select, boardinfo->gpio_reset, boardinfo->gpio_dreq);
+
+		/* the device comes up with its second spi device */
+		if (chip->spi_ctrl != NULL) {
+			status = vs10xx_io_attach(chip, chip->id);
+			if (status < 0) {
+				chip->spi_data = NULL;
+			}
+		}
 	}
 
+	mutex_unlock(&vs10xx_io_lock);
+
 	return status;
 }
 
@@ -295,10 +552,17 @@ static struct spi_driver vs10xx_spi_data = {
 /* VS10XX IO REG/UNREG                                                                                                           */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
-int vs10xx_io_register(void) {
+int vs10xx_io_register(int (*attach)(struct vs10xx_chip *chip, int id)) {
+/*
+ *  Descr:  Register the spi drivers. Each chip whose ctrl and data devices are probed, now or
+ *          later, is handed to attach, which sets up the device on top of it.
+ *  Return: status
+ */
 
 	int s1 = 0, s2 = 0;
 
+	vs10xx_io_attach = attach;
+
 	/* register vs10xx ctrl spi driver */
 	s1 = spi_register_driver(&vs10xx_spi_ctrl);
 	if (s1 < 0) {
@@ -317,110 +581,125 @@ int vs10xx_io_register(void) {
 
 void vs10xx_io_unregister(void) {
 
+	struct vs10xx_chip *chip, *n;
+
 	/* unregister spi devices */
 	spi_unregister_driver(&vs10xx_spi_ctrl);
 	spi_unregister_driver(&vs10xx_spi_data);
+
+	/* the devices are gone, vs10xx_io_exit was called for each */
+	list_for_each_entry_safe(chip, n, &vs10xx_chips, list) {
+		list_del(&chip->list);
+		kfree(chip);
+	}
 }
 
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 /* VS10XX IO INIT/EXIT                                                                                                           */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
-int vs10xx_io_init(int id) {
+int vs10xx_io_init(struct vs10xx_chip *chip, struct vs10xx_stats_dev_t *stats) {
 
-	struct vs10xx_chip *chip;
 	int status = -1;
 
-	if (id < 0 || id >= VS10XX_MAX_DEVICES) {
-
-		vs10xx_err("id:%d out of range", id);
+	chip->stats = stats;
 
-	} else {
+	if (chip->spi_ctrl == NULL || chip->spi_data == NULL) {
 
-		chip = &vs10xx_chips[id];
+		vs10xx_dbg("id:%d no board config", chip->id);
 
-		if (chip->spi_ctrl == NULL || chip->spi_data == NULL) {
+	} else {
 
-			vs10xx_dbg("id:%d no board config", id);
+		/* initialize wait queue */
+		init_waitqueue_head(&chip->wq);
 
-		} else {
+		/* request reset signal */
+		status = gpio_request(chip->gpio_reset, "vs10xx_reset");
+		if (status < 0) {
+			vs10xx_err("gpio_request gpio_reset:%d", chip->gpio_reset);
+			chip->gpio_reset = -1;
+		}
 
-			/* initialize wait queue */
-			init_waitqueue_head(&chip->wq);
+		if (status == 0) {
+			/* set gpio_reset as output, keep vs10xx in reset */
+			status = gpio_direction_output(chip->gpio_reset, (hwreset ? 0 : 1));
+			if (status < 0) {
+				vs10xx_err("gpio_direction_output gpio_reset:%d", chip->gpio_reset);
+			} else {
+				gpio_set_value(chip->gpio_reset, (hwreset ? 0 : 1));
+			}
+		}
 
-			/* request reset signal */
-			status = gpio_request(chip->gpio_reset, "vs10xx_reset");
+		if (status == 0) {
+			/* request dreq signal */
+			status = gpio_request(chip->gpio_dreq, "vs10xx_dreq");
 			if (status < 0) {
-				vs10xx_err("gpio_request gpio_reset:%d", chip->gpio_reset);
-				chip->gpio_reset = -1;
+				vs10xx_err("gpio_request gpio_dreq:%d", chip->gpio_dreq);
+				chip->gpio_dreq = -1;
 			}
+		}
 
-			if (status == 0) {
-				/* set gpio_reset as output, keep vs10xx in reset */
-				status = gpio_direction_output(chip->gpio_reset, (hwreset ? 0 : 1));
-				if (status < 0) {
-					vs10xx_err("gpio_direction_output gpio_reset:%d", chip->gpio_reset);
-				} else {
-					gpio_set_value(chip->gpio_reset, (hwreset ? 0 : 1));
-				}
+		if (status == 0) {
+			/* set gpio_dreq as input */
+			status = gpio_direction_input(chip->gpio_dreq);
+			if (status < 0) {
+				vs10xx_err("gpio_direction_input gpio_dreq:%d", chip->gpio_dreq);
+			} else {
+				chip->dreq_val = gpio_get_value(chip->gpio_dreq);
 			}
+		}
 
+		if (irqmode) {
 			if (status == 0) {
-				/* request dreq signal */
-				status = gpio_request(chip->gpio_dreq, "vs10xx_dreq");
-				if (status < 0) {
-					vs10xx_err("gpio_request gpio_dreq:%d", chip->gpio_dreq);
-					chip->gpio_dreq = -1;
+				/* request dreq irq */
+				chip->irq_dreq = gpio_to_irq(chip->gpio_dreq);
+				if (chip->irq_dreq < 0) {
+					vs10xx_err("gpio_to_irq gpio_dreq:%d", chip->gpio_dreq);
+					status = -1;
 				}
 			}
 
 			if (status == 0) {
-				/* set gpio_dreq as input */
-				status = gpio_direction_input(chip->gpio_dreq);
+				/* request irq for gpio_dreq */
+				status = request_irq(chip->irq_dreq, vs10xx_io_irq, IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING, VS10XX_NAME, chip);
 				if (status < 0) {
-					vs10xx_err("gpio_direction_input gpio_dreq:%d", chip->gpio_dreq);
-				} else {
-					chip->dreq_val = gpio_get_value(chip->gpio_dreq);
-				}
-			}
-
-			if (irqmode) {
-				if (status == 0) {
-					/* request dreq irq */
-					chip->irq_dreq = gpio_to_irq(chip->gpio_dreq);
-					if (chip->irq_dreq < 0) {
-						vs10xx_err("gpio_to_irq gpio_dreq:%d", chip->gpio_dreq);
-						status = -1;
-					}
-				}
-
-				if (status == 0) {
-					/* request irq for gpio_dreq */
-					status = request_irq(chip->irq_dreq, vs10xx_io_irq, IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING, VS10XX_NAME, (void*)id);
-					if (status < 0) {
-						vs10xx_err("request_irq irq_dreq:%d", chip->irq_dreq);
-						chip->irq_dreq = -1;
-					}
+					vs10xx_err("request_irq irq_dreq:%d", chip->irq_dreq);
+					chip->irq_dreq = -1;
 				}
 			}
 		}
 	}
 
 	if (status == 0) {
-		vs10xx_inf("id:%d gpio_reset:%d gpio_dreq:%d irq_dreq:%d", id, chip->gpio_reset, chip->gpio_dreq, chip->irq_dreq);
+		vs10xx_inf("id:%d gpio_reset:%d gpio_dreq:%d irq_dreq:%d", chip->id, chip->gpio_reset, chip->gpio_dreq, chip->irq_dreq);
+	}
+
+	if (status == 0 && vs10xx_stats_dir(stats) != NULL) {
+
+		/* fault injection, debugfs vs10xx/vs10xx-<id>/fault */
+		memset(&chip->fault, 0, sizeof(chip->fault));
+		chip->fault.dir = debugfs_create_dir("fault", vs10xx_stats_dir(stats));
+
+		if (chip->fault.dir != NULL) {
+			debugfs_create_u32("spifail", 0644, chip->fault.dir, &chip->fault.spifail);
+			debugfs_create_u32("dreqstuck", 0644, chip->fault.dir, &chip->fault.dreqstuck);
+			debugfs_create_u32("scigarble", 0644, chip->fault.dir, &chip->fault.scigarble);
+		}
 	}
 
 	return status;
 }
 
-void vs10xx_io_exit(int id) {
+void vs10xx_io_exit(struct vs10xx_chip *chip) {
 
-	struct vs10xx_chip *chip = &vs10xx_chips[id];
+	if (chip == NULL) {
+		return;
+	}
 
 	/* release dreq irq */
 	if (irqmode && chip->irq_dreq > 0) {
 		synchronize_irq(chip->irq_dreq);
-		free_irq(chip->irq_dreq, (void*)id);
+		free_irq(chip->irq_dreq, chip);
 	}
 
 	/* free gpio dreq */
@@ -437,5 +716,8 @@ void vs10xx_io_exit(int id) {
 
 		gpio_free(chip->gpio_reset);
 	}
+
+	/* the fault files go with the stats directory */
+	memset(&chip->fault, 0, sizeof(chip->fault));
 }
 
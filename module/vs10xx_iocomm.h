@@ -20,18 +20,24 @@
 #ifndef VS10XX_IOCOMM_H
 #define VS10XX_IOCOMM_H
 
-int vs10xx_io_register(void);
+/* one per chip, allocated when its first spi device is probed */
+struct vs10xx_chip;
+struct vs10xx_stats_dev_t;
+
+int vs10xx_io_register(int (*attach)(struct vs10xx_chip *chip, int id));
 void vs10xx_io_unregister(void);
 
-int vs10xx_io_init(int id);
-void vs10xx_io_exit(int id);
+int vs10xx_io_init(struct vs10xx_chip *chip, struct vs10xx_stats_dev_t *stats);
+void vs10xx_io_exit(struct vs10xx_chip *chip);
 
-void vs10xx_io_reset(int id);
-int vs10xx_io_isready(int id);
-int vs10xx_io_wtready(int id, unsigned timeout);
+void vs10xx_io_reset(struct vs10xx_chip *chip);
+int vs10xx_io_isready(struct vs10xx_chip *chip);
+int vs10xx_io_wtready(struct vs10xx_chip *chip, unsigned timeout);
+void vs10xx_io_idle(struct vs10xx_chip *chip);
 
-int vs10xx_io_ctrl_xf(int id, const char *txbuf, unsigned txlen, char *rxbuf, unsigned rxlen);
-int vs10xx_io_data_rx(int id, char *rxbuf, unsigned rxlen);
-int vs10xx_io_data_tx(int id, const char *txbuf, unsigned txlen);
+int vs10xx_io_ctrl_xf(struct vs10xx_chip *chip, const char *txbuf, unsigned txlen, char *rxbuf, unsigned rxlen);
+int vs10xx_io_ctrl_xfv(struct vs10xx_chip *chip, const char *txbuf, unsigned txlen, char *rxbuf, unsigned rxlen, unsigned n);
+int vs10xx_io_data_rx(struct vs10xx_chip *chip, char *rxbuf, unsigned rxlen);
+int vs10xx_io_data_tx(struct vs10xx_chip *chip, const char *txbuf, unsigned txlen);
 
 #endif
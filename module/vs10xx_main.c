@@ -21,17 +21,91 @@
 #include "vs10xx_device.h"
 #include "vs10xx_queue.h"
 #include "vs10xx_iocomm.h"
+#include "vs10xx_stats.h"
+
+#define CREATE_TRACE_POINTS
+#include "vs10xx_trace.h"
 
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/uaccess.h>
 #include <linux/cdev.h>
+#include <linux/idr.h>
 #include <linux/kthread.h>
 #include <linux/delay.h>
 
+/* debug level, 1: debug, 2: noisy */
 static int debug = 0;
-int *vs10xx_debug = &debug;
-module_param(debug, int, 0644);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
+
+DEFINE_STATIC_KEY_FALSE(vs10xx_debug_dbg);
+DEFINE_STATIC_KEY_FALSE(vs10xx_debug_nsy);
+
+static void vs10xx_debug_update(void) {
+
+	if (debug > 0) {
+		static_branch_enable(&vs10xx_debug_dbg);
+	} else {
+		static_branch_disable(&vs10xx_debug_dbg);
+	}
+
+	if (debug > 1) {
+		static_branch_enable(&vs10xx_debug_nsy);
+	} else {
+		static_branch_disable(&vs10xx_debug_nsy);
+	}
+}
+
+#else
+
+int vs10xx_debug_dbg __read_mostly = 0;
+int vs10xx_debug_nsy __read_mostly = 0;
+
+static void vs10xx_debug_update(void) {
+
+	vs10xx_debug_dbg = (debug > 0);
+	vs10xx_debug_nsy = (debug > 1);
+}
+
+#endif
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,36)
+
+static int vs10xx_debug_set(const char *val, const struct kernel_param *kp) {
+
+	int status = param_set_int(val, kp);
+
+	if (status == 0) {
+		vs10xx_debug_update();
+	}
+
+	return status;
+}
+
+static const struct kernel_param_ops vs10xx_debug_ops = {
+	.set = vs10xx_debug_set,
+	.get = param_get_int,
+};
+
+module_param_cb(debug, &vs10xx_debug_ops, &debug, 0644);
+
+#else
+
+static int vs10xx_debug_set(const char *val, struct kernel_param *kp) {
+
+	int status = param_set_int(val, kp);
+
+	if (status == 0) {
+		vs10xx_debug_update();
+	}
+
+	return status;
+}
+
+module_param_call(debug, vs10xx_debug_set, param_get_int, &debug, 0644);
+
+#endif
 
 MODULE_DESCRIPTION("device driver for vs10xx");
 MODULE_AUTHOR("Richard van Paasen");
@@ -40,24 +114,40 @@ MODULE_LICENSE("GPL v2");
 static dev_t vs10xx_cdev_region;
 static struct cdev *vs10xx_cdev;
 
+/* device context per minor, minors are handed out as the chips are probed */
+static DEFINE_IDR(vs10xx_minors);
+
+/* number of minors, the devices beyond it are not attached */
+static int maxdevs = 32;
+module_param(maxdevs, int, 0444);
+
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 /* CHARDEV INTERFACE                                                                                                             */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
 static int vs10xx_open(struct inode *inode, struct file *file) {
 
-	int id = MINOR(inode->i_rdev);
+	struct vs10xx_device_t *device = idr_find(&vs10xx_minors, MINOR(inode->i_rdev));
+	int id = vs10xx_device_id(device);
 	int status = 0;
 
 	vs10xx_dbg("id:%d", id);
 
-	status = vs10xx_device_open(id);
+	if (!(file->f_mode & FMODE_WRITE)) {
+
+		/* read-only opens observe (status page, poll, reading ioctls) and do not claim the stream */
+		status = (vs10xx_device_isvalid(device) ? 0 : -1);
+
+	} else {
+
+		status = vs10xx_device_open(device);
+	}
 
 	if (status < 0) {
 		vs10xx_inf("id:%d not valid or already open", id);
 		status = -EACCES;
 	} else {
-		file->private_data = (void*)id;
+		file->private_data = device;
 	}
 
 	return status;
@@ -66,12 +156,15 @@ static int vs10xx_open(struct inode *inode, struct file *file) {
 
 static int vs10xx_release(struct inode *inode, struct file *file) {
 
-	int id = (int)file->private_data;
+	struct vs10xx_device_t *device = file->private_data;
+	int id = vs10xx_device_id(device);
 	int status = 0;
 
 	vs10xx_dbg("id:%d", id);
 
-	status = vs10xx_device_release(id);
+	if (file->f_mode & FMODE_WRITE) {
+		status = vs10xx_device_release(device);
+	}
 
 	if (status < 0) {
 		status = -EIO;
@@ -83,7 +176,8 @@ static int vs10xx_release(struct inode *inode, struct file *file) {
 
 static ssize_t vs10xx_write(struct file *file, const char __user *usrbuf, size_t lbuf, loff_t *ppos) {
 
-	int id = (int)file->private_data;
+	struct vs10xx_device_t *device = file->private_data;
+	int id = vs10xx_device_id(device);
 	int status = 0;
 
 	int nbytes = 0;
@@ -96,34 +190,86 @@ static ssize_t vs10xx_write(struct file *file, const char __user *usrbuf, size_t
 
 	do {
 
-		buffer = vs10xx_device_getbuf(id);
+		buffer = vs10xx_device_getbuf(device);
 
 		if ((buffer == NULL)) {
 
 			vs10xx_dbg("id:%d queue full", id);
-			msleep(1);
+			if (file->f_flags & O_NONBLOCK) {
+				/* writer polls for POLLOUT */
+				status = (copied ? 0 : -EAGAIN);
+			} else {
+				msleep(1);
+			}
 
 		} else {
 
 			acttodo = sizeof(buffer->data) > (lbuf-copied) ? (lbuf-copied) : sizeof(buffer->data);
 			nbytes = acttodo - copy_from_user(buffer->data, usrbuf+copied, acttodo);
 			buffer->len = nbytes;
-			status = vs10xx_device_write(id);
+			status = vs10xx_device_write(device);
 			copied += nbytes;
 		}
 
 	} while (copied < lbuf && buffer != NULL);
 
+	vs10xx_stats_add(vs10xx_device_stats(device), wr_bytes, copied);
+
+	trace_vs10xx_write(id, lbuf, copied, vs10xx_device_getlevel(device));
+
 	vs10xx_nsy("id:%d copied %d bytes", id, copied);
 
 	return (status < 0 ? status : copied);
 }
 
 
+static int vs10xx_ioctl_control(unsigned int cmd, const struct vs10xx_scibatch *scibatch) {
+/*
+ *  Descr:  Test if an ioctl changes the device or its stream, scibatch is checked for writes
+ *  Return: 1 --> needs a file opened for writing
+ *          0 --> only reads
+ */
+
+	int i;
+
+	switch (cmd) {
+		case VS10XX_CTL_RESET:
+		case VS10XX_CTL_FLUSH:
+		case VS10XX_CTL_CANCEL:
+		case VS10XX_CTL_SEEK:
+		case VS10XX_CTL_DRAIN:
+		case VS10XX_CTL_SETSCIREG:
+		case VS10XX_CTL_SETCLOCKF:
+		case VS10XX_CTL_SETVOLUME:
+		case VS10XX_CTL_SETTONE:
+		case VS10XX_CTL_SETRAMP:
+		case VS10XX_CTL_SETREBUF:
+		case VS10XX_CTL_SETGROUP:
+		case VS10XX_CTL_GROUPSTART:
+		case VS10XX_CTL_SETFANOUT:
+		case VS10XX_CTL_MOVE:
+			return 1;
+		case VS10XX_CTL_SCIBATCH:
+			for (i = 0; i < scibatch->count && i < VS10XX_SCI_MAXOPS; i++) {
+				if (scibatch->ops[i].op == VS10XX_SCI_WRITE) {
+					return 1;
+				}
+			}
+			return 0;
+		default:
+			return 0;
+	}
+}
+
+/* copy the ioctl argument in or out, the size comes from the struct, never from the command */
+#define vs10xx_ioctl_in(x)  (copy_from_user(&(x), usrbuf, sizeof(x)) ? -EFAULT : 0)
+#define vs10xx_ioctl_out(x) (copy_to_user(usrbuf, &(x), sizeof(x)) ? -EFAULT : 0)
+
 static long vs10xx_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
 
-	int ioctype =_IOC_TYPE(cmd), iocnr = _IOC_NR(cmd), /*iocdir = _IOC_DIR(cmd),*/ iocsize = _IOC_SIZE(cmd);
-	int id = (int)file->private_data;
+	int ioctype =_IOC_TYPE(cmd), iocnr = _IOC_NR(cmd);
+	struct vs10xx_device_t *device = file->private_data;
+	int id = vs10xx_device_id(device);
 	char __user * usrbuf = (void __user *)arg;
 
 	struct vs10xx_scireg scireg;
@@ -131,59 +277,182 @@ static long vs10xx_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	struct vs10xx_volume volume;
 	struct vs10xx_tone tone;
 	struct vs10xx_info info;
+	struct vs10xx_scibatch scibatch;
+	struct vs10xx_ramp ramp;
+	struct vs10xx_events events;
+	struct vs10xx_delay delay;
+	struct vs10xx_rebuf rebuf;
+	struct vs10xx_group group;
+	struct vs10xx_groupstart groupstart;
+	struct vs10xx_fanout fanout;
+	struct vs10xx_move move;
+	int status = 0;
 
 	if (ioctype != VS10XX_CTL_TYPE) {
 		vs10xx_dbg("id:%d unsupported ioctl type:%c nr:%d", id, ioctype, iocnr);
 		return -EINVAL;
 	}
 
-	switch (iocnr) {
-		case _IOC_NR(VS10XX_CTL_RESET):
-			vs10xx_device_reset(id);
+	/* the batch is needed up front to tell reads from writes */
+	scibatch.count = 0;
+	if (cmd == VS10XX_CTL_SCIBATCH && vs10xx_ioctl_in(scibatch) < 0) {
+		return -EFAULT;
+	}
+
+	if (!(file->f_mode & FMODE_WRITE) && vs10xx_ioctl_control(cmd, &scibatch)) {
+
+		/* read-only opens observe, they do not steer the stream of the process that has the device open */
+		vs10xx_dbg("id:%d ioctl nr:%d needs a file opened for writing", id, iocnr);
+		return -EBADF;
+	}
+
+	/* the full command, so a size or direction that does not match the struct is rejected */
+	switch (cmd) {
+		case VS10XX_CTL_RESET:
+			vs10xx_device_reset(device);
+			break;
+		case VS10XX_CTL_FLUSH:
+			status = vs10xx_device_flush(device);
+			break;
+		case VS10XX_CTL_CANCEL:
+			status = vs10xx_device_cancel(device);
+			break;
+		case VS10XX_CTL_SEEK:
+			status = vs10xx_device_seek(device);
+			break;
+		case VS10XX_CTL_DRAIN:
+			status = vs10xx_device_finish(device);
+			break;
+		case VS10XX_CTL_GETSCIREG:
+			status = vs10xx_ioctl_in(scireg);
+			if (status == 0) {
+				vs10xx_device_getscireg(device, &scireg);
+				status = vs10xx_ioctl_out(scireg);
+			}
+			break;
+		case VS10XX_CTL_SETSCIREG:
+			status = vs10xx_ioctl_in(scireg);
+			if (status == 0) {
+				vs10xx_device_setscireg(device, &scireg);
+			}
+			break;
+		case VS10XX_CTL_GETCLOCKF:
+			vs10xx_device_getclockf(device, &clockf);
+			status = vs10xx_ioctl_out(clockf);
+			break;
+		case VS10XX_CTL_SETCLOCKF:
+			status = vs10xx_ioctl_in(clockf);
+			if (status == 0) {
+				vs10xx_device_setclockf(device, &clockf);
+			}
+			break;
+		case VS10XX_CTL_GETVOLUME:
+			vs10xx_device_getvolume(device, &volume);
+			status = vs10xx_ioctl_out(volume);
 			break;
-		case _IOC_NR(VS10XX_CTL_GETSCIREG):
-			copy_from_user(&scireg, usrbuf, iocsize);
-			vs10xx_device_getscireg(id, &scireg);
-			copy_to_user(usrbuf, &scireg, iocsize);
+		case VS10XX_CTL_SETVOLUME:
+			status = vs10xx_ioctl_in(volume);
+			if (status == 0) {
+				vs10xx_device_setvolume(device, &volume);
+			}
 			break;
-		case _IOC_NR(VS10XX_CTL_SETSCIREG):
-			copy_from_user(&scireg, usrbuf, iocsize);
-			vs10xx_device_setscireg(id, &scireg);
+		case VS10XX_CTL_GETTONE:
+			vs10xx_device_gettone(device, &tone);
+			status = vs10xx_ioctl_out(tone);
 			break;
-		case _IOC_NR(VS10XX_CTL_GETCLOCKF):
-			vs10xx_device_getclockf(id, &clockf);
-			copy_to_user(usrbuf, &clockf, iocsize);
+		case VS10XX_CTL_SETTONE:
+			status = vs10xx_ioctl_in(tone);
+			if (status == 0) {
+				vs10xx_device_settone(device, &tone);
+			}
 			break;
-		case _IOC_NR(VS10XX_CTL_SETCLOCKF):
-			copy_from_user(&clockf, usrbuf, iocsize);
-			vs10xx_device_setclockf(id, &clockf);
+		case VS10XX_CTL_GETINFO:
+			vs10xx_device_getinfo(device, &info);
+			status = vs10xx_ioctl_out(info);
 			break;
-		case _IOC_NR(VS10XX_CTL_GETVOLUME):
-			vs10xx_device_getvolume(id, &volume);
-			copy_to_user(usrbuf, &volume, iocsize);
+		case VS10XX_CTL_SCIBATCH:
+			status = vs10xx_device_scibatch(device, &scibatch);
+			if (vs10xx_ioctl_out(scibatch) < 0) {
+				status = -EFAULT;
+			}
+			break;
+		case VS10XX_CTL_SETRAMP:
+			status = vs10xx_ioctl_in(ramp);
+			if (status == 0) {
+				status = vs10xx_device_setramp(device, &ramp);
+			}
 			break;
-		case _IOC_NR(VS10XX_CTL_SETVOLUME):
-			copy_from_user(&volume, usrbuf, iocsize);
-			vs10xx_device_setvolume(id, &volume);
+		case VS10XX_CTL_GETEVENTS:
+			vs10xx_device_getevents(device, &events);
+			status = vs10xx_ioctl_out(events);
 			break;
-		case _IOC_NR(VS10XX_CTL_GETTONE):
-			vs10xx_device_gettone(id, &tone);
-			copy_to_user(usrbuf, &tone, iocsize);
+		case VS10XX_CTL_SETREBUF:
+			status = vs10xx_ioctl_in(rebuf);
+			if (status == 0) {
+				status = vs10xx_device_setrebuf(device, &rebuf);
+			}
 			break;
-		case _IOC_NR(VS10XX_CTL_SETTONE):
-			copy_from_user(&tone, usrbuf, iocsize);
-			vs10xx_device_settone(id, &tone);
+		case VS10XX_CTL_GETDELAY:
+			status = vs10xx_device_getdelay(device, &delay);
+			if (vs10xx_ioctl_out(delay) < 0) {
+				status = -EFAULT;
+			}
 			break;
-		case _IOC_NR(VS10XX_CTL_GETINFO):
-			vs10xx_device_getinfo(id, &info);
-			copy_to_user(usrbuf, &info, iocsize);
+		case VS10XX_CTL_SETGROUP:
+			status = vs10xx_ioctl_in(group);
+			if (status == 0) {
+				status = vs10xx_device_setgroup(device, &group);
+			}
+			break;
+		case VS10XX_CTL_GROUPSTART:
+			status = vs10xx_ioctl_in(groupstart);
+			if (status == 0) {
+				status = vs10xx_device_groupstart(device, &groupstart);
+				if (vs10xx_ioctl_out(groupstart) < 0) {
+					status = -EFAULT;
+				}
+			}
+			break;
+		case VS10XX_CTL_SETFANOUT:
+			status = vs10xx_ioctl_in(fanout);
+			if (status == 0) {
+				status = vs10xx_device_setfanout(device, &fanout);
+			}
+			break;
+		case VS10XX_CTL_MOVE:
+			status = vs10xx_ioctl_in(move);
+			if (status == 0) {
+				status = vs10xx_device_move(device, &move);
+				if (status == 0) {
+					/* the stream lives on the target now */
+					file->private_data = vs10xx_device_get(move.target);
+				}
+				if (vs10xx_ioctl_out(move) < 0) {
+					status = -EFAULT;
+				}
+			}
 			break;
 		default:
-			vs10xx_dbg("id:%d unsupported ioctl type:%c nr:%d", id, ioctype, iocnr);
+			vs10xx_dbg("id:%d unsupported ioctl type:%c nr:%d size:%d", id, ioctype, iocnr, _IOC_SIZE(cmd));
 			return -EINVAL;
 	}
 
-	return 0;
+	/* argument errors, bad user pointers and interrupted waits go back as such, any other failure is the device's */
+	if (status == -EINVAL || status == -EFAULT || status == -ERESTARTSYS) {
+		return status;
+	}
+
+	return (status < 0 ? -EIO : 0);
+}
+
+static unsigned int vs10xx_poll(struct file *file, poll_table *wait) {
+
+	return vs10xx_device_poll(file->private_data, file, wait);
+}
+
+static int vs10xx_mmap(struct file *file, struct vm_area_struct *vma) {
+
+	return vs10xx_device_mmap(file->private_data, vma);
 }
 
 static const struct file_operations vs10xx_fops = {
@@ -192,6 +461,8 @@ static const struct file_operations vs10xx_fops = {
 	.release = vs10xx_release,
 	.write = vs10xx_write,
 	.unlocked_ioctl = vs10xx_ioctl,
+	.poll = vs10xx_poll,
+	.mmap = vs10xx_mmap,
 };
 
 /* ----------------------------------------------------------------------------------------------------------------------------- */
@@ -210,21 +481,21 @@ static struct class vs10xx_class = {
 
 static ssize_t vs10xx_sys_reset_w(struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
 
-	const int id = (int)dev_get_drvdata(dev);
-	vs10xx_device_reset(id);
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	vs10xx_device_reset(device);
 	return size;
 }
 
 static ssize_t vs10xx_sys_test_w(struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
 
-	const int id = (int)dev_get_drvdata(dev);
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
 
 	if (buf && (*buf=='M' || *buf=='m')) {
-		vs10xx_device_memtest(id);
+		vs10xx_device_memtest(device);
 	}
 
 	if (buf && (*buf=='S' || *buf=='s')) {
-		vs10xx_device_sinetest(id);
+		vs10xx_device_sinetest(device);
 	}
 
 	return size;
@@ -232,18 +503,99 @@ static ssize_t vs10xx_sys_test_w(struct device *dev, struct device_attribute *at
 
 static ssize_t vs10xx_sys_status_r(struct device *dev, struct device_attribute *attr, char *buf) {
 
-	const int id = (int)dev_get_drvdata(dev);
-	return vs10xx_device_status(id, buf);
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	return vs10xx_device_status(device, buf);
+}
+
+static ssize_t vs10xx_sys_ctrlwait_r(struct device *dev, struct device_attribute *attr, char *buf) {
+
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	return vs10xx_device_ctrlwait(device, buf);
+}
+
+static ssize_t vs10xx_sys_ctrlwait_w(struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
+
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	vs10xx_device_clrctrlwait(device);
+	return size;
+}
+
+static ssize_t vs10xx_sys_drift_r(struct device *dev, struct device_attribute *attr, char *buf) {
+
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	return vs10xx_device_drift(device, buf);
+}
+
+static ssize_t vs10xx_sys_sched_r(struct device *dev, struct device_attribute *attr, char *buf) {
+
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	return vs10xx_device_sched(device, buf);
+}
+
+static ssize_t vs10xx_sys_sched_w(struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
+
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	return (vs10xx_device_setsched(device, buf) < 0 ? -EINVAL : size);
+}
+
+static ssize_t vs10xx_sys_cpus_r(struct device *dev, struct device_attribute *attr, char *buf) {
+
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	return vs10xx_device_cpus(device, buf);
+}
+
+static ssize_t vs10xx_sys_cpus_w(struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
+
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	return (vs10xx_device_setcpus(device, buf) < 0 ? -EINVAL : size);
+}
+
+static ssize_t vs10xx_sys_jitter_r(struct device *dev, struct device_attribute *attr, char *buf) {
+
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	return vs10xx_stats_jitter(vs10xx_device_stats(device), buf, PAGE_SIZE);
+}
+
+static ssize_t vs10xx_sys_jitter_w(struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
+
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	vs10xx_stats_clrjitter(vs10xx_device_stats(device));
+	return size;
+}
+
+static ssize_t vs10xx_sys_stats_r(struct device *dev, struct device_attribute *attr, char *buf) {
+
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	return vs10xx_stats_print(vs10xx_device_stats(device), buf, PAGE_SIZE);
+}
+
+static ssize_t vs10xx_sys_stats_w(struct device *dev, struct device_attribute *attr, const char *buf, size_t size) {
+
+	struct vs10xx_device_t *device = dev_get_drvdata(dev);
+	vs10xx_stats_clear(vs10xx_device_stats(device));
+	return size;
 }
 
 static const DEVICE_ATTR(reset, 0222, NULL, vs10xx_sys_reset_w);
 static const DEVICE_ATTR(test, 0666, NULL, vs10xx_sys_test_w);
 static const DEVICE_ATTR(status, 0444, vs10xx_sys_status_r, NULL);
+static const DEVICE_ATTR(ctrlwait, 0644, vs10xx_sys_ctrlwait_r, vs10xx_sys_ctrlwait_w);
+static const DEVICE_ATTR(stats, 0644, vs10xx_sys_stats_r, vs10xx_sys_stats_w);
+static const DEVICE_ATTR(drift, 0444, vs10xx_sys_drift_r, NULL);
+static const DEVICE_ATTR(sched, 0644, vs10xx_sys_sched_r, vs10xx_sys_sched_w);
+static const DEVICE_ATTR(cpus, 0644, vs10xx_sys_cpus_r, vs10xx_sys_cpus_w);
+static const DEVICE_ATTR(jitter, 0644, vs10xx_sys_jitter_r, vs10xx_sys_jitter_w);
 
 static const struct attribute *vs10xx_attrs[] = {
 	&dev_attr_reset.attr,
 	&dev_attr_test.attr,
 	&dev_attr_status.attr,
+	&dev_attr_ctrlwait.attr,
+	&dev_attr_stats.attr,
+	&dev_attr_drift.attr,
+	&dev_attr_sched.attr,
+	&dev_attr_cpus.attr,
+	&dev_attr_jitter.attr,
 	NULL,
 };
 
@@ -255,28 +607,120 @@ static const struct attribute_group vs10xx_attr_group = {
 /* MODULE INIT/EXIT                                                                                                              */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
-static void vs10xx_cleanup (void) {
+static int vs10xx_minor_get(void) {
+/*
+ *  Descr:  Reserve the lowest free minor, the device context is filled in once it is up
+ *  Return: minor, <0 --> none
+ */
 
-	int i;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0)
 
-	/* cleanup vs10xx devices */
-	for (i=0; i<VS10XX_MAX_DEVICES; i++) {
+	return idr_alloc(&vs10xx_minors, NULL, 0, maxdevs, GFP_KERNEL);
+
+#else
+
+	int minor, status;
+
+	do {
+		if (!idr_pre_get(&vs10xx_minors, GFP_KERNEL)) {
+			return -ENOMEM;
+		}
+		status = idr_get_new(&vs10xx_minors, NULL, &minor);
+	} while (status == -EAGAIN);
+
+	if (status == 0 && minor >= maxdevs) {
+		idr_remove(&vs10xx_minors, minor);
+		status = -ENOSPC;
+	}
+
+	return (status < 0 ? status : minor);
+
+#endif
+}
+
+static void vs10xx_detach(struct vs10xx_device_t *device, int minor) {
 
-		/* exit device */
-		vs10xx_device_exit(i);
+	/* exit device, with its queue, io path and stats */
+	vs10xx_device_exit(device);
+
+	if (minor >= 0) {
 
 		/* destroy device */
-		device_destroy(&vs10xx_class, MKDEV(MAJOR(vs10xx_cdev_region), i));
+		device_destroy(&vs10xx_class, MKDEV(MAJOR(vs10xx_cdev_region), minor));
+		idr_remove(&vs10xx_minors, minor);
+	}
+}
+
+static int vs10xx_attach(struct vs10xx_chip *chip, int id) {
+/*
+ *  Descr:  Bring up a device once both spi devices of its chip are probed, called from the probes
+ *  Return: status
+ */
+
+	struct vs10xx_device_t *device = NULL;
+	int minor, status = 0;
+	struct device *dev;
+
+	minor = vs10xx_minor_get();
+	if (minor < 0) {
+		vs10xx_err("id:%d no free minor", id);
+		return -1;
+	}
+
+	/* create vs10xx char device, opens find no context until the device is up */
+	dev = device_create(&vs10xx_class, NULL, MKDEV(MAJOR(vs10xx_cdev_region), minor), NULL, "%s-%d", VS10XX_NAME, id);
+	if (IS_ERR_OR_NULL(dev)) {
+		vs10xx_err("device_create id:%d name:%s-%d maj:%d min:%d", id, VS10XX_NAME, id, MAJOR(vs10xx_cdev_region), minor);
+		status = -1;
+	}
+
+	if (status == 0) {
+		status = vs10xx_device_init(id, chip, dev, &device);
+	}
+
+	if (status == 0) {
+		/* the attributes use the device thread */
+		dev_set_drvdata(dev, device);
+		status = sysfs_create_group(&dev->kobj, &vs10xx_attr_group);
+	}
+
+	if (status == 0) {
+		idr_replace(&vs10xx_minors, device, minor);
+		vs10xx_inf("id:%d name:%s-%d maj:%d min:%d", id, VS10XX_NAME, id, MAJOR(vs10xx_cdev_region), minor);
+	} else {
+		vs10xx_detach(device, minor);
+	}
+
+	return status;
+}
+
+static void vs10xx_cleanup (void) {
 
-		/* exit queue */
-		vs10xx_queue_exit(i);
+	struct vs10xx_device_t *device;
+	int minor;
 
-		/* exit io */
-		vs10xx_io_exit(i);
+	/* the device threads look at the other members of their groups, stop all of them first */
+	for (minor = 0; minor < maxdevs; minor++) {
+		device = idr_find(&vs10xx_minors, minor);
+		if (device) {
+			vs10xx_device_stop(device);
+		}
 	}
 
+	/* cleanup vs10xx devices */
+	for (minor = 0; minor < maxdevs; minor++) {
+		device = idr_find(&vs10xx_minors, minor);
+		if (device) {
+			vs10xx_detach(device, minor);
+		}
+	}
+
+	idr_destroy(&vs10xx_minors);
+
 	vs10xx_io_unregister();
 
+	vs10xx_stats_unregister();
+
 	/* cleanup char device driver */
 	if (vs10xx_cdev) {
 		cdev_del(vs10xx_cdev);
@@ -286,20 +730,27 @@ static void vs10xx_cleanup (void) {
 	class_unregister(&vs10xx_class);
 
 	/* unregister vs10xx region */
-	unregister_chrdev_region(vs10xx_cdev_region, VS10XX_MAX_DEVICES);
+	unregister_chrdev_region(vs10xx_cdev_region, maxdevs);
 
 }
 
 static int __init vs10xx_init (void) {
 
-	int i, status = 0;
-	struct device *dev;
+	int status = 0;
+
+	/* debug may have been set on the command line before the keys were usable */
+	vs10xx_debug_update();
 
 	vs10xx_dbg("start");
 
+	if (maxdevs < 1) {
+		vs10xx_err("maxdevs:%d", maxdevs);
+		return -EINVAL;
+	}
+
 	if (status == 0) {
-		/* register vs10xx region */
-		status = alloc_chrdev_region(&vs10xx_cdev_region, 0, VS10XX_MAX_DEVICES, VS10XX_NAME);
+		/* register vs10xx region, maxdevs minors, the devices take them as they come */
+		status = alloc_chrdev_region(&vs10xx_cdev_region, 0, maxdevs, VS10XX_NAME);
 		if (status < 0) {
 			vs10xx_err("alloc_chrdev_region");
 		}
@@ -321,7 +772,7 @@ static int __init vs10xx_init (void) {
 			status = -1;
 		} else {
 			cdev_init(vs10xx_cdev, &vs10xx_fops);
-			status = cdev_add(vs10xx_cdev, vs10xx_cdev_region, VS10XX_MAX_DEVICES);
+			status = cdev_add(vs10xx_cdev, vs10xx_cdev_region, maxdevs);
 			if (status < 0) {
 				vs10xx_err("cdev_add");
 			}
@@ -329,39 +780,13 @@ static int __init vs10xx_init (void) {
 	}
 
 	if (status == 0) {
-		/* register io */
-		status = vs10xx_io_register();
+		/* register debugfs */
+		status = vs10xx_stats_register();
 	}
 
-	/* initialize vs10xx devices */
-	for (i = 0; (status == 0) && (i < VS10XX_MAX_DEVICES); i++) {
-
-		/* init io path */
-		if (vs10xx_io_init(i) == 0) {
-
-			/* init queue */
-			status = vs10xx_queue_init(i);
-
-			if (status == 0) {
-				/* create vs10xx char device */
-				dev = device_create(&vs10xx_class, NULL, MKDEV(MAJOR(vs10xx_cdev_region), i), (void*)i, "%s-%d", VS10XX_NAME, i);
-				if (dev == NULL) {
-					vs10xx_err("device_create id:%d name:%s-%d maj:%d min:%d", i, VS10XX_NAME, i, MAJOR(vs10xx_cdev_region), i);
-					status = -1;
-				} else {
-					dev_set_drvdata(dev, (void*)i);
-					status = sysfs_create_group(&dev->kobj, &vs10xx_attr_group);
-				}
-			}
-
-			if (status == 0) {
-				status = vs10xx_device_init(i, dev);
-			}
-
-			if (status == 0) {
-				vs10xx_inf("id:%d name:%s-%d maj:%d min:%d", i, VS10XX_NAME, i, MAJOR(vs10xx_cdev_region), i);
-			}
-		}
+	if (status == 0) {
+		/* register io, the devices attach as their chips are probed */
+		status = vs10xx_io_register(vs10xx_attach);
 	}
 
 	if (status != 0) {
@@ -19,8 +19,12 @@
 
 #include "vs10xx_common.h"
 #include "vs10xx_queue.h"
+#include "vs10xx_stats.h"
+#include "vs10xx_trace.h"
 
+#include <linux/kref.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 
 /* queue size*/
 static int queuelen = 2048;
@@ -29,25 +33,48 @@ module_param(queuelen, int, 0644);
 struct vs10xx_queue_entry_t {
 	struct list_head list;
 	struct vs10xx_queue_buf_t buf;
+	ktime_t queued;
 };
 
+/* fan-out ring, one writer and a read position per member, freed when the last member lets go.
+   head, the byte count and the member positions change under the ring lock and are read lockless
+   for the levels. */
+struct vs10xx_queue_ring_t {
+	struct kref ref;
+	spinlock_t lock;
+	int size;
+	int policy;
+	struct vs10xx_queue_t *writer;    /* queue that takes the writes             */
+	struct list_head members;
+	u64 head;                         /* chunks written                          */
+	u64 bytes;                        /* bytes written                           */
+	struct vs10xx_queue_entry_t *slot;
+};
+
+/* free and bytes change under the device lock and are read lockless for the levels */
 struct vs10xx_queue_t {
 	int id;
+	int size;
 	int free;
+	unsigned bytes;
 	int valid;
 	struct list_head buf_pool;
 	struct list_head buf_data;
+	struct vs10xx_stats_dev_t *stats;
+	/* fan-out member, see struct vs10xx_queue_ring_t */
+	struct vs10xx_queue_ring_t *ring;
+	struct list_head member;
+	u64 tail;                         /* chunks consumed                         */
+	u64 tbytes;                       /* bytes consumed                          */
+	u64 busy;                         /* chunk being sent, ~0: none              */
 };
 
-static struct vs10xx_queue_t vs10xx_queue[VS10XX_MAX_DEVICES];
-
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 /* VS10XX QUEUE BUFFERS                                                                                                          */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
-static int vs10xx_queue_alloc(int id) {
+static int vs10xx_queue_alloc(struct vs10xx_queue_t *queue) {
 
-	struct vs10xx_queue_t *queue = &vs10xx_queue[id];
 	struct vs10xx_queue_entry_t *entry;
 	int i, status = 0;
 
@@ -68,36 +95,52 @@ static int vs10xx_queue_alloc(int id) {
 		}
 	}
 
+	queue->size = ((status == 0) ? queuelen : 0);
 	queue->free = ((status == 0) ? queuelen : 0);
+	queue->bytes = 0;
 	queue->valid = ((status == 0) ? 1 : 0);
 
-	vs10xx_inf("id:%d allocated %d/%d buffers (%d bytes)", queue->id, i, queuelen, (i * sizeof(entry->buf)));
+	vs10xx_inf("id:%d allocated %d/%d buffers (%d bytes)", queue->id, i, queuelen, (int)(i * sizeof(entry->buf)));
 
 	return status;
 }
 
-void vs10xx_queue_flush(int id) {
+void vs10xx_queue_flush(struct vs10xx_queue_t *queue) {
 
-	struct vs10xx_queue_t *queue = &vs10xx_queue[id];
 	struct vs10xx_queue_entry_t *entry, *n;
+	unsigned long flags;
+
+	if (queue->ring) {
+
+		/* skip to the write position, the other members keep theirs */
+		spin_lock_irqsave(&queue->ring->lock, flags);
+		WRITE_ONCE(queue->tail, queue->ring->head);
+		WRITE_ONCE(queue->tbytes, queue->ring->bytes);
+		queue->busy = ~0ULL;
+		spin_unlock_irqrestore(&queue->ring->lock, flags);
+	}
 
 	/* move all buffers to pool */
 	if (!list_empty(&queue->buf_data)) {
-		vs10xx_dbg("id:%d flush queue", id);
+		vs10xx_dbg("id:%d flush queue", queue->id);
 		list_for_each_entry_safe(entry, n, &queue->buf_data, list) {
+			entry->buf.len = 0;
 			list_move_tail(&entry->list, &queue->buf_pool);
 		}
 	}
+
+	WRITE_ONCE(queue->free, queue->size);
+	WRITE_ONCE(queue->bytes, 0);
 }
 
-static void vs10xx_queue_free(int id) {
+static void vs10xx_queue_free(struct vs10xx_queue_t *queue) {
 
-	struct vs10xx_queue_t *queue = &vs10xx_queue[id];
 	struct vs10xx_queue_entry_t *entry, *n;
 
 	if (queue->valid) {
 
-		vs10xx_queue_flush(id);
+		vs10xx_queue_unshare(queue);
+		vs10xx_queue_flush(queue);
 
 		/* free buffers */
 		list_for_each_entry_safe(entry, n, &queue->buf_pool, list) {
@@ -105,89 +148,367 @@ static void vs10xx_queue_free(int id) {
 			kfree(entry);
 		}
 
-		queue->free = 0;
+		queue->size = 0;
+		WRITE_ONCE(queue->free, 0);
 		queue->valid = 0;
 	}
 }
 
-int vs10xx_queue_isfull(int id) {
+static int vs10xx_queue_ringfull(struct vs10xx_queue_ring_t *ring) {
+/*
+ *  Descr:  Test if the writer must wait for a member. With VS10XX_FANOUT_DROP only the writer's own
+ *          queue sets the pace, another member that is a full ring behind skips 1/8 of it, unless
+ *          it is sending the oldest chunk right now.
+ *  Return: 1 --> full
+ *          0 --> room for a chunk
+ */
+
+	struct vs10xx_queue_entry_t *entry;
+	struct vs10xx_queue_t *m;
+	unsigned long flags;
+	unsigned drop;
+	int full = 0;
+
+	spin_lock_irqsave(&ring->lock, flags);
+
+	list_for_each_entry(m, &ring->members, member) {
+
+		if (ring->head - m->tail < ring->size) {
+			continue;
+		}
+
+		if (ring->policy == VS10XX_FANOUT_DROP && m != ring->writer && m->busy != m->tail) {
+
+			for (drop = 0; drop < ring->size / 8; drop++) {
+				entry = &ring->slot[m->tail % ring->size];
+				WRITE_ONCE(m->tbytes, m->tbytes + entry->buf.len);
+				vs10xx_stats_add(m->stats, drop_bytes, entry->buf.len);
+				WRITE_ONCE(m->tail, m->tail + 1);
+			}
+
+			vs10xx_stats_add(m->stats, drops, drop);
+
+		} else {
+
+			full = 1;
+		}
+	}
+
+	spin_unlock_irqrestore(&ring->lock, flags);
+
+	return full;
+}
+
+int vs10xx_queue_isfull(struct vs10xx_queue_t *queue) {
 
-	struct vs10xx_queue_t *queue = &vs10xx_queue[id];
+	struct vs10xx_queue_ring_t *ring = ACCESS_ONCE(queue->ring);
+
+	if (ring) {
+		return vs10xx_queue_ringfull(ring);
+	}
 
 	return list_empty(&queue->buf_pool);
 
 }
 
-int vs10xx_queue_isempty(int id) {
+int vs10xx_queue_isempty(struct vs10xx_queue_t *queue) {
 
-	struct vs10xx_queue_t *queue = &vs10xx_queue[id];
+	struct vs10xx_queue_ring_t *ring = ACCESS_ONCE(queue->ring);
+
+	if (ring) {
+		return (ACCESS_ONCE(ring->head) == ACCESS_ONCE(queue->tail));
+	}
 
 	return list_empty(&queue->buf_data);
 
 }
 
-int vs10xx_queue_getfree(int id) {
+int vs10xx_queue_getfree(struct vs10xx_queue_t *queue) {
+
+	struct vs10xx_queue_ring_t *ring = ACCESS_ONCE(queue->ring);
+
+	if (ring) {
+		return ring->size - (int)(ACCESS_ONCE(ring->head) - ACCESS_ONCE(queue->tail));
+	}
+
+	return ACCESS_ONCE(queue->free);
+}
+
+int vs10xx_queue_getlevel(struct vs10xx_queue_t *queue) {
 
-	struct vs10xx_queue_t *queue = &vs10xx_queue[id];
+	struct vs10xx_queue_ring_t *ring = ACCESS_ONCE(queue->ring);
 
-	return queue->free;
+	if (ring) {
+		return (int)(ACCESS_ONCE(ring->head) - ACCESS_ONCE(queue->tail));
+	}
+
+	return queue->size - ACCESS_ONCE(queue->free);
 }
 
-struct vs10xx_queue_buf_t* vs10xx_queue_getslot(int id) {
+unsigned vs10xx_queue_getbytes(struct vs10xx_queue_t *queue) {
+
+	struct vs10xx_queue_ring_t *ring = ACCESS_ONCE(queue->ring);
+
+	if (ring) {
+		return (unsigned)(ACCESS_ONCE(ring->bytes) - ACCESS_ONCE(queue->tbytes));
+	}
+
+	return ACCESS_ONCE(queue->bytes);
+}
+
+struct vs10xx_queue_buf_t* vs10xx_queue_getslot(struct vs10xx_queue_t *queue) {
 
-	struct vs10xx_queue_t *queue = &vs10xx_queue[id];
 	/* get the first (empty) data entry from the data queue */
-	struct vs10xx_queue_entry_t *entry = list_first_entry(&queue->buf_pool, struct vs10xx_queue_entry_t, list);
+	struct vs10xx_queue_entry_t *entry;
+
+	if (queue->ring) {
+		/* the writer owns the slot at head until it enqueues */
+		return &queue->ring->slot[queue->ring->head % queue->ring->size].buf;
+	}
+
+	entry = list_first_entry(&queue->buf_pool, struct vs10xx_queue_entry_t, list);
 
 	return &entry->buf;
 }
 
-struct vs10xx_queue_buf_t* vs10xx_queue_gethead(int id) {
+struct vs10xx_queue_buf_t* vs10xx_queue_gethead(struct vs10xx_queue_t *queue) {
 
-	struct vs10xx_queue_t *queue = &vs10xx_queue[id];
 	/* get the first (filled) data entry from the data queue */
-	struct vs10xx_queue_entry_t *entry = list_first_entry(&queue->buf_data, struct vs10xx_queue_entry_t, list);
+	struct vs10xx_queue_entry_t *entry;
+	unsigned long flags;
+
+	if (queue->ring) {
+		/* the writer does not drop a chunk that is being sent */
+		spin_lock_irqsave(&queue->ring->lock, flags);
+		queue->busy = queue->tail;
+		entry = &queue->ring->slot[queue->tail % queue->ring->size];
+		spin_unlock_irqrestore(&queue->ring->lock, flags);
+		return &entry->buf;
+	}
+
+	entry = list_first_entry(&queue->buf_data, struct vs10xx_queue_entry_t, list);
 
 	return &entry->buf;
 }
 
-void vs10xx_queue_enqueue(int id) {
+void vs10xx_queue_enqueue(struct vs10xx_queue_t *queue) {
 
-	struct vs10xx_queue_t *queue = &vs10xx_queue[id];
 	/* could ask the caller for the entry, but let's do not to prevent queue corruption */
-	struct vs10xx_queue_entry_t *entry = list_first_entry(&queue->buf_pool, struct vs10xx_queue_entry_t, list);
+	struct vs10xx_queue_entry_t *entry;
+	struct vs10xx_queue_ring_t *ring = queue->ring;
+	unsigned long flags;
+
+	if (ring) {
+		entry = &ring->slot[ring->head % ring->size];
+		if (entry->buf.len > 0) {
+			entry->queued = ktime_get();
+			spin_lock_irqsave(&ring->lock, flags);
+			WRITE_ONCE(ring->head, ring->head + 1);
+			WRITE_ONCE(ring->bytes, ring->bytes + entry->buf.len);
+			spin_unlock_irqrestore(&ring->lock, flags);
+			trace_vs10xx_queue_enqueue(queue->id, entry->buf.len, (int)(ring->head - queue->tail));
+		}
+		return;
+	}
+
+	entry = list_first_entry(&queue->buf_pool, struct vs10xx_queue_entry_t, list);
 	if (entry->buf.len > 0) {
+		entry->queued = ktime_get();
 		list_move_tail(&entry->list, &queue->buf_data);
-		queue->free -= 1;
+		WRITE_ONCE(queue->free, queue->free - 1);
+		WRITE_ONCE(queue->bytes, queue->bytes + entry->buf.len);
+		trace_vs10xx_queue_enqueue(queue->id, entry->buf.len, queue->size - queue->free);
 	}
 }
 
-void vs10xx_queue_dequeue(int id) {
+void vs10xx_queue_dequeue(struct vs10xx_queue_t *queue) {
 
-	struct vs10xx_queue_t *queue = &vs10xx_queue[id];
 	/* could ask the caller for the entry, but let's do not to prevent queue corruption */
-	struct vs10xx_queue_entry_t *entry = list_first_entry(&queue->buf_data, struct vs10xx_queue_entry_t, list);
+	struct vs10xx_queue_entry_t *entry;
+	struct vs10xx_queue_ring_t *ring = queue->ring;
+	unsigned long flags;
+
+	if (ring) {
+		/* the slot stays for the other members, unless the writer dropped it meanwhile */
+		spin_lock_irqsave(&ring->lock, flags);
+		entry = &ring->slot[queue->tail % ring->size];
+		if (queue->busy == queue->tail) {
+			WRITE_ONCE(queue->tail, queue->tail + 1);
+			WRITE_ONCE(queue->tbytes, queue->tbytes + entry->buf.len);
+		}
+		queue->busy = ~0ULL;
+		spin_unlock_irqrestore(&ring->lock, flags);
+		vs10xx_stats_latency(queue->stats, VS10XX_LAT_QUEUE, entry->queued);
+		trace_vs10xx_queue_dequeue(queue->id, entry->buf.len, (int)(ring->head - queue->tail));
+		return;
+	}
+
+	entry = list_first_entry(&queue->buf_data, struct vs10xx_queue_entry_t, list);
+	vs10xx_stats_latency(queue->stats, VS10XX_LAT_QUEUE, entry->queued);
 	list_move_tail(&entry->list, &queue->buf_pool);
+	trace_vs10xx_queue_dequeue(queue->id, entry->buf.len, queue->size - queue->free - 1);
+	WRITE_ONCE(queue->bytes, queue->bytes - entry->buf.len);
 	entry->buf.len = 0;
-	queue->free += 1;
+	WRITE_ONCE(queue->free, queue->free + 1);
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX QUEUE FAN-OUT                                                                                                          */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+static void vs10xx_queue_ringfree(struct kref *ref) {
+
+	struct vs10xx_queue_ring_t *ring = container_of(ref, struct vs10xx_queue_ring_t, ref);
+
+	vfree(ring->slot);
+	kfree(ring);
+}
+
+int vs10xx_queue_share(struct vs10xx_queue_t *queue, struct vs10xx_queue_t **members, int count, int policy) {
+/*
+ *  Descr:  Let the count queues in members, queue among them, read the writes to queue from one
+ *          shared ring of queuelen chunks. The queues are flushed, the callers hold the device
+ *          locks of all members.
+ *  Return: status
+ */
+
+	struct vs10xx_queue_ring_t *ring;
+	int m, writer = 0;
+
+	for (m = 0; m < count; m++) {
+		if (!members[m]->valid || members[m]->ring != NULL) {
+			return -1;
+		}
+		writer |= (members[m] == queue);
+	}
+
+	if (!writer) {
+		return -1;
+	}
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (ring == NULL) {
+		vs10xx_err("id:%d kzalloc fan-out ring", queue->id);
+		return -1;
+	}
+
+	ring->size = queue->size;
+	ring->slot = vmalloc(ring->size * sizeof(*ring->slot));
+	if (ring->slot == NULL) {
+		vs10xx_err("id:%d vmalloc %d fan-out chunks", queue->id, ring->size);
+		kfree(ring);
+		return -1;
+	}
+
+	memset(ring->slot, 0, ring->size * sizeof(*ring->slot));
+	kref_init(&ring->ref);
+	spin_lock_init(&ring->lock);
+	INIT_LIST_HEAD(&ring->members);
+	ring->policy = policy;
+	ring->writer = queue;
+
+	for (m = 0; m < count; m++) {
+		vs10xx_queue_flush(members[m]);
+		members[m]->tail = 0;
+		members[m]->tbytes = 0;
+		members[m]->busy = ~0ULL;
+		kref_get(&ring->ref);
+		list_add_tail(&members[m]->member, &ring->members);
+		members[m]->ring = ring;
+	}
+
+	/* the members hold the ring now */
+	kref_put(&ring->ref, vs10xx_queue_ringfree);
+
+	vs10xx_dbg("id:%d fan-out to %d queues, %d chunks", queue->id, count, ring->size);
+
+	return 0;
+}
+
+void vs10xx_queue_unshare(struct vs10xx_queue_t *queue) {
+/*
+ *  Descr:  Detach queue from its fan-out ring, the last member frees it. The caller holds the device lock.
+ *  Return: -
+ */
+
+	struct vs10xx_queue_ring_t *ring = queue->ring;
+	unsigned long flags;
+
+	if (ring) {
+
+		spin_lock_irqsave(&ring->lock, flags);
+		list_del(&queue->member);
+		queue->ring = NULL;
+		spin_unlock_irqrestore(&ring->lock, flags);
+
+		kref_put(&ring->ref, vs10xx_queue_ringfree);
+	}
+}
+
+unsigned vs10xx_queue_move(struct vs10xx_queue_t *src, struct vs10xx_queue_t *dst) {
+/*
+ *  Descr:  Hand the queued chunks of queue src over to the empty queue dst, which gives back as many
+ *          free chunks. What does not fit stays behind. The caller holds both device locks.
+ *  Return: bytes moved
+ */
+
+	struct vs10xx_queue_entry_t *entry, *n;
+	unsigned bytes = 0;
+
+	if (src->ring || dst->ring || !list_empty(&dst->buf_data)) {
+		return 0;
+	}
+
+	list_for_each_entry_safe(entry, n, &src->buf_data, list) {
+
+		if (list_empty(&dst->buf_pool)) {
+			break;
+		}
+
+		list_move_tail(&entry->list, &dst->buf_data);
+		list_move(dst->buf_pool.next, &src->buf_pool);
+		bytes += entry->buf.len;
+		WRITE_ONCE(src->free, src->free + 1);
+		WRITE_ONCE(dst->free, dst->free - 1);
+	}
+
+	WRITE_ONCE(src->bytes, src->bytes - bytes);
+	WRITE_ONCE(dst->bytes, dst->bytes + bytes);
+
+	vs10xx_dbg("id:%d moved %u bytes to %d", src->id, bytes, dst->id);
+
+	return bytes;
+}
+
+int vs10xx_queue_isshared(struct vs10xx_queue_t *queue) {
+
+	return (queue->ring != NULL);
 }
 
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 /* VS10XX QUEUE INIT/EXIT                                                                                                        */
 /* ----------------------------------------------------------------------------------------------------------------------------- */
 
-int vs10xx_queue_init(int id) {
+int vs10xx_queue_init(int id, struct vs10xx_stats_dev_t *stats, struct vs10xx_queue_t **queue) {
 
-	int status;
+	*queue = kzalloc(sizeof(struct vs10xx_queue_t), GFP_KERNEL);
+	if (*queue == NULL) {
+		vs10xx_err("id:%d kzalloc queue", id);
+		return -1;
+	}
 
-	vs10xx_queue[id].id = id;
-	status = vs10xx_queue_alloc(id);
+	(*queue)->id = id;
+	(*queue)->stats = stats;
 
-	return status;
+	return vs10xx_queue_alloc(*queue);
 }
 
-void vs10xx_queue_exit(int id) {
+void vs10xx_queue_exit(struct vs10xx_queue_t *queue) {
+
+	if (queue != NULL) {
 
-	vs10xx_queue_free(id);
+		vs10xx_queue_free(queue);
 
+		kfree(queue);
+	}
 }
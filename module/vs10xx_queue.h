@@ -27,18 +27,29 @@ struct vs10xx_queue_buf_t {
 	unsigned len;
 };
 
-int vs10xx_queue_init(int id);
-void vs10xx_queue_exit(int id);
-void vs10xx_queue_flush(int id);
+struct vs10xx_queue_t;
+struct vs10xx_stats_dev_t;
 
-int vs10xx_queue_isfull(int id);
-int vs10xx_queue_isempty(int id);
-int vs10xx_queue_getfree(int id);
+int vs10xx_queue_init(int id, struct vs10xx_stats_dev_t *stats, struct vs10xx_queue_t **queue);
+void vs10xx_queue_exit(struct vs10xx_queue_t *queue);
+void vs10xx_queue_flush(struct vs10xx_queue_t *queue);
 
-struct vs10xx_queue_buf_t* vs10xx_queue_getslot(int id);
-struct vs10xx_queue_buf_t* vs10xx_queue_gethead(int id);
+int vs10xx_queue_isfull(struct vs10xx_queue_t *queue);
+int vs10xx_queue_isempty(struct vs10xx_queue_t *queue);
+int vs10xx_queue_getfree(struct vs10xx_queue_t *queue);
+int vs10xx_queue_getlevel(struct vs10xx_queue_t *queue);
+unsigned vs10xx_queue_getbytes(struct vs10xx_queue_t *queue);
 
-void vs10xx_queue_enqueue(int id);
-void vs10xx_queue_dequeue(int id);
+struct vs10xx_queue_buf_t* vs10xx_queue_getslot(struct vs10xx_queue_t *queue);
+struct vs10xx_queue_buf_t* vs10xx_queue_gethead(struct vs10xx_queue_t *queue);
+
+void vs10xx_queue_enqueue(struct vs10xx_queue_t *queue);
+void vs10xx_queue_dequeue(struct vs10xx_queue_t *queue);
+
+int vs10xx_queue_share(struct vs10xx_queue_t *queue, struct vs10xx_queue_t **members, int count, int policy);
+void vs10xx_queue_unshare(struct vs10xx_queue_t *queue);
+int vs10xx_queue_isshared(struct vs10xx_queue_t *queue);
+
+unsigned vs10xx_queue_move(struct vs10xx_queue_t *src, struct vs10xx_queue_t *dst);
 
 #endif
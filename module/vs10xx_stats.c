@@ -0,0 +1,454 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx statistics.
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+#include "vs10xx_common.h"
+#include "vs10xx_stats.h"
+
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/math64.h>
+
+/* per cpu latency histograms, updated from the device thread and ioctl paths, summed when read */
+struct vs10xx_stats_lat_t {
+	struct vs10xx_hist_t hist[VS10XX_LAT_COUNT];
+	/* moments of VS10XX_LAT_WAKE [us], for the spread the histogram is too coarse for */
+	u64 wakes;
+	u64 wakesum;
+	u64 wakesq;
+	unsigned long wakemin;
+};
+
+static const char *vs10xx_stats_latname[VS10XX_LAT_COUNT] = { "refill", "spisync", "queuewait", "recovery", "wakeup" };
+
+static struct dentry *vs10xx_stats_root;
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX HISTOGRAMS                                                                                                             */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+void vs10xx_hist_add(struct vs10xx_hist_t *hist, unsigned long val) {
+
+	int n = (val ? fls(val) - 1 : 0);
+
+	hist->slot[MIN(n, VS10XX_HIST_SLOTS - 1)]++;
+
+	if (val > hist->max) {
+		hist->max = val;
+	}
+}
+
+void vs10xx_hist_clear(struct vs10xx_hist_t *hist) {
+
+	memset(hist, 0, sizeof(*hist));
+}
+
+int vs10xx_hist_print(struct vs10xx_hist_t *hist, const char *unit, char *buf, int size) {
+
+	int n, len = 0;
+
+	for (n = 0; n < VS10XX_HIST_SLOTS; n++) {
+
+		if (n < VS10XX_HIST_SLOTS - 1) {
+			len += scnprintf(buf + len, size - len, "%7lu..%-7lu%s: %lu\n", (n ? 1UL << n : 0), (2UL << n) - 1, unit, hist->slot[n]);
+		} else {
+			len += scnprintf(buf + len, size - len, "%7lu..       %s: %lu\n", 1UL << n, unit, hist->slot[n]);
+		}
+	}
+
+	len += scnprintf(buf + len, size - len, "max           %s: %lu\n", unit, hist->max);
+
+	return len;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX COUNTERS                                                                                                               */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+void vs10xx_stats_level(struct vs10xx_stats_dev_t *stats, int level) {
+
+	int low = ACCESS_ONCE(stats->low);
+
+	/* the writer updates the marks, sysfs reads and resets them */
+	if (level > ACCESS_ONCE(stats->high)) {
+		WRITE_ONCE(stats->high, level);
+	}
+
+	if (level < low || low < 0) {
+		WRITE_ONCE(stats->low, level);
+	}
+}
+
+void vs10xx_stats_xfer(struct vs10xx_stats_dev_t *stats, unsigned len) {
+
+	int n = (len ? fls(len) - 1 : 0);
+
+	vs10xx_stats_add(stats, sdi_bytes, len);
+	vs10xx_stats_inc(stats, spi_sizes[MIN(n, VS10XX_STATS_SIZES - 1)]);
+}
+
+void vs10xx_stats_latency(struct vs10xx_stats_dev_t *stats, int lat, ktime_t since) {
+
+	s64 usec = ktime_us_delta(ktime_get(), since);
+	unsigned long val = (usec > 0 ? (unsigned long)usec : 0);
+	struct vs10xx_stats_lat_t *pcpu;
+
+	/* no lock, only this cpu writes its copy and no interrupt handler takes samples */
+	preempt_disable();
+	pcpu = this_cpu_ptr(stats->lat);
+
+	vs10xx_hist_add(&pcpu->hist[lat], val);
+
+	if (lat == VS10XX_LAT_WAKE) {
+		if (pcpu->wakes == 0 || val < pcpu->wakemin) {
+			pcpu->wakemin = val;
+		}
+		pcpu->wakes++;
+		pcpu->wakesum += val;
+		pcpu->wakesq += (u64)val * val;
+	}
+
+	preempt_enable();
+}
+
+static void vs10xx_stats_hist(struct vs10xx_stats_dev_t *stats, int lat, struct vs10xx_hist_t *hist) {
+/*
+ *  Descr:  Sum a latency histogram over the cpus
+ *  Return: -
+ */
+
+	struct vs10xx_stats_lat_t *pcpu;
+	int cpu, n;
+
+	vs10xx_hist_clear(hist);
+
+	for_each_possible_cpu(cpu) {
+
+		pcpu = per_cpu_ptr(stats->lat, cpu);
+
+		for (n = 0; n < VS10XX_HIST_SLOTS; n++) {
+			hist->slot[n] += pcpu->hist[lat].slot[n];
+		}
+		hist->max = MAX(hist->max, pcpu->hist[lat].max);
+	}
+}
+
+static void vs10xx_stats_clrhist(struct vs10xx_stats_dev_t *stats, int lat) {
+
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		vs10xx_hist_clear(&per_cpu_ptr(stats->lat, cpu)->hist[lat]);
+	}
+}
+
+void vs10xx_stats_clear(struct vs10xx_stats_dev_t *stats) {
+
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		memset(per_cpu_ptr(stats->counters, cpu), 0, sizeof(struct vs10xx_stats_t));
+	}
+
+	WRITE_ONCE(stats->high, 0);
+	WRITE_ONCE(stats->low, -1);
+}
+
+int vs10xx_stats_print(struct vs10xx_stats_dev_t *stats, char *buf, int size) {
+
+	struct vs10xx_stats_t sum, *pcpu;
+	int cpu, n, len = 0;
+
+	memset(&sum, 0, sizeof(sum));
+
+	for_each_possible_cpu(cpu) {
+
+		/* other cpus keep counting, each field is read once */
+		pcpu = per_cpu_ptr(stats->counters, cpu);
+
+		sum.wr_bytes += ACCESS_ONCE(pcpu->wr_bytes);
+		sum.sdi_bytes += ACCESS_ONCE(pcpu->sdi_bytes);
+		sum.spi_xfers += ACCESS_ONCE(pcpu->spi_xfers);
+		for (n = 0; n < VS10XX_STATS_SIZES; n++) {
+			sum.spi_sizes[n] += ACCESS_ONCE(pcpu->spi_sizes[n]);
+		}
+		sum.dreq_waits += ACCESS_ONCE(pcpu->dreq_waits);
+		sum.dreq_timeouts += ACCESS_ONCE(pcpu->dreq_timeouts);
+		sum.irqs += ACCESS_ONCE(pcpu->irqs);
+		sum.wakeups += ACCESS_ONCE(pcpu->wakeups);
+		sum.lock_ns += ACCESS_ONCE(pcpu->lock_ns);
+		sum.spi_errors += ACCESS_ONCE(pcpu->spi_errors);
+		sum.faults += ACCESS_ONCE(pcpu->faults);
+		sum.drops += ACCESS_ONCE(pcpu->drops);
+		sum.drop_bytes += ACCESS_ONCE(pcpu->drop_bytes);
+		sum.silent_us += ACCESS_ONCE(pcpu->silent_us);
+		sum.watchdogs += ACCESS_ONCE(pcpu->watchdogs);
+	}
+
+	len += scnprintf(buf + len, size - len, "wr_bytes: %llu\n", (unsigned long long)sum.wr_bytes);
+	len += scnprintf(buf + len, size - len, "sdibytes: %llu\n", (unsigned long long)sum.sdi_bytes);
+	len += scnprintf(buf + len, size - len, "spixfers: %llu\n", (unsigned long long)sum.spi_xfers);
+	for (n = 0; n < VS10XX_STATS_SIZES; n++) {
+		len += scnprintf(buf + len, size - len, "spisz%3d: %llu\n", 1 << n, (unsigned long long)sum.spi_sizes[n]);
+	}
+	len += scnprintf(buf + len, size - len, "dreqwait: %llu\n", (unsigned long long)sum.dreq_waits);
+	len += scnprintf(buf + len, size - len, "dreqtout: %llu\n", (unsigned long long)sum.dreq_timeouts);
+	len += scnprintf(buf + len, size - len, "irqcount: %llu\n", (unsigned long long)sum.irqs);
+	len += scnprintf(buf + len, size - len, "wakeups : %llu\n", (unsigned long long)sum.wakeups);
+	len += scnprintf(buf + len, size - len, "lockedus: %llu\n", (unsigned long long)sum.lock_ns / 1000);
+	len += scnprintf(buf + len, size - len, "spierror: %llu\n", (unsigned long long)sum.spi_errors);
+	len += scnprintf(buf + len, size - len, "faults  : %llu\n", (unsigned long long)sum.faults);
+	len += scnprintf(buf + len, size - len, "dropped : %llu\n", (unsigned long long)sum.drops);
+	len += scnprintf(buf + len, size - len, "dropbyte: %llu\n", (unsigned long long)sum.drop_bytes);
+	len += scnprintf(buf + len, size - len, "silentus: %llu\n", (unsigned long long)sum.silent_us);
+	len += scnprintf(buf + len, size - len, "watchdog: %llu\n", (unsigned long long)sum.watchdogs);
+	len += scnprintf(buf + len, size - len, "queuehwm: %d\n", ACCESS_ONCE(stats->high));
+	len += scnprintf(buf + len, size - len, "queuelwm: %d\n", ACCESS_ONCE(stats->low));
+
+	return len;
+}
+
+int vs10xx_stats_jitter(struct vs10xx_stats_dev_t *stats, char *buf, int size) {
+/*
+ *  Descr:  Summary of the pump wakeup latency: how late the device thread ran after a dreq interrupt
+ *          or, polling, after its poll sleep. The p99 is the upper bound of its histogram slot.
+ *  Return: length
+ */
+
+	struct vs10xx_stats_lat_t *pcpu;
+	struct vs10xx_hist_t hist;
+	unsigned long min = 0, sum, p99 = 0;
+	u64 n = 0, wakesum = 0, wakesq = 0, avg, sq, var = 0;
+	int cpu, slot, len = 0;
+
+	vs10xx_stats_hist(stats, VS10XX_LAT_WAKE, &hist);
+
+	for_each_possible_cpu(cpu) {
+
+		pcpu = per_cpu_ptr(stats->lat, cpu);
+
+		if (pcpu->wakes && (n == 0 || pcpu->wakemin < min)) {
+			min = pcpu->wakemin;
+		}
+		n += pcpu->wakes;
+		wakesum += pcpu->wakesum;
+		wakesq += pcpu->wakesq;
+	}
+
+	avg = (n ? div64_u64(wakesum, n) : 0);
+	sq = (n ? div64_u64(wakesq, n) : 0);
+
+	if (sq > avg * avg) {
+		var = sq - avg * avg;
+	}
+
+	for (sum = 0, slot = 0; n && slot < VS10XX_HIST_SLOTS; slot++) {
+		sum += hist.slot[slot];
+		if ((u64)sum * 100 >= n * 99) {
+			p99 = (slot < VS10XX_HIST_SLOTS - 1 ? (2UL << slot) - 1 : hist.max);
+			break;
+		}
+	}
+
+	len += scnprintf(buf + len, size - len, "samples : %llu\n", (unsigned long long)n);
+	len += scnprintf(buf + len, size - len, "minus   : %lu\n", min);
+	len += scnprintf(buf + len, size - len, "avgus   : %llu\n", (unsigned long long)avg);
+	len += scnprintf(buf + len, size - len, "jitterus: %lu\n", int_sqrt((unsigned long)MIN(var, (u64)ULONG_MAX)));
+	len += scnprintf(buf + len, size - len, "p99us   : %lu\n", MIN(p99, hist.max));
+	len += scnprintf(buf + len, size - len, "maxus   : %lu\n", hist.max);
+
+	return len;
+}
+
+void vs10xx_stats_clrjitter(struct vs10xx_stats_dev_t *stats) {
+
+	struct vs10xx_stats_lat_t *pcpu;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+
+		pcpu = per_cpu_ptr(stats->lat, cpu);
+
+		vs10xx_hist_clear(&pcpu->hist[VS10XX_LAT_WAKE]);
+		pcpu->wakes = 0;
+		pcpu->wakesum = 0;
+		pcpu->wakesq = 0;
+		pcpu->wakemin = 0;
+	}
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX DEBUGFS                                                                                                                */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+/* each file is bound to one histogram, see struct vs10xx_stats_file_t */
+
+static int vs10xx_stats_open(struct inode *inode, struct file *filp) {
+
+	filp->private_data = inode->i_private;
+
+	return 0;
+}
+
+static ssize_t vs10xx_stats_read(struct file *filp, char __user *ubuf, size_t count, loff_t *ppos) {
+
+	struct vs10xx_stats_file_t *file = filp->private_data;
+	struct vs10xx_hist_t hist;
+	ssize_t status;
+	char *buf;
+	int len;
+
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (buf == NULL) {
+		return -ENOMEM;
+	}
+
+	/* print a snapshot, the histogram keeps counting */
+	vs10xx_stats_hist(file->stats, file->lat, &hist);
+
+	len = vs10xx_hist_print(&hist, "us", buf, PAGE_SIZE);
+	status = simple_read_from_buffer(ubuf, count, ppos, buf, len);
+
+	kfree(buf);
+
+	return status;
+}
+
+static ssize_t vs10xx_stats_write(struct file *filp, const char __user *ubuf, size_t count, loff_t *ppos) {
+
+	struct vs10xx_stats_file_t *file = filp->private_data;
+
+	if (file->lat == VS10XX_LAT_WAKE) {
+		/* the wakeup moments go with their histogram */
+		vs10xx_stats_clrjitter(file->stats);
+		return count;
+	}
+
+	/* any write clears the histogram */
+	vs10xx_stats_clrhist(file->stats, file->lat);
+
+	return count;
+}
+
+static const struct file_operations vs10xx_stats_fops = {
+	.owner = THIS_MODULE,
+	.open  = vs10xx_stats_open,
+	.read  = vs10xx_stats_read,
+	.write = vs10xx_stats_write,
+};
+
+struct dentry *vs10xx_stats_dir(struct vs10xx_stats_dev_t *stats) {
+/*
+ *  Descr:  Debugfs directory of a device, for other parts of the driver to add files to
+ *  Return: directory or NULL when debugfs is not there
+ */
+
+	return (stats != NULL ? stats->dir : NULL);
+}
+
+int vs10xx_stats_register(void) {
+
+	vs10xx_stats_root = debugfs_create_dir(VS10XX_NAME, NULL);
+
+	if (IS_ERR_OR_NULL(vs10xx_stats_root)) {
+
+		/* not fatal, histograms are just not visible */
+		vs10xx_wrn("debugfs_create_dir %s", VS10XX_NAME);
+		vs10xx_stats_root = NULL;
+	}
+
+	return 0;
+}
+
+void vs10xx_stats_unregister(void) {
+
+	debugfs_remove_recursive(vs10xx_stats_root);
+	vs10xx_stats_root = NULL;
+}
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* VS10XX STATS INIT/EXIT                                                                                                        */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+int vs10xx_stats_init(int id, struct vs10xx_stats_dev_t **stats) {
+
+	struct vs10xx_stats_dev_t *s;
+	char name[24];
+	int status = 0;
+	int lat;
+
+	s = kzalloc(sizeof(struct vs10xx_stats_dev_t), GFP_KERNEL);
+	*stats = s;
+
+	if (s == NULL) {
+
+		vs10xx_err("id:%d kzalloc", id);
+		return -1;
+	}
+
+	s->id = id;
+	s->lat = alloc_percpu(struct vs10xx_stats_lat_t);
+	s->counters = alloc_percpu(struct vs10xx_stats_t);
+
+	if (s->counters == NULL || s->lat == NULL) {
+
+		vs10xx_err("id:%d alloc_percpu", id);
+		status = -1;
+
+	} else {
+
+		vs10xx_stats_clear(s);
+	}
+
+	if (status == 0 && vs10xx_stats_root != NULL) {
+
+		snprintf(name, sizeof(name), "%s-%d", VS10XX_NAME, id);
+		s->dir = debugfs_create_dir(name, vs10xx_stats_root);
+
+		for (lat = 0; s->dir != NULL && lat < VS10XX_LAT_COUNT; lat++) {
+			s->file[lat].stats = s;
+			s->file[lat].lat = lat;
+			debugfs_create_file(vs10xx_stats_latname[lat], 0644, s->dir, &s->file[lat], &vs10xx_stats_fops);
+		}
+	}
+
+	return status;
+}
+
+void vs10xx_stats_exit(struct vs10xx_stats_dev_t *stats) {
+
+	if (stats == NULL) {
+		return;
+	}
+
+	debugfs_remove_recursive(stats->dir);
+
+	if (stats->lat != NULL) {
+		free_percpu(stats->lat);
+	}
+
+	if (stats->counters != NULL) {
+		free_percpu(stats->counters);
+	}
+
+	kfree(stats);
+}
@@ -0,0 +1,107 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx statistics.
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+#ifndef VS10XX_STATS_H
+#define VS10XX_STATS_H
+
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+
+struct dentry;
+
+/* log2 histogram, slot n counts values in [2^n, 2^(n+1)), the last slot counts everything above */
+#define VS10XX_HIST_SLOTS 16
+
+struct vs10xx_hist_t {
+	unsigned long slot[VS10XX_HIST_SLOTS];
+	unsigned long max;
+};
+
+/* sdi transfer sizes, log2 slots 1, 2..3, 4..7, .., 32.. bytes */
+#define VS10XX_STATS_SIZES 6
+
+/* per cpu counters, summed when read */
+struct vs10xx_stats_t {
+	u64 wr_bytes;      /* bytes accepted by write()      */
+	u64 sdi_bytes;     /* bytes sent over sdi            */
+	u64 spi_xfers;     /* spi messages, sci and sdi      */
+	u64 spi_sizes[VS10XX_STATS_SIZES];
+	u64 dreq_waits;    /* waits for dreq to become high  */
+	u64 dreq_timeouts; /* waits that timed out           */
+	u64 irqs;          /* dreq interrupts                */
+	u64 wakeups;       /* device thread loop iterations  */
+	u64 lock_ns;       /* time the device lock was held  */
+	u64 spi_errors;    /* failed spi messages            */
+	u64 faults;        /* failures the pump recovered of */
+	u64 drops;         /* chunks given up after retries  */
+	u64 drop_bytes;    /* audio bytes never sent         */
+	u64 silent_us;     /* decoder starved during faults  */
+	u64 watchdogs;     /* stalled decoders reset         */
+};
+
+/* latency histograms [usec], exposed in debugfs */
+#define VS10XX_LAT_REFILL 0 /* dreq rising to first sdi byte */
+#define VS10XX_LAT_SPI    1 /* spi_sync duration             */
+#define VS10XX_LAT_QUEUE  2 /* time a chunk spent queued     */
+#define VS10XX_LAT_RECOV  3 /* first failure to next sdi     */
+#define VS10XX_LAT_WAKE   4 /* dreq irq or poll to pump run  */
+#define VS10XX_LAT_COUNT  5
+
+struct vs10xx_stats_lat_t;
+struct vs10xx_stats_dev_t;
+
+/* a debugfs histogram file */
+struct vs10xx_stats_file_t {
+	struct vs10xx_stats_dev_t *stats;
+	int lat;
+};
+
+/* per device, part of the device context */
+struct vs10xx_stats_dev_t {
+	int id;
+	struct vs10xx_stats_t __percpu *counters;
+	/* queue water marks, only the writer and the device thread update them */
+	int high;
+	int low;
+	struct vs10xx_stats_lat_t __percpu *lat;
+	struct vs10xx_stats_file_t file[VS10XX_LAT_COUNT];
+	struct dentry *dir;
+};
+
+#define vs10xx_stats_add(stats, field, n) this_cpu_add((stats)->counters->field, (n))
+#define vs10xx_stats_inc(stats, field) this_cpu_inc((stats)->counters->field)
+
+int vs10xx_stats_register(void);
+void vs10xx_stats_unregister(void);
+int vs10xx_stats_init(int id, struct vs10xx_stats_dev_t **stats);
+void vs10xx_stats_exit(struct vs10xx_stats_dev_t *stats);
+void vs10xx_stats_clear(struct vs10xx_stats_dev_t *stats);
+void vs10xx_stats_level(struct vs10xx_stats_dev_t *stats, int level);
+void vs10xx_stats_xfer(struct vs10xx_stats_dev_t *stats, unsigned len);
+void vs10xx_stats_latency(struct vs10xx_stats_dev_t *stats, int lat, ktime_t since);
+int vs10xx_stats_print(struct vs10xx_stats_dev_t *stats, char *buf, int size);
+int vs10xx_stats_jitter(struct vs10xx_stats_dev_t *stats, char *buf, int size);
+void vs10xx_stats_clrjitter(struct vs10xx_stats_dev_t *stats);
+struct dentry *vs10xx_stats_dir(struct vs10xx_stats_dev_t *stats);
+
+void vs10xx_hist_add(struct vs10xx_hist_t *hist, unsigned long val);
+void vs10xx_hist_clear(struct vs10xx_hist_t *hist);
+int vs10xx_hist_print(struct vs10xx_hist_t *hist, const char *unit, char *buf, int size);
+
+#endif
@@ -0,0 +1,218 @@
+/* ------------------------------------------------------------------------------------------------------------------------------
+    vs10xx trace events.
+    Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+   ----------------------------------------------------------------------------------------------------------------------------- */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM vs10xx
+
+#if !defined(VS10XX_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define VS10XX_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/ktime.h>
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* WRITE PATH                                                                                                                    */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+TRACE_EVENT(vs10xx_write,
+
+	TP_PROTO(int id, size_t len, int copied, int level),
+
+	TP_ARGS(id, len, copied, level),
+
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(size_t, len)
+		__field(int, copied)
+		__field(int, level)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->len = len;
+		__entry->copied = copied;
+		__entry->level = level;
+	),
+
+	TP_printk("id=%d len=%zu copied=%d level=%d",
+		__entry->id, __entry->len, __entry->copied, __entry->level)
+);
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* QUEUE                                                                                                                         */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+DECLARE_EVENT_CLASS(vs10xx_queue,
+
+	TP_PROTO(int id, unsigned len, int level),
+
+	TP_ARGS(id, len, level),
+
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(unsigned, len)
+		__field(int, level)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->len = len;
+		__entry->level = level;
+	),
+
+	TP_printk("id=%d len=%u level=%d",
+		__entry->id, __entry->len, __entry->level)
+);
+
+DEFINE_EVENT(vs10xx_queue, vs10xx_queue_enqueue,
+
+	TP_PROTO(int id, unsigned len, int level),
+
+	TP_ARGS(id, len, level)
+);
+
+DEFINE_EVENT(vs10xx_queue, vs10xx_queue_dequeue,
+
+	TP_PROTO(int id, unsigned len, int level),
+
+	TP_ARGS(id, len, level)
+);
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* SPI AND DREQ                                                                                                                  */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+TRACE_EVENT(vs10xx_io_data_tx,
+
+	TP_PROTO(int id, unsigned len, int status, s64 start_ns),
+
+	TP_ARGS(id, len, status, start_ns),
+
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(unsigned, len)
+		__field(int, status)
+		__field(s64, start_ns)
+		__field(s64, end_ns)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->len = len;
+		__entry->status = status;
+		__entry->start_ns = start_ns;
+		/* read only when the event is on, the call site passes no end time */
+		__entry->end_ns = ktime_to_ns(ktime_get());
+	),
+
+	TP_printk("id=%d len=%u status=%d start=%lld dur_ns=%lld",
+		__entry->id, __entry->len, __entry->status, __entry->start_ns, __entry->end_ns - __entry->start_ns)
+);
+
+TRACE_EVENT(vs10xx_io_ctrl_xf,
+
+	TP_PROTO(int id, unsigned txlen, unsigned rxlen, unsigned n, int status, s64 start_ns),
+
+	TP_ARGS(id, txlen, rxlen, n, status, start_ns),
+
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(unsigned, txlen)
+		__field(unsigned, rxlen)
+		__field(unsigned, n)
+		__field(int, status)
+		__field(s64, start_ns)
+		__field(s64, end_ns)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->txlen = txlen;
+		__entry->rxlen = rxlen;
+		__entry->n = n;
+		__entry->status = status;
+		__entry->start_ns = start_ns;
+		/* read only when the event is on, the call site passes no end time */
+		__entry->end_ns = ktime_to_ns(ktime_get());
+	),
+
+	TP_printk("id=%d tx=%u rx=%u n=%u status=%d start=%lld dur_ns=%lld",
+		__entry->id, __entry->txlen, __entry->rxlen, __entry->n, __entry->status,
+		__entry->start_ns, __entry->end_ns - __entry->start_ns)
+);
+
+TRACE_EVENT(vs10xx_io_irq,
+
+	TP_PROTO(int id, int dreq),
+
+	TP_ARGS(id, dreq),
+
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(int, dreq)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->dreq = dreq;
+	),
+
+	TP_printk("id=%d dreq=%d", __entry->id, __entry->dreq)
+);
+
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+/* DEVICE THREAD                                                                                                                 */
+/* ----------------------------------------------------------------------------------------------------------------------------- */
+
+TRACE_EVENT(vs10xx_pump_state,
+
+	TP_PROTO(int id, int state, int level),
+
+	TP_ARGS(id, state, level),
+
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(int, state)
+		__field(int, level)
+	),
+
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->state = state;
+		__entry->level = level;
+	),
+
+	TP_printk("id=%d state=%s level=%d", __entry->id,
+		__print_symbolic(__entry->state,
+			{ VS10XX_PUMP_PAUSED,   "paused"   },
+			{ VS10XX_PUMP_WAITING,  "waiting"  },
+			{ VS10XX_PUMP_SENDING,  "sending"  },
+			{ VS10XX_PUMP_UNDERRUN, "underrun" },
+			{ VS10XX_PUMP_CLOSING,  "closing"  }),
+		__entry->level)
+);
+
+#endif
+
+/* this part must be outside the header guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE vs10xx_trace
+#include <trace/define_trace.h>
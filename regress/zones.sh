@@ -0,0 +1,246 @@
+#!/bin/sh
+# ------------------------------------------------------------------------------------------------------------------------------
+#   vs10xx multi-zone cpu and wakeup regression suite.
+#   Copyright (C) 2010-2013 Richard van Paasen <rvp-nl@t3i.nl>
+#
+#   This program is free software; you can redistribute it and/or modify
+#   it under the terms of the GNU General Public License as published by
+#   the Free Software Foundation; either version 2 of the License, or
+#   (at your option) any later version.
+#
+#   Streams to N devices at realistic bitrates with ioctl/bench and records per profile:
+#     kthread_cpu  cpu time of the vs10xx-N threads          [% of one cpu]
+#     writer_cpu   cpu time of the writer threads             [% of one cpu]
+#     ctxsw_s      context switches, whole system             [1/s]
+#     kthread_cs_s context switches of the vs10xx-N threads   [1/s]
+#     irq_s        DREQ interrupts (driver irqcount)          [1/s]
+#     wakeups_s    pump wakeups (driver wakeups)              [1/s]
+#     timer_s      timer wakeups from /proc/timer_stats       [1/s, - if not available]
+#     underruns    decoder underruns
+#   and compares them with a baseline, any metric above baseline * (1 + tolerance) is a regression.
+#   Empty or - baseline fields are not checked and the columns that were are listed with the verdict.
+#   baselines/at91sam9-200mhz.csv only holds the quoted mp3-128 figure, comparing with it checks pump
+#   cpu (kthread_cpu) and underruns only. Save a full baseline per board or emulator host with -s.
+# ------------------------------------------------------------------------------------------------------------------------------
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+BENCH=${BENCH:-$DIR/../ioctl/bench}
+
+DEVICES=4
+SECONDS_RUN=30
+PROFILES="mp3-128:128 mp3-320:320 flac:900"
+EMUL=0
+BASELINE=
+SAVE=
+RESULTS=
+TOLERANCE=20
+
+usage() {
+	cat <<USAGE
+Usage: $0 [options]
+
+Options:
+  -h               help
+  -n devices       number of devices (4)
+  -t seconds       duration per profile (30)
+  -p profiles      name:kbit/s list ("$PROFILES")
+  -e               load emul/vs10xx_emul.ko and module/vs10xx.ko irqmode=0 first
+  -b baseline      compare with this baseline csv
+  -s baseline      save the results as baseline csv
+  -o results       append the results to a csv file
+  -T percent       tolerance (20)
+USAGE
+}
+
+while getopts "hn:t:p:eb:s:o:T:" opt; do
+	case $opt in
+		n) DEVICES=$OPTARG ;;
+		t) SECONDS_RUN=$OPTARG ;;
+		p) PROFILES=$OPTARG ;;
+		e) EMUL=1 ;;
+		b) BASELINE=$OPTARG ;;
+		s) SAVE=$OPTARG ;;
+		o) RESULTS=$OPTARG ;;
+		T) TOLERANCE=$OPTARG ;;
+		h) usage; exit 0 ;;
+		*) usage; exit 1 ;;
+	esac
+done
+
+HEADER="profile,devices,kthread_cpu,writer_cpu,ctxsw_s,kthread_cs_s,irq_s,wakeups_s,timer_s,underruns"
+HZ=$(getconf CLK_TCK 2>/dev/null || echo 100)
+TMP=$(mktemp -d /tmp/vs10xx-zones.XXXXXX) || exit 1
+
+cleanup() {
+	if [ "$EMUL" = 1 ]; then
+		rmmod vs10xx 2>/dev/null
+		rmmod vs10xx_emul 2>/dev/null
+	fi
+	rm -rf "$TMP"
+}
+trap cleanup EXIT INT TERM
+
+# ------------------------------------------------------------------------------------------------------------------------------
+# sampling
+# ------------------------------------------------------------------------------------------------------------------------------
+
+kthread_pids() {
+	for p in /proc/[0-9]*; do
+		case "$(cat "$p/comm" 2>/dev/null)" in
+			vs10xx-[0-9]*) echo "${p#/proc/}" ;;
+		esac
+	done
+}
+
+# utime + stime [ticks] and context switches of the pump threads
+kthread_sample() {
+	ticks=0; cs=0
+	for pid in $KPIDS; do
+		t=$(awk '{ print $14 + $15 }' "/proc/$pid/stat" 2>/dev/null || echo 0)
+		c=$(awk '/ctxt_switches/ { n += $2 } END { print n + 0 }' "/proc/$pid/status" 2>/dev/null || echo 0)
+		ticks=$((ticks + t)); cs=$((cs + c))
+	done
+	echo "$ticks $cs"
+}
+
+system_ctxt() {
+	awk '/^ctxt/ { print $2 }' /proc/stat
+}
+
+# sum of a counter over the sysfs stats of all devices
+driver_counter() {
+	n=0; i=0
+	while [ $i -lt "$DEVICES" ]; do
+		v=$(awk -F: -v k="$1" '{ gsub(/ /, "", $1) } $1 == k { print $2 + 0 }' "/sys/class/vs10xx/vs10xx-$i/stats" 2>/dev/null)
+		n=$((n + ${v:-0})); i=$((i + 1))
+	done
+	echo $n
+}
+
+driver_clear() {
+	i=0
+	while [ $i -lt "$DEVICES" ]; do
+		echo 0 > "/sys/class/vs10xx/vs10xx-$i/stats" 2>/dev/null
+		i=$((i + 1))
+	done
+}
+
+timer_start() {
+	[ -w /proc/timer_stats ] && echo 1 > /proc/timer_stats
+}
+
+# timer events of the pump threads, stops collection
+timer_count() {
+	if [ -w /proc/timer_stats ]; then
+		awk '/vs10xx-[0-9]/ { sub(/D?,/, "", $1); n += $1 } END { print n + 0 }' /proc/timer_stats
+		echo 0 > /proc/timer_stats
+	else
+		echo -
+	fi
+}
+
+# ------------------------------------------------------------------------------------------------------------------------------
+# run
+# ------------------------------------------------------------------------------------------------------------------------------
+
+if [ "$EMUL" = 1 ]; then
+	insmod "$DIR/../emul/vs10xx_emul.ko" devices="$DEVICES" || exit 1
+	insmod "$DIR/../module/vs10xx.ko" irqmode=0 || exit 1
+fi
+
+[ -x "$BENCH" ] || { echo "no bench tool at $BENCH, run make in ioctl/"; exit 1; }
+
+KPIDS=$(kthread_pids)
+[ -n "$KPIDS" ] || { echo "no vs10xx threads, is the driver loaded?"; exit 1; }
+
+echo "$HEADER" > "$TMP/results.csv"
+
+for profile in $PROFILES; do
+
+	name=${profile%%:*}
+	kbps=${profile#*:}
+
+	if [ -w /sys/module/vs10xx_emul/parameters/bitrate ]; then
+		echo $((kbps * 1000)) > /sys/module/vs10xx_emul/parameters/bitrate
+	fi
+
+	devs=; i=0
+	while [ $i -lt "$DEVICES" ]; do
+		devs="$devs -d /dev/vs10xx-$i"; i=$((i + 1))
+	done
+
+	driver_clear
+	rm -f "$TMP/bench.csv"
+	set -- $(kthread_sample); k0=$1; kc0=$2
+	c0=$(system_ctxt)
+	timer_start
+
+	# shellcheck disable=SC2086
+	"$BENCH" $devs -r "$kbps" -t "$SECONDS_RUN" -c "$TMP/bench.csv" > "$TMP/bench.log" || {
+		cat "$TMP/bench.log"; exit 1; }
+
+	tm=$(timer_count)
+	c1=$(system_ctxt)
+	set -- $(kthread_sample); k1=$1; kc1=$2
+	irqs=$(driver_counter irqcount)
+	wakeups=$(driver_counter wakeups)
+
+	awk -F, -v name="$name" -v n="$DEVICES" -v s="$SECONDS_RUN" -v hz="$HZ" \
+		-v kt=$((k1 - k0)) -v kc=$((kc1 - kc0)) -v cs=$((c1 - c0)) -v irq="$irqs" -v wk="$wakeups" -v tm="$tm" '
+		NR > 1 { cpu += $15; under += $17 }
+		END {
+			printf "%s,%d,%.2f,%.2f,%.1f,%.1f,%.1f,%.1f,%s,%d\n", name, n, 100 * kt / hz / s, cpu,
+				cs / s, kc / s, irq / s, wk / s, (tm == "-" ? "-" : sprintf("%.1f", tm / s)), under
+		}' "$TMP/bench.csv" >> "$TMP/results.csv"
+
+	tail -n 1 "$TMP/results.csv"
+done
+
+echo
+column -s, -t < "$TMP/results.csv" 2>/dev/null || cat "$TMP/results.csv"
+
+if [ -n "$RESULTS" ]; then
+	[ -s "$RESULTS" ] || echo "time,$HEADER" > "$RESULTS"
+	now=$(date +%s)
+	tail -n +2 "$TMP/results.csv" | sed "s/^/$now,/" >> "$RESULTS"
+fi
+
+if [ -n "$SAVE" ]; then
+	cp "$TMP/results.csv" "$SAVE"
+	echo "baseline saved to $SAVE"
+fi
+
+# ------------------------------------------------------------------------------------------------------------------------------
+# compare
+# ------------------------------------------------------------------------------------------------------------------------------
+
+if [ -n "$BASELINE" ]; then
+
+	echo
+	awk -F, -v tol="$TOLERANCE" '
+		FNR == 1 { for (i = 1; i <= NF; i++) col[FILENAME, i] = $i; next }
+		NR == FNR { base[$1 "," $2] = $0; next }
+		{
+			key = $1 "," $2
+			if (!(key in base)) { printf "%-10s %d devices: no baseline\n", $1, $2; next }
+			split(base[key], b, ",")
+			for (i = 3; i <= NF; i++) {
+				if (b[i] == "" || b[i] == "-" || $i == "-") continue
+				if (!(i in checked)) { checked[i]; names = names " " col[FILENAME, i] }
+				# underruns have no tolerance, small rates get one unit of slack
+				limit = (i == NF ? b[i] : b[i] * (1 + tol / 100) + 1)
+				if ($i + 0 > limit) {
+					printf "%-10s %d devices: %s %s > baseline %s\n", $1, $2, col[FILENAME, i], $i, b[i]
+					fail = 1
+				}
+			}
+		}
+		END {
+			print "checked:" (names == "" ? " nothing" : names)
+			if (fail) { print "REGRESSION"; exit 1 }
+			print "ok"
+		}' "$BASELINE" "$TMP/results.csv"
+	exit $?
+fi
+
+exit 0